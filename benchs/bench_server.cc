@@ -1,6 +1,7 @@
 #include <gflags/gflags.h>
 
 #include "../core/lib.hh"
+#include "../core/rmem/alloc.hh"
 
 DEFINE_int64(port, 8888, "Server listener (UDP) port.");
 DEFINE_int64(use_nic_idx, 0, "Which NIC to create QP");
@@ -31,11 +32,15 @@ int main(int argc, char **argv) {
     }
 
     {
-      for (uint i = 0; i < RNicInfo::query_dev_names().size(); ++i)
-        // allocate a memory (with 20M) so that remote QP can access it
-        RDMA_ASSERT(ctrl.registered_mrs.create_then_reg(
-            i, Arc<RMem>(new RMem(1024 * 1024 * 64)),
-            ctrl.opened_nics.query(i).value())) << "reg mem at: " << i << " error";
+      for (uint i = 0; i < RNicInfo::query_dev_names().size(); ++i) {
+        auto nic = ctrl.opened_nics.query(i).value();
+        // allocate a memory (with 64M) so that remote QP can access it,
+        // on hugepages near the NIC so random reads do not thrash its MTT
+        auto mem = RMemAlloc::create(1024 * 1024 * 64, AllocPolicy::near(nic))
+                       .value();
+        RDMA_ASSERT(ctrl.registered_mrs.create_then_reg(i, mem, nic))
+            << "reg mem at: " << i << " error";
+      }
       }
 
     // initialzie the value so as client can sanity check its content
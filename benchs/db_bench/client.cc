@@ -8,6 +8,8 @@
 #include "../thread.hh"
 #include "../bench_op.hh"
 
+#include "../../core/qps/doorbell_batch.hh"
+
 using namespace rdmaio;
 using namespace rdmaio::qp;
 using namespace rdmaio::rmem;
@@ -105,39 +107,31 @@ usize worker_fn(const usize &worker_id, Statics *s) {
     ops[i].set_type(FLAGS_op_type);
     ops[i].init_lbuf(test_buf, sizeof(u64), qp->local_mr.value().key, 1000);
     ops[i].init_rbuf(remote_buf, remote_attr.key, 10000);
-    ops[i].set_wrid(i);
-    if (i != 0) {
-      ops[i - 1].set_next(&(ops[i]));
-    }
   }
 
-  int or_max = qp->my_config.max_send_sz() / 2;
+  // the QP signals one out of half of its send queue, and reclaims the queue
+  // before it overflows
+  qp->enable_selective_signal(qp->my_config.max_send_sz() / 2);
+  // requests are posted with one doorbell once db_factor of them are added
+  DoorbellBatch<db_factor> batch(qp);
 
   while (running) {
-    int or_idx = 0;
-    for (int i = 0; i < FLAGS_or_factor; i += db_factor, or_idx += db_factor) {
+    for (int i = 0; i < FLAGS_or_factor; i += db_factor) {
       compile_fence();
       // access remote data randomly
       for (int j = 0; j < db_factor; ++j) {
         ops[j].refresh();
+        // the last request is signaled so that we can wait for this round
+        ops[j].set_flags((i + j == FLAGS_or_factor - 1) ? IBV_SEND_SIGNALED
+                                                          : 0);
+        auto res_s = batch.add(ops[j], j);
+        RDMA_ASSERT(res_s == IOCode::Ok);
       }
-
-      int flags = 0;
-      if (or_idx == 0 || or_idx >= or_max) {
-        flags = IBV_SEND_SIGNALED;
-        or_idx = 0;
-      }
-      ops[db_factor - 1].set_flags(flags);
-      auto res_s = ops[0].execute_batch(qp);
-      RDMA_ASSERT(res_s == IOCode::Ok);
-
-      if (flags == IBV_SEND_SIGNALED && i != 0) {
-        auto res_p = qp->wait_one_comp();
-        RDMA_ASSERT(res_p == IOCode::Ok);
-      }
     }
-    auto res_p = qp->wait_one_comp();
-    RDMA_ASSERT(res_p == IOCode::Ok);
+    while (qp->ongoing_signaled() > 0) {
+      auto res_p = qp->wait_rc_comp();
+      RDMA_ASSERT(res_p == IOCode::Ok);
+    }
     ss.increment(FLAGS_or_factor);
   }
   RDMA_LOG(4) << "t-" << worker_id << " stoped";
@@ -98,7 +98,8 @@ usize worker_fn(const usize &worker_id, Statics *s) {
   op.set_read().set_imm(0);
   op.set_payload(test_buf, sizeof(u64), qp->local_mr.value().key);
 
-  u64 recv_cnt = 0, flying_cnt = 0, try_rounds = 5;
+  ibv_wc wcs[64];
+  u64 recv_cnt = 0, flying_cnt = 0;
   while (running) {
     for (int i = 0; i < FLAGS_para_factor - flying_cnt; ++i) {
       compile_fence();
@@ -109,20 +110,17 @@ usize worker_fn(const usize &worker_id, Statics *s) {
       ss.increment();  // finish one request
     }
 
-    for (int i = 0; i < try_rounds; i++) {
-      auto res_p = qp->wait_one_comp(0);
-      if (res_p == IOCode::Ok) {
-        recv_cnt++;
-      }
+    // drain the finished requests in a batch
+    auto comps = qp->poll_rc_comps(wcs);
+    for (auto &wc : comps) {
+      RDMA_ASSERT(wc.status == IBV_WC_SUCCESS) << RC::wc_status(wc);
     }
+    recv_cnt += comps.size();
     flying_cnt = ss.data.counter - recv_cnt;
   }
   RDMA_LOG(4) << "t-" << worker_id << " stoped";
   while (recv_cnt < ss.data.counter) {
-    auto res_p = qp->wait_one_comp(0);
-    if (res_p == IOCode::Ok) {
-      recv_cnt++;
-    }
+    recv_cnt += qp->poll_rc_comps(wcs).size();
   }
   cm.delete_remote_rc(
       FLAGS_client_name + " thread-qp" + std::to_string(worker_id), key);
@@ -99,30 +99,25 @@ usize worker_fn(const usize &worker_id, Statics *s) {
   op.set_read().set_imm(0);
   op.set_payload(test_buf, sizeof(u64), qp->local_mr.value().key);
 
-  int or_max = qp->my_config.max_send_sz() / 2;
+  // the QP signals one out of half of its send queue, and reclaims the queue
+  // before it overflows
+  qp->enable_selective_signal(qp->my_config.max_send_sz() / 2);
 
   while (running) {
-    int or_idx = 0;
-    for (int i = 0; i < FLAGS_or_factor; ++i, ++or_idx) {
+    for (int i = 0; i < FLAGS_or_factor; ++i) {
       compile_fence();
       int index = rand.next() % 10000;
       op.set_rdma_rbuf(remote_buf + index, remote_attr.key);
 
-      int flags = 0;
-      if (or_idx == 0 || or_idx >= or_max) {
-        flags = IBV_SEND_SIGNALED;
-        or_idx = 0;
-      }
+      // the last request is signaled so that we can wait for this round
+      int flags = (i == FLAGS_or_factor - 1) ? IBV_SEND_SIGNALED : 0;
       auto res_s = op.execute(qp, flags);
       RDMA_ASSERT(res_s == IOCode::Ok);
-
-      if (flags == IBV_SEND_SIGNALED && i != 0) {
-        auto res_p = qp->wait_one_comp();
-        RDMA_ASSERT(res_p == IOCode::Ok);
-      }
     }
-    auto res_p = qp->wait_one_comp();
-    RDMA_ASSERT(res_p == IOCode::Ok);
+    while (qp->ongoing_signaled() > 0) {
+      auto res_p = qp->wait_rc_comp();
+      RDMA_ASSERT(res_p == IOCode::Ok);
+    }
     ss.increment(FLAGS_or_factor);
   }
   RDMA_LOG(4) << "t-" << worker_id << " stoped";
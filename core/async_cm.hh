@@ -0,0 +1,446 @@
+#pragma once
+
+#include <functional>
+#include <tuple>
+#include <unordered_map>
+
+#include "./lib.hh"
+
+namespace rdmaio {
+
+/*!
+  An asynchronous connect manager, which talks to many RCtrl servers
+  concurrently, using one UDP socket.
+
+  Unlike ConnectManager, a call never blocks: it returns once the request is
+  sent, and its reply is matched by the request id (i.e., the checksum of
+  SRpc) in poll(), which calls the callback of the call.
+  So connecting to N servers takes about one round trip, and a slow (or dead)
+  server only delays the calls to itself.
+
+  The calls are retried with an exponential backoff (from init_backoff_usec,
+  doubled each time up to max_backoff_usec), until the reply or the timeout.
+  A retried request may be executed twice at the server, so only the
+  idempotent calls are retried, e.g., fetching attrs, but not creating QPs.
+
+  \note: AsyncCM is not thread-safe.
+  \note: a reply too large for one message (see SRpc::call_large) is not
+  fetched, and the call fails with "reply too large"; use SRpc for them.
+
+  Example:
+  `
+  auto cm = AsyncCM::create().value();
+  std::vector<AsyncCM::server_id_t> servers;
+  for (auto &addr : addrs)
+    servers.push_back(cm->add_server(addr).value());
+
+  for (auto s : servers) {
+    cm->fetch_remote_mr(s, 73, [](Result<ConnectManager::mr_res_t> &res) {
+      if (res == IOCode::Ok) {
+        // use std::get<1>(res.desc)
+      }
+    });
+  }
+  cm->wait_all(1000000); // or, call cm->poll() in the event loop
+  `
+ */
+class AsyncCM {
+public:
+  using server_id_t = u32;
+  using req_id_t = u64;
+  using reply_cb_t = std::function<void(Result<ByteBuffer> &)>;
+
+  struct Stats {
+    u64 sent = 0;
+    u64 retries = 0;
+    u64 timeouts = 0;
+    // replies that match no outstanding call, e.g., of a retried call
+    u64 stale = 0;
+  };
+
+  // the backoff of the retries, in usec
+  double init_backoff_usec = 10000;
+  double max_backoff_usec = 500000;
+
+  Stats stats;
+
+private:
+  struct Pending {
+    server_id_t server;
+    ByteBuffer msg;
+    reply_cb_t cb;
+    bool retry;
+    // in usec, measured by the timer
+    double deadline;
+    double next_retry;
+    double backoff;
+  };
+
+  Arc<::rdmaio::bootstrap::MultiSendChannel> channel;
+  std::vector<sockaddr_in> servers;
+
+  std::unordered_map<req_id_t, Pending> pending;
+  // replies of the calls without callbacks, see take_reply()
+  std::unordered_map<req_id_t, Result<ByteBuffer>> completed;
+
+  req_id_t next_id = SRpc::invalid_checksum + 1;
+  Timer timer;
+  ByteBuffer recv_buf;
+
+  explicit AsyncCM(Arc<::rdmaio::bootstrap::MultiSendChannel> channel)
+      : channel(channel) {}
+
+public:
+  static Option<Arc<AsyncCM>> create() {
+    auto channel = ::rdmaio::bootstrap::MultiSendChannel::create();
+    if (!channel)
+      return {};
+    return Arc<AsyncCM>(new AsyncCM(channel.value()));
+  }
+
+  /*!
+    Add a server in the format (ip:port)
+   */
+  Option<server_id_t> add_server(const std::string &addr) {
+    auto res = ::rdmaio::bootstrap::MultiSendChannel::resolve(addr);
+    if (!res)
+      return {};
+    servers.push_back(res.value());
+    return static_cast<server_id_t>(servers.size() - 1);
+  }
+
+  usize num_servers() const { return servers.size(); }
+
+  usize outstanding() const { return pending.size(); }
+
+  /*!
+    Call the RPC *id* of the server, without blocking.
+    The reply is passed to *cb* in poll(), or kept for take_reply() if cb is
+    null. If no reply arrives in timeout_usec, the reply is Timeout.
+    \param retry: whether to retry the call, only for idempotent RPCs
+    \ret: the id of the call
+   */
+  Result<req_id_t> call(const server_id_t &server, const rpc_id_t &id,
+                        const ByteBuffer &parameter, reply_cb_t cb = nullptr,
+                        const double &timeout_usec = 1000000,
+                        const bool &retry = true) {
+    if (unlikely(server >= servers.size()))
+      return ::rdmaio::Err(static_cast<req_id_t>(0));
+
+    auto mmsg_o = MultiMsg<kMaxMsgSz>::create_exact(sizeof(SRpcHeader) +
+                                                    parameter.size());
+    if (unlikely(!mmsg_o))
+      return ::rdmaio::Err(static_cast<req_id_t>(0));
+    auto &mmsg = mmsg_o.value();
+    mmsg.alloc = true; // so the buf is freed with the msg
+
+    const req_id_t req_id = next_id++;
+    RDMA_ASSERT(mmsg.append(::rdmaio::Marshal::dump<SRpcHeader>(
+        {.id = id, .checksum = req_id})));
+    RDMA_ASSERT(mmsg.append(parameter));
+
+    auto res = channel->send_to(*mmsg.buf, servers[server]);
+    if (unlikely(res != IOCode::Ok))
+      return ::rdmaio::transfer(res, static_cast<req_id_t>(0));
+    stats.sent += 1;
+
+    const double now = timer.passed_msec();
+    pending.insert(std::make_pair(
+        req_id, Pending({.server = server,
+                         .msg = *mmsg.buf,
+                         .cb = cb,
+                         .retry = retry,
+                         .deadline = now + timeout_usec,
+                         .next_retry = now + init_backoff_usec,
+                         .backoff = init_backoff_usec})));
+    return ::rdmaio::Ok(req_id);
+  }
+
+  /*!
+    Take the reply of a call issued without a callback
+    \ret: {} if the call has not completed
+   */
+  Option<Result<ByteBuffer>> take_reply(const req_id_t &id) {
+    auto it = completed.find(id);
+    if (it == completed.end())
+      return {};
+    auto ret = it->second;
+    completed.erase(it);
+    return ret;
+  }
+
+  /*!
+    Handle the received replies, and retry (or expire) the outstanding calls.
+    The callbacks of the completed calls are called here.
+    \ret: #of calls completed
+   */
+  usize poll() {
+    // (id, cb, reply) of the completed calls
+    std::vector<std::tuple<req_id_t, reply_cb_t, Result<ByteBuffer>>> done;
+
+    // 1. match the replies with the outstanding calls
+    while (channel->recv_one(recv_buf) == IOCode::Ok) {
+      auto mm_o = MultiMsg<kMaxMsgSz>::create_from(recv_buf);
+      if (!mm_o) {
+        stats.stale += 1;
+        continue;
+      }
+      auto &mm = mm_o.value();
+      auto header_buf = mm.view_one(0);
+      auto header = header_buf
+                        ? ::rdmaio::Marshal::dedump<SReplyHeader>(
+                              header_buf.value())
+                        : Option<SReplyHeader>();
+      if (!header) {
+        stats.stale += 1;
+        continue;
+      }
+      auto it = pending.find(header.value().checksum);
+      if (it == pending.end()) {
+        stats.stale += 1;
+        continue;
+      }
+
+      done.emplace_back(it->first, std::move(it->second.cb),
+                        decode_reply(header.value(), mm));
+      pending.erase(it);
+    }
+
+    // 2. retry or expire the calls without replies
+    const double now = timer.passed_msec();
+    for (auto it = pending.begin(); it != pending.end();) {
+      auto &p = it->second;
+      if (now >= p.deadline) {
+        stats.timeouts += 1;
+        done.emplace_back(it->first, std::move(p.cb),
+                          ::rdmaio::Timeout(ByteBuffer("no reply")));
+        it = pending.erase(it);
+        continue;
+      }
+      if (p.retry && now >= p.next_retry) {
+        // a failed resend is retried later
+        channel->send_to(p.msg, servers[p.server]);
+        stats.retries += 1;
+        p.backoff = std::min(p.backoff * 2, max_backoff_usec);
+        p.next_retry = now + p.backoff;
+      }
+      ++it;
+    }
+
+    // 3. notify the completed calls, after which new calls may be issued
+    for (auto &d : done) {
+      auto &cb = std::get<1>(d);
+      if (cb)
+        cb(std::get<2>(d));
+      else
+        completed.insert(std::make_pair(std::get<0>(d), std::get<2>(d)));
+    }
+    return done.size();
+  }
+
+  /*!
+    Poll until all the outstanding calls complete, or timeout.
+    Between the polls, it blocks on the socket until the next reply, retry
+    or expiration.
+    \ret: true if no call is outstanding
+   */
+  bool wait_all(const double &timeout_usec = ::rdmaio::Timer::no_timeout()) {
+    Timer t;
+    while (true) {
+      poll();
+      if (pending.empty())
+        return true;
+      const double left = timeout_usec - t.passed_msec();
+      if (left <= 0)
+        return false;
+      channel->wait(std::min(left, next_event() - timer.passed_msec()));
+    }
+  }
+
+  /*!
+    The async versions of the ConnectManager's calls, which pass the same
+    results to the callbacks.
+   */
+  using ready_cb_t = std::function<void(Result<std::string> &)>;
+  Result<req_id_t> wait_ready(const server_id_t &server, ready_cb_t cb,
+                              const double &timeout_usec = 1000000) {
+    return call(server, proto::RCtrlBinderIdType::HeartBeat,
+                ByteBuffer(1, '0'),
+                [cb](Result<ByteBuffer> &reply) {
+                  auto res = ::rdmaio::transfer(reply, std::string(""));
+                  cb(res);
+                },
+                timeout_usec);
+  }
+
+  using mr_cb_t = std::function<void(Result<ConnectManager::mr_res_t> &)>;
+  Result<req_id_t> fetch_remote_mr(const server_id_t &server,
+                                   const rmem::register_id_t &id, mr_cb_t cb,
+                                   const double &timeout_usec = 1000000) {
+    return call(
+        server, proto::FetchMr,
+        ::rdmaio::Marshal::dump<proto::MRReq>({.id = id}),
+        [cb](Result<ByteBuffer> &reply) {
+          auto res = ::rdmaio::transfer(
+              reply, std::make_pair(reply.desc, rmem::RegAttr()));
+          if (reply == IOCode::Ok) {
+            auto mr_reply =
+                ::rdmaio::Marshal::dedump<proto::MRReply>(reply.desc);
+            if (!mr_reply)
+              res = ::rdmaio::Err(
+                  std::make_pair(std::string("Decode reply error"),
+                                 rmem::RegAttr()));
+            else if (mr_reply.value().status == proto::CallbackStatus::Ok)
+              res = ::rdmaio::Ok(
+                  std::make_pair(std::string(""), mr_reply.value().attr));
+            else if (mr_reply.value().status ==
+                     proto::CallbackStatus::NotFound)
+              res = NotReady(std::make_pair(std::string(""), rmem::RegAttr()));
+            else
+              res = ::rdmaio::Err(std::make_pair(
+                  std::string("Unknown status code"), rmem::RegAttr()));
+          }
+          cb(res);
+        },
+        timeout_usec);
+  }
+
+  using qp_attr_cb_t =
+      std::function<void(Result<ConnectManager::qp_attr_ret_t> &)>;
+  Result<req_id_t> fetch_qp_attr(const server_id_t &server,
+                                 const std::string &name, qp_attr_cb_t cb,
+                                 const double &timeout_usec = 1000000) {
+    if (unlikely(name.size() > ::rdmaio::qp::kMaxQPNameLen))
+      return ::rdmaio::Err(static_cast<req_id_t>(0));
+
+    auto req = proto::QPReq();
+    memcpy(req.name, name.data(), name.size());
+    return call(
+        server, proto::RCtrlBinderIdType::FetchQPAttr,
+        ::rdmaio::Marshal::dump<proto::QPReq>(req),
+        [cb](Result<ByteBuffer> &reply) {
+          auto res = ::rdmaio::transfer(
+              reply, std::make_pair(reply.desc, ::rdmaio::qp::QPAttr()));
+          if (reply == IOCode::Ok) {
+            auto qp_reply =
+                ::rdmaio::Marshal::dedump<proto::RCReply>(reply.desc);
+            if (!qp_reply)
+              res = ::rdmaio::Err(std::make_pair(
+                  std::string("Decode reply error"), ::rdmaio::qp::QPAttr()));
+            else if (qp_reply.value().status == proto::CallbackStatus::Ok)
+              res = ::rdmaio::Ok(
+                  std::make_pair(std::string(""), qp_reply.value().attr));
+            else if (qp_reply.value().status ==
+                     proto::CallbackStatus::NotFound)
+              res = NotReady(std::make_pair(std::string("attribute not found"),
+                                            ::rdmaio::qp::QPAttr()));
+            else
+              res = ::rdmaio::Err(std::make_pair(
+                  std::string("Unknown status code"), ::rdmaio::qp::QPAttr()));
+          }
+          cb(res);
+        },
+        timeout_usec);
+  }
+
+  /*!
+    Create and connect an RC QP at the server, see ConnectManager::cc_rc().
+    The local QP is connected before the callback.
+    \note: the call is not retried, since the server creates the QP only once
+   */
+  using cc_rc_cb_t = std::function<void(Result<ConnectManager::cc_rc_ret_t> &)>;
+  Result<req_id_t> cc_rc(const server_id_t &server, const std::string &name,
+                         const Arc<::rdmaio::qp::RC> rc,
+                         const ::rdmaio::nic_id_t &nic_id,
+                         const ::rdmaio::qp::QPConfig &config, cc_rc_cb_t cb,
+                         const double &timeout_usec = 1000000) {
+    if (unlikely(name.size() > ::rdmaio::qp::kMaxQPNameLen))
+      return ::rdmaio::Err(static_cast<req_id_t>(0));
+
+    proto::RCReq req = {};
+    memcpy(req.name, name.data(), name.size());
+    req.whether_create = 1;
+    req.whether_recv = 0;
+    req.nic_id = nic_id;
+    req.config = config;
+    req.attr = rc->my_attr();
+
+    return call(
+        server, proto::CreateRC, ::rdmaio::Marshal::dump<proto::RCReq>(req),
+        [cb, rc](Result<ByteBuffer> &reply) {
+          auto res = ::rdmaio::transfer(
+              reply, std::make_pair(reply.desc, static_cast<u64>(0)));
+          if (reply == IOCode::Ok) {
+            auto qp_reply =
+                ::rdmaio::Marshal::dedump<proto::RCReply>(reply.desc);
+            std::string err_str = "Decode reply error";
+            if (qp_reply) {
+              switch (qp_reply.value().status) {
+              case proto::CallbackStatus::Ok: {
+                auto ret = rc->connect(qp_reply.value().attr);
+                err_str = ret.desc;
+                if (ret == IOCode::Ok)
+                  err_str = "";
+              } break;
+              case proto::CallbackStatus::ConnectErr:
+                err_str = "Remote connect error";
+                break;
+              case proto::CallbackStatus::WrongArg:
+                err_str = "Wrong arguments, possible the QP has exsists";
+                break;
+              default:
+                err_str = "Unknown status code";
+              }
+            }
+            if (err_str.empty()) {
+              u64 key = qp_reply.value().key;
+              res = ::rdmaio::Ok(std::make_pair(err_str, key));
+            } else
+              res = ::rdmaio::Err(
+                  std::make_pair(err_str, static_cast<u64>(0)));
+          }
+          cb(res);
+        },
+        timeout_usec, false);
+  }
+
+private:
+  static Result<ByteBuffer> decode_reply(const SReplyHeader &header,
+                                         MultiMsg<kMaxMsgSz> &mm) {
+    // the heartbeat reply has no payload
+    if (header.dummy)
+      return ::rdmaio::Ok(ByteBuffer(""));
+
+    switch (header.callstatus) {
+    case CallStatus::Ok: {
+      auto payload = mm.query_one(1);
+      if (payload)
+        return ::rdmaio::Ok(payload.value());
+      return ::rdmaio::Err(ByteBuffer("decode reply error"));
+    }
+    case CallStatus::Nop:
+      return ::rdmaio::Err(ByteBuffer("Not ready"));
+    case CallStatus::Fragmented:
+      // only the first fragment is sent, the rest is left at the server
+      // until its fragments expire
+      return ::rdmaio::Err(ByteBuffer("reply too large"));
+    default:
+      return ::rdmaio::Err(ByteBuffer("unknown error"));
+    }
+  }
+
+  /*!
+    \ret: the time (of the timer) of the next retry or expiration
+   */
+  double next_event() const {
+    double ret = ::rdmaio::Timer::no_timeout();
+    for (auto &p : pending) {
+      ret = std::min(ret, p.second.deadline);
+      if (p.second.retry)
+        ret = std::min(ret, p.second.next_retry);
+    }
+    return ret;
+  }
+};
+
+} // namespace rdmaio
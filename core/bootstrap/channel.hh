@@ -2,8 +2,14 @@
 
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
+#include <array>
+#include <limits>
+#include <vector>
+
 #include "../common.hh"
 
 #include "../utils/ipname.hh"
@@ -15,11 +21,70 @@ namespace bootstrap {
 
 const usize kMaxMsgSz = 4096;
 
+// max #of msgs recved (or sent) by one syscall
+const usize kMaxBatch = 32;
+
+/*!
+  Preallocated buffers to recv a batch of msgs with one recvmmsg().
+  The msgs are consumed from the front, and the buffers are reused by the
+  next batch.
+ */
+template <usize N = kMaxBatch> class RecvBatch {
+  std::vector<ByteBuffer> bufs;
+  std::array<struct iovec, N> iovs;
+  std::array<struct mmsghdr, N> hdrs;
+  std::array<sockaddr, N> addrs;
+
+  usize num = 0;
+  usize cur = 0;
+
+public:
+  RecvBatch() : bufs(N, ByteBuffer(kMaxMsgSz, '\0')) {}
+
+  bool empty() const { return cur >= num; }
+
+  ByteBuffer &front() { return bufs[cur]; }
+
+  const sockaddr &front_addr() const { return addrs[cur]; }
+
+  void pop() { cur += 1; }
+
+  /*!
+    Recv at most N pending msgs without blocking, dropping the unconsumed ones
+    \ret: #of msgs recved, 0 if none is pending, -1 on error
+   */
+  int fill(int fd) {
+    // the buffers of the last batch are shrunk to their msgs
+    for (usize i = 0; i < num; ++i)
+      bufs[i].resize(kMaxMsgSz);
+    for (usize i = 0; i < N; ++i) {
+      iovs[i] = {.iov_base = &bufs[i][0], .iov_len = kMaxMsgSz};
+      hdrs[i] = {};
+      hdrs[i].msg_hdr.msg_name = &addrs[i];
+      hdrs[i].msg_hdr.msg_namelen = sizeof(sockaddr);
+      hdrs[i].msg_hdr.msg_iov = &iovs[i];
+      hdrs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    cur = 0;
+    num = 0;
+    auto n = recvmmsg(fd, hdrs.data(), N, MSG_DONTWAIT, nullptr);
+    if (n < 0)
+      return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+
+    num = static_cast<usize>(n);
+    for (usize i = 0; i < num; ++i)
+      bufs[i].resize(hdrs[i].msg_len);
+    return n;
+  }
+};
+
 class AbsChannel {
 protected:
   int sock_fd = -1;
+  int epoll_fd = -1;
 
-  explicit AbsChannel(int sock) : sock_fd(sock) {}
+  explicit AbsChannel(int sock) : sock_fd(sock) { init_epoll(); }
 
   AbsChannel() : sock_fd(-1) {}
 
@@ -28,9 +93,14 @@ protected:
   // possible to set later
   void set_socket(int fd)  {
     sock_fd = fd;
+    init_epoll();
   }
 
   Result<> close_channel() {
+    if (epoll_fd >= 0) {
+      close(epoll_fd);
+      epoll_fd = -1;
+    }
     if (valid()) {
       close(sock_fd);
       sock_fd = -1;
@@ -51,46 +121,69 @@ protected:
     return Ok(std::string(""));
   }
 
+  /*!
+    Block until the socket is readable, or timeout
+    \param timeout: timeout in usec, rounded up to msec
+    \ret: 1 if readable, 0 if timeout, -1 on error
+   */
+  int wait_readable(const double &to_usec) {
+    if (epoll_fd < 0)
+      return -1;
+    const double max_usec = std::numeric_limits<int>::max() * 1000.0;
+    const int timeout_ms =
+        to_usec >= max_usec
+            ? -1
+            : (to_usec <= 0 ? 0 : static_cast<int>((to_usec + 999) / 1000));
+
+    struct epoll_event ev;
+    auto n = epoll_wait(epoll_fd, &ev, 1, timeout_ms);
+    if (n < 0 && errno == EINTR)
+      return 0;
+    return n;
+  }
+
   /*!
     \param timeout: timeout in usec
    */
   Result<sockaddr> try_recv(ByteBuffer &buf, const double to_usec = 1000000) {
     struct sockaddr addr;
 
-    fd_set rfds;
-    FD_ZERO(&rfds);
-    FD_SET(sock_fd, &rfds);
-    struct timeval tv = {.tv_sec = 0, .tv_usec = static_cast<int>(to_usec)};
-
-    auto ready = select(sock_fd + 1, &rfds, nullptr, nullptr, &tv);
-
-    switch (ready) {
+    switch (wait_readable(to_usec)) {
     case 0:
       return Timeout(addr);
     case -1:
       return Err(addr);
     default: {
-      if (FD_ISSET(sock_fd, &rfds)) {
-        // now recv the msg
-        usize len = sizeof(addr);
-        auto n = recvfrom(sock_fd, (char *)(buf.c_str()), buf.size(), 0,
-                          (struct sockaddr *)(&addr), &len);
-
-        // we successfully receive one msg
-        if (n >= 0) {
-          return Ok(addr);
-        }
-        else {
-          //RDMA_LOG(4) << "error: " << strerror(errno);
-          return Err(addr);
-        }
-      } else {
-        RDMA_ASSERT(false);
-      }
+      // now recv the msg
+      socklen_t len = sizeof(addr);
+      auto n = recvfrom(sock_fd, (char *)(buf.c_str()), buf.size(), 0,
+                        (struct sockaddr *)(&addr), &len);
+
+      // we successfully receive one msg
+      if (n >= 0)
+        return Ok(addr);
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return Timeout(addr);
+      return Err(addr);
     }
       // end switch
     }
-    return Err(addr); // should not return here
+  }
+
+private:
+  void init_epoll() {
+    if (!valid())
+      return;
+    epoll_fd = epoll_create1(0);
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = sock_fd;
+    if (epoll_fd >= 0 && epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sock_fd, &ev)) {
+      close(epoll_fd);
+      epoll_fd = -1;
+    }
+    if (epoll_fd < 0)
+      RDMA_LOG(4) << "failed to create epoll: " << strerror(errno);
   }
 
 public:
@@ -115,6 +208,9 @@ class SendChannel : public AbsChannel {
 
   struct sockaddr_in end_addr;
 
+  // the replies recved but not returned yet
+  RecvBatch<> inbox;
+
   explicit SendChannel(const std::string &ip, int port) :
         end_addr(convert_addr(ip, port)) {
     struct addrinfo hints, *servinfo;
@@ -183,22 +279,119 @@ public:
   }
 
   /*!
-    Recv a reply of on the channel
+    Recv a reply of on the channel.
+    The pending replies are recved in a batch, and returned one per call.
    */
   Result<ByteBuffer> recv(const double &timeout_usec = 1000) {
-    ByteBuffer buf(kMaxMsgSz, '\0');
-    auto res = try_recv(buf, timeout_usec);
-    if (res == IOCode::Ok) {
-      return Ok(std::move(buf));
+    if (inbox.empty() && inbox.fill(this->sock_fd) == 0) {
+      auto ready = wait_readable(timeout_usec);
+      if (ready == 0)
+        return Timeout(ByteBuffer(""));
+      if (ready > 0 && inbox.fill(this->sock_fd) == 0)
+        return Timeout(ByteBuffer("")); // a spurious wakeup
+    }
+    if (inbox.empty())
+      return Err(ByteBuffer(""));
+
+    ByteBuffer ret = inbox.front();
+    inbox.pop();
+    return Ok(std::move(ret));
+  }
+};
+
+/*!
+  A UDP-based channel for sending msgs to many remote ends, and recving their
+  replies, using one (unconnected) socket.
+  Each msg is at maxinum ::rdmaio::bootstrap::kMaxMsgSz .
+  An example:
+  `
+  auto mc = MultiSendChannel::create().value();
+  auto addr = MultiSendChannel::resolve("xx.xx.xx.xx:xx").value();
+  auto send_res = mc->send_to("hello", addr);
+  // ... wait some time
+  ByteBuffer reply;
+  if (mc->wait(1000) && mc->recv_one(reply) == IOCode::Ok) {
+    // the reply is from the address in the result's desc
+  }
+  `
+ */
+class MultiSendChannel : public AbsChannel {
+
+  MultiSendChannel() : AbsChannel(socket(AF_INET, SOCK_DGRAM, 0)) {
+    if (valid()) {
+      // set as a non-blocking channel
+      fcntl(this->sock_fd, F_SETFL, O_NONBLOCK);
+    } else {
+      RDMA_LOG(4) << "failed to create the socket: " << strerror(errno);
+    }
+  }
+
+public:
+  static Option<Arc<MultiSendChannel>> create() {
+    auto mc = Arc<MultiSendChannel>(new MultiSendChannel());
+    if (mc->valid())
+      return mc;
+    return {};
+  }
+
+  /*!
+    Resolve an address in the format (ip:port)
+   */
+  static Option<sockaddr_in> resolve(const std::string &addr) {
+    auto host_port = IPNameHelper::parse_addr(addr);
+    if (host_port) {
+      auto ip_res = IPNameHelper::host2ip(std::get<0>(host_port.value()));
+      if (ip_res == IOCode::Ok) {
+        return sockaddr_in(
+            {.sin_family = AF_INET,
+             .sin_port = htons(std::get<1>(host_port.value())),
+             .sin_addr = {.s_addr = inet_addr(ip_res.desc.c_str())}});
+      }
     }
-    // direct forward the res code to the reply
-    return Result<ByteBuffer>({.code = res.code, .desc = ByteBuffer("")});
+    return {};
+  }
+
+  int fd() const { return sock_fd; }
+
+  Result<std::string> send_to(const ByteBuffer &buf, const sockaddr_in &addr) {
+    return raw_send(buf, addr);
+  }
+
+  /*!
+    Recv one msg into buf without blocking, buf is resized to the msg.
+    \ret: Ok with the sender, NotReady if no msg is pending
+   */
+  Result<sockaddr_in> recv_one(ByteBuffer &buf) {
+    sockaddr_in addr = {};
+    socklen_t len = sizeof(addr);
+    buf.resize(kMaxMsgSz);
+    auto n = recvfrom(sock_fd, (char *)(buf.data()), buf.size(), 0,
+                      (struct sockaddr *)(&addr), &len);
+    if (n < 0) {
+      buf.clear();
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return NotReady(addr);
+      return Err(addr);
+    }
+    buf.resize(n);
+    return Ok(addr);
+  }
+
+  /*!
+    Block until some msgs are pending, or timeout (in usec)
+    \ret: true if there are msgs to recv
+   */
+  bool wait(const double &timeout_usec) {
+    return wait_readable(timeout_usec) > 0;
   }
 };
 
 /*!
   A UDP-based channel for recving msgs.
   Each msg is at maxinum ::rdmaio::bootstrap::kMaxMsgSz .
+  The pending msgs are recved in batches (recvmmsg) into preallocated buffers,
+  and the replies to them (reply_cur) are buffered and sent in batches
+  (sendmmsg) before the channel recvs again, or by flush_replies().
   To use:
   `
   auto rc = RecvChannel::create (port_to_listen).value();
@@ -211,11 +404,14 @@ public:
  */
 class RecvChannel : public AbsChannel {
 
-  Option<sockaddr> cur_msg_client = {}; // who sent the current client
-  ByteBuffer cur_msg;
+  RecvBatch<> inbox;
+
+  // the replies not sent yet (the first num_out), with their receivers.
+  // the buffers are reused by the later replies.
+  std::vector<std::pair<ByteBuffer, sockaddr>> outbox;
+  usize num_out = 0;
 
-  explicit RecvChannel(int port)
-      : cur_msg(::rdmaio::bootstrap::kMaxMsgSz, '\0') {
+  explicit RecvChannel(int port) {
     struct addrinfo hints, *servinfo, *p;
     socklen_t addr_len;
     memset(&hints, 0, sizeof hints);
@@ -259,7 +455,7 @@ class RecvChannel : public AbsChannel {
   }
 
   explicit RecvChannel(int port, const std::string &host)
-    : AbsChannel(socket(AF_INET, SOCK_DGRAM, 0)), cur_msg(kMaxMsgSz, '\0') {
+    : AbsChannel(socket(AF_INET, SOCK_DGRAM, 0)) {
     if (valid()) {
       // set as a non-blocking channel
       fcntl(this->sock_fd, F_SETFL, O_NONBLOCK);
@@ -289,6 +485,8 @@ public:
     return {};
   }
 
+  ~RecvChannel() { flush_replies(); }
+
   /*!
     Try recv a msg;
     \param timeout: in usec
@@ -297,34 +495,83 @@ public:
     // donot over consume the current msg
     if (has_msg())
       return;
-    auto res = try_recv(cur_msg, timeout_usec);
-    if (res == IOCode::Ok) {
-      cur_msg_client = res.desc;
-    }
+    flush_replies();
+    if (inbox.fill(this->sock_fd) == 0 && wait_readable(timeout_usec) > 0)
+      inbox.fill(this->sock_fd);
   }
 
-  bool has_msg() const {
-    if (cur_msg_client)
-      return true;
-    return false;
-  }
+  bool has_msg() const { return !inbox.empty(); }
 
   /*!
     Drop current msg, and try to recv another one
    */
   void next() {
-    cur_msg_client = {}; // re-set msg header
-    start();             // fill one msg
+    inbox.pop();
+    start(); // fill msgs if the batch is consumed
   }
 
   /*!
     \note: this call is not safe
    */
-  ByteBuffer &cur() { return cur_msg; }
+  ByteBuffer &cur() { return inbox.front(); }
 
+  /*!
+    Reply the current msg, the reply is sent with the others in a batch
+   */
   Result<std::string> reply_cur(const ByteBuffer &buf) {
-    return raw_send(buf, cur_msg_client.value());
+    if (num_out == outbox.size())
+      outbox.emplace_back();
+    outbox[num_out].first.assign(buf);
+    outbox[num_out].second = inbox.front_addr();
+    num_out += 1;
+    if (num_out >= kMaxBatch)
+      return flush_replies();
+    return Ok(std::string(""));
   };
+
+  /*!
+    Send the buffered replies
+   */
+  Result<std::string> flush_replies() {
+    std::array<struct iovec, kMaxBatch> iovs;
+    std::array<struct mmsghdr, kMaxBatch> hdrs;
+
+    usize sent = 0;
+    while (sent < num_out) {
+      const usize num = std::min(static_cast<usize>(kMaxBatch),
+                                 static_cast<usize>(num_out - sent));
+      for (usize i = 0; i < num; ++i) {
+        auto &reply = outbox[sent + i];
+        iovs[i] = {.iov_base = const_cast<char *>(reply.first.data()),
+                   .iov_len = reply.first.size()};
+        hdrs[i] = {};
+        hdrs[i].msg_hdr.msg_name = &reply.second;
+        hdrs[i].msg_hdr.msg_namelen = sizeof(sockaddr);
+        hdrs[i].msg_hdr.msg_iov = &iovs[i];
+        hdrs[i].msg_hdr.msg_iovlen = 1;
+      }
+      auto n = sendmmsg(this->sock_fd, hdrs.data(), num, MSG_CONFIRM);
+      if (n <= 0) {
+        num_out = 0;
+        return Err(std::string(strerror(errno)));
+      }
+      sent += n;
+    }
+    num_out = 0;
+    return Ok(std::string(""));
+  }
+
+  /*!
+    The sender of the current msg, so it can be replied later with reply_to()
+   */
+  sockaddr cur_client() const { return inbox.front_addr(); }
+
+  /*!
+    Reply to a client immediately, which is thread-safe
+   */
+  Result<std::string> reply_to(const ByteBuffer &buf, const sockaddr &client) {
+    return raw_send(buf, client);
+  }
 }; // namespace bootstrap
 
 } // namespace bootstrap
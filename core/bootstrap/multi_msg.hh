@@ -1,6 +1,7 @@
 #pragma once
 
 #include <limits>
+#include <vector>
 
 #include "../common.hh"
 #include "./channel.hh"
@@ -35,7 +36,7 @@ namespace bootstrap {
  */
 
 // max encoded msg per MultiMsg
-const usize kMaxMultiMsg = 8;
+const usize kMaxMultiMsg = 16;
 
 struct __attribute__((packed)) MsgEntry {
   u16 offset = 0;
@@ -160,13 +161,24 @@ template <usize MAXSZ = kMaxMsgSz> struct MultiMsg {
 
   /*!
     Get one msg from the multimsg
-    \note: performance may be bad
+    \note: performance may be bad, prefer view_one()
    */
   Option<ByteBuffer> query_one(const usize &idx) const {
+    auto v = view_one(idx);
+    if (!v)
+      return {};
+    return v.value().to_buffer();
+  }
+
+  /*!
+    View one msg in the multimsg without copying it,
+    the view is valid while the buf is alive and unchanged
+   */
+  Option<ByteView> view_one(const usize &idx) const {
     if (idx >= num_msg())
       return {};
     MsgEntry &entry = header->entries[idx];
-    return ByteBuffer(buf->data() + entry.offset, entry.sz);
+    return ByteView(buf->data() + entry.offset, entry.sz);
   }
 
 private:
@@ -193,5 +205,88 @@ private:
   }
 };
 
+/*!
+  MsgBatch encodes msgs into one MultiMsg, so several small msgs are sent in
+  one datagram.
+  The encoded buffer reserves kMaxMsgSz and is reused after clear(),
+  so a batch kept across msgs encodes without heap allocation.
+
+  Usage:
+  `
+  MsgBatch batch;
+  if (!batch.fits(2, sizeof(Header) + b.size())) {
+    send(batch.buffer());
+    batch.clear();
+  }
+  batch.append_struct(header);
+  batch.append(b);
+  ...
+  send(batch.buffer());
+  `
+ */
+class MsgBatch {
+  ByteBuffer buf;
+
+  MsgsHeader *header() { return reinterpret_cast<MsgsHeader *>(&buf[0]); }
+
+  const MsgsHeader *header() const {
+    return reinterpret_cast<const MsgsHeader *>(buf.data());
+  }
+
+public:
+  MsgBatch() : buf(::rdmaio::Marshal::dump_null<MsgsHeader>()) {
+    buf.reserve(kMaxMsgSz);
+  }
+
+  bool empty() const { return num_msg() == 0; }
+
+  usize num_msg() const { return static_cast<usize>(header()->num); }
+
+  /*!
+    \ret: whether *num* more msgs of total *bytes* fit in the batch
+   */
+  bool fits(const usize &num, const usize &bytes) const {
+    return num_msg() + num <= kMaxMultiMsg && buf.size() + bytes <= kMaxMsgSz;
+  }
+
+  bool append(const ByteView &msg) {
+    if (!fits(1, msg.size()))
+      return false;
+    RDMA_ASSERT(header()->append_one(static_cast<u16>(msg.size())));
+    buf.append(msg.data(), msg.size());
+    return true;
+  }
+
+  /*!
+    Append a struct as a msg, without encoding it to a temporary buffer
+   */
+  template <typename T> bool append_struct(const T &t) {
+    if (!fits(1, sizeof(T)))
+      return false;
+    RDMA_ASSERT(header()->append_one(static_cast<u16>(sizeof(T))));
+    ::rdmaio::Marshal::dump_to(t, buf);
+    return true;
+  }
+
+  /*!
+    The encoded MultiMsg, valid until the batch is changed
+   */
+  const ByteBuffer &buffer() const { return buf; }
+
+  void clear() {
+    buf.resize(sizeof(MsgsHeader));
+    *header() = MsgsHeader();
+  }
+
+  /*!
+    Copy out the encoded MultiMsg, and clear the batch
+   */
+  ByteBuffer pack() {
+    ByteBuffer ret = buf;
+    clear();
+    return ret;
+  }
+};
+
 } // namespace bootstrap
 } // namespace rdmaio
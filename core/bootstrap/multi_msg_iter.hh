@@ -24,7 +24,7 @@ namespace bootstrap {
   `
   MultiMsg<1024> msgs;
   for (MsgsIter iter(msgs); iter.valid();iter.next()) {
-    auto msg = iter.cur_msg();
+    auto msg = iter.cur_msg(); // or cur_view() to avoid the copy
     // To use ...
   }
   `
@@ -62,6 +62,12 @@ public:
     auto msg = cur();
     return ByteBuffer(std::get<0>(msg),std::get<1>(msg));
   }
+
+  // a safe version of cur() without memcpy
+  ByteView cur_view() const {
+    auto msg = cur();
+    return ByteView(std::get<0>(msg), std::get<1>(msg));
+  }
 };
 }
 } // namespace rdmaio
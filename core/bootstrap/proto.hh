@@ -20,6 +20,7 @@ enum RCtrlBinderIdType : rpc_id_t {
   DeleteRC,
   FetchQPAttr,  // fetch a created QP's attr. useful for UD QP
   FetchDCAttr,  // fetch a DC attr. used for DCT
+  CreateRCBatch, // create and connect a batch of RCs in one call
   Reserved,
 };
 
@@ -86,6 +87,30 @@ struct __attribute__((packed)) DCReply {
   u64 key;
 };
 
+/*!
+  Req/Reply for creating and connecting a batch of RC QPs.
+  The request is an RCBatchReq followed by *num* RCBatchEntry,
+  and the reply is an RCBatchReply followed by *num* RCReply,
+  one for each QP in the request order.
+ */
+struct __attribute__((packed)) RCBatchReq {
+  u8 num = 0;
+
+  // all QPs of a batch are created with the same nic and config
+  ::rdmaio::nic_id_t nic_id;
+  ::rdmaio::qp::QPConfig config;
+};
+
+struct __attribute__((packed)) RCBatchEntry {
+  char name[::rdmaio::qp::kMaxQPNameLen + 1];
+  ::rdmaio::qp::QPAttr attr; // the attr used for connect
+};
+
+struct __attribute__((packed)) RCBatchReply {
+  CallbackStatus status;
+  u8 num = 0;
+};
+
 struct __attribute__((packed)) DelRCReq {
   // parameter for querying the QP
   char name[::rdmaio::qp::kMaxQPNameLen + 1];
@@ -1,6 +1,11 @@
 #pragma once
 
-#include <mutex>   // lock
+#include <condition_variable>
+#include <deque>
+#include <mutex> // lock
+#include <set>
+#include <thread>
+#include <unordered_map>
 #include <utility> // std::pair
 
 #include "./channel.hh"
@@ -19,6 +24,8 @@ enum CallStatus : u8 {
   WrongReply,
   NotMatch,
   FatalErr,
+  // the reply is too large for one msg, and should be fetched in fragments
+  Fragmented,
 };
 
 struct __attribute__((packed)) SRpcHeader {
@@ -35,16 +42,94 @@ struct __attribute__((packed)) SReplyHeader {
   u8 dummy = 0;
 };
 
+/*!
+  The header of a fragment of a large msg (request or reply),
+  which does not fit in one msg (see SRpc::call()).
+ */
+struct __attribute__((packed)) SFragHeader {
+  // identify the large msg at the server, i.e., the checksum of its call
+  u64 key;
+  // the RPC called with the reassembled request, used by kFragCall
+  rpc_id_t id;
+  u32 total;
+  u32 offset;
+};
+
+// the RPC ids reserved for the large msgs, which are served by SRpcHandler
+const rpc_id_t kFragPut = 253;  // upload a fragment of a request
+const rpc_id_t kFragGet = 254;  // fetch a fragment of a reply
+const rpc_id_t kFragCall = 255; // call an RPC with an uploaded request
+
+// max payload of a fragment, so it fits in one msg with the headers
+const usize kMaxFragSz = kMaxMsgSz - sizeof(MsgsHeader) -
+                         sizeof(SReplyHeader) - sizeof(SFragHeader);
+
+// max sz of a large msg
+const usize kMaxLargeMsgSz = 64 * 1024 * 1024;
+
 /*!
   A simple RPC used for establish connection for RDMA.
+
+  Besides the blocking call()/receive_reply(), SRpc supports pipelined calls:
+  call_async() issues a call without waiting for the previous replies,
+  up to *window* outstanding ones. The small calls issued back-to-back are
+  batched into one datagram (flushed by flush(), or when the batch is full).
+  The replies may arrive out of order, so they are demultiplexed to the calls
+  by the request id (the checksum), and the stale ones are dropped.
+
+  A request or reply larger than one msg (up to kMaxLargeMsgSz) is
+  transparently split into fragments of kMaxFragSz.
+  The fragments are uploaded (or fetched) by pipelined calls, at most
+  kFragWindow outstanding so they do not overflow the socket buffers.
+
+  Example:
+  `
+  SRpc rpc("localhost:1111");
+  std::vector<u64> ids;
+  for (auto &req : reqs)
+    ids.push_back(rpc.call_async(id, req).value());
+  rpc.flush();
+  for (auto id : ids) {
+    auto reply = rpc.wait_reply(id);
+    ...
+  }
+  `
  */
 class SRpc {
 public:
-  static const u64 invalid_checksum = 0;
+  static constexpr const u64 invalid_checksum = 0;
+
+  // max #of outstanding calls issued by call_async()
+  usize window = 64;
+
+  // max #of outstanding fragments of a large msg
+  static constexpr const usize kFragWindow = 16;
+
+  // replies matching no call, e.g., of the calls timeout
+  u64 stale_replies = 0;
 
 private:
   Arc<SendChannel> channel;
+
+  // the id of the next call
   u64 checksum = invalid_checksum + 1;
+  // the id of the last blocking call
+  u64 sync_checksum = invalid_checksum;
+
+  struct Outstanding {
+    // in usec, measured by the timer
+    double deadline;
+    Option<Result<ByteBuffer>> reply;
+    // the reply is the first fragment of a large reply
+    bool fragmented;
+  };
+  std::unordered_map<u64, Outstanding> outstanding;
+
+  // the async calls not sent yet
+  MsgBatch batch;
+  std::vector<u64> batch_ids;
+
+  Timer timer;
 
 public:
   using MMsg = MultiMsg<kMaxMsgSz>;
@@ -53,13 +138,214 @@ public:
 
   /*!
     Send an RPC with id "id", using a specificed parameter.
+    A parameter larger than one msg is uploaded in fragments first,
+    so the call blocks until the server receives them.
     */
   Result<std::string> call(const rpc_id_t &id, const ByteBuffer &parameter) {
-    auto mmsg_o = MMsg::create_exact(sizeof(rpc_id_t) + parameter.size());
+    if (sizeof(MsgsHeader) + sizeof(SRpcHeader) + parameter.size() >
+        kMaxMsgSz)
+      return call_large(id, parameter);
+    sync_checksum = checksum++;
+    return send_one(id, sync_checksum, parameter);
+  }
+
+  /*!
+    Recv a reply from the server ysing the timeout specified.
+    The replies of the async calls received meanwhile are kept for them,
+    and the stale ones are dropped.
+    \Note: this call must follow from a "call"
+    */
+  Result<ByteBuffer> receive_reply(const double &timeout_usec = 1000000,
+                                   bool heartbeat = false) {
+    Timer t;
+    while (true) {
+      const double left = std::max(timeout_usec - t.passed_msec(), 0.0);
+      auto res = channel->recv(left);
+      if (res != IOCode::Ok)
+        // the receive has error, just return
+        return res;
+
+      Option<Result<ByteBuffer>> ret;
+      bool fragmented = false;
+      auto decoded = decode_replies(
+          res.desc, [&](const SReplyHeader &header, Result<ByteBuffer> &r) {
+            // first we handle heartbeat reply
+            if (header.dummy) {
+              if (heartbeat)
+                ret = ::rdmaio::Ok(ByteBuffer(""));
+              return;
+            }
+            // then we handle normal reply
+            if (header.checksum == sync_checksum && !heartbeat) {
+              ret = r;
+              fragmented = header.callstatus == CallStatus::Fragmented;
+            } else if (header.checksum == invalid_checksum)
+              ret = ::rdmaio::Err(ByteBuffer("Fatal checksum error"));
+            else
+              deliver(header.checksum, r,
+                      header.callstatus == CallStatus::Fragmented);
+          });
+      if (!decoded)
+        return ::rdmaio::Err(ByteBuffer("decode reply error"));
+      if (ret && fragmented)
+        return fetch_rest(ret.value().desc, timeout_usec);
+      if (ret)
+        return ret.value();
+      if (left <= 0)
+        return ::rdmaio::Timeout(ByteBuffer(""));
+    }
+  }
+
+  /*!
+    Issue a call without waiting for its reply, which is fetched later by
+    wait_reply() or take_reply(). The call is batched with the following
+    ones, until flush() or the batch is full.
+    If no reply arrives in timeout_usec, the reply is Timeout.
+    \ret: the id of the call, or NotReady if the window is full
+   */
+  Result<u64> call_async(const rpc_id_t &id, const ByteBuffer &parameter,
+                         const double &timeout_usec = 1000000) {
+    if (outstanding.size() >= window)
+      return ::rdmaio::NotReady(invalid_checksum);
+
+    const usize bytes = sizeof(SRpcHeader) + parameter.size();
+    if (!batch.fits(2, bytes)) {
+      flush();
+      if (!batch.fits(2, bytes))
+        return ::rdmaio::Err(invalid_checksum); // msg too large
+    }
+
+    const u64 req_id = checksum++;
+    batch.append_struct(SRpcHeader({.id = id, .checksum = req_id}));
+    batch.append(parameter);
+    batch_ids.push_back(req_id);
+    outstanding.insert(std::make_pair(
+        req_id, Outstanding({.deadline = timer.passed_msec() + timeout_usec,
+                             .reply = {},
+                             .fragmented = false})));
+    return ::rdmaio::Ok(req_id);
+  }
+
+  /*!
+    Send the batched async calls in one datagram
+   */
+  Result<std::string> flush() {
+    if (batch.empty())
+      return ::rdmaio::Ok(std::string(""));
+    auto res = channel->send(batch.buffer());
+    batch.clear();
+    if (unlikely(res != IOCode::Ok)) {
+      for (auto id : batch_ids)
+        deliver(id, ::rdmaio::Err(ByteBuffer(res.desc)));
+    }
+    batch_ids.clear();
+    return res;
+  }
+
+  usize outstanding_calls() const { return outstanding.size(); }
+
+  /*!
+    Flush the batched calls, and receive the replies of the async calls,
+    waiting at most timeout_usec for the first one.
+    The calls without replies after their deadlines are Timeout.
+    \ret: #of calls completed
+   */
+  usize poll_replies(const double &timeout_usec = 0) {
+    flush();
+
+    usize num = 0;
+    for (double t = timeout_usec;; t = 0) {
+      auto res = channel->recv(t);
+      if (res != IOCode::Ok)
+        break;
+      decode_replies(res.desc,
+                     [&](const SReplyHeader &header, Result<ByteBuffer> &r) {
+                       if (!header.dummy)
+                         num += deliver(
+                             header.checksum, r,
+                             header.callstatus == CallStatus::Fragmented);
+                     });
+    }
+
+    const double now = timer.passed_msec();
+    for (auto &o : outstanding) {
+      if (!o.second.reply && o.second.deadline <= now) {
+        o.second.reply = ::rdmaio::Timeout(ByteBuffer(""));
+        num += 1;
+      }
+    }
+    return num;
+  }
+
+  /*!
+    Take the reply of an async call.
+    The rest of a large reply is fetched before it returns.
+    \ret: {} if the call has not completed
+   */
+  Option<Result<ByteBuffer>> take_reply(const u64 &id) {
+    auto it = outstanding.find(id);
+    if (it == outstanding.end() || !it->second.reply)
+      return {};
+    auto ret = it->second.reply.value();
+    const bool fragmented = it->second.fragmented;
+    outstanding.erase(it);
+    if (fragmented)
+      return fetch_rest(ret.desc);
+    return ret;
+  }
+
+  /*!
+    Drop an async call, its reply is ignored
+   */
+  void cancel(const u64 &id) { outstanding.erase(id); }
+
+  /*!
+    Wait for the reply of an async call, or its timeout
+   */
+  Result<ByteBuffer> wait_reply(const u64 &id) {
+    while (true) {
+      auto it = outstanding.find(id);
+      if (it == outstanding.end())
+        return ::rdmaio::Err(ByteBuffer("unknown call"));
+      if (it->second.reply) {
+        auto ret = it->second.reply.value();
+        const bool fragmented = it->second.fragmented;
+        outstanding.erase(it);
+        if (fragmented)
+          return fetch_rest(ret.desc);
+        return ret;
+      }
+      // the channel waits at most 1 second per recv
+      poll_replies(std::min(
+          std::max(it->second.deadline - timer.passed_msec(), 0.0), 1000000.0));
+    }
+  }
+
+private:
+  /*!
+    Store the reply to its async call
+    \ret: 1 if the call is found
+   */
+  usize deliver(const u64 &id, const Result<ByteBuffer> &r,
+                const bool &fragmented = false) {
+    auto it = outstanding.find(id);
+    if (it == outstanding.end() || it->second.reply) {
+      stale_replies += 1;
+      return 0;
+    }
+    it->second.reply = r;
+    it->second.fragmented = fragmented;
+    return 1;
+  }
+
+  Result<std::string> send_one(const rpc_id_t &id, const u64 &req_id,
+                               const ByteBuffer &parameter) {
+    auto mmsg_o = MMsg::create_exact(sizeof(SRpcHeader) + parameter.size());
     if (mmsg_o) {
       auto &mmsg = mmsg_o.value();
+      mmsg.alloc = true; // so the buf is freed with the msg
       RDMA_ASSERT(mmsg.append(::rdmaio::Marshal::dump<SRpcHeader>(
-          {.id = id, .checksum = checksum})));
+          {.id = id, .checksum = req_id})));
       RDMA_ASSERT(mmsg.append(parameter));
       return channel->send(*mmsg.buf);
     } else {
@@ -69,53 +355,144 @@ public:
   }
 
   /*!
-    Recv a reply from the server ysing the timeout specified.
-    \Note: this call must follow from a "call"
-    */
-  Result<ByteBuffer> receive_reply(const double &timeout_usec = 1000000,
-                                   bool heartbeat = false) {
-  retry:
-    auto res = channel->recv(timeout_usec);
-    if (res == IOCode::Ok) {
-
-      // further we decode the header for check
-      try {
-
-        auto decoded_reply = MultiMsg<kMaxMsgSz>::create_from(res.desc).value();
-
-        auto header = ::rdmaio::Marshal::dedump<SReplyHeader>(
-                          decoded_reply.query_one(0).value())
-                          .value();
+    Upload a large parameter in fragments, then call the RPC with it
+   */
+  Result<std::string> call_large(const rpc_id_t &id,
+                                 const ByteBuffer &parameter) {
+    if (parameter.size() > kMaxLargeMsgSz)
+      return ::rdmaio::Err(
+          std::string("Msg too large!, only kMaxLargeMsgSz supported"));
+
+    const u64 key = checksum++;
+    std::vector<ByteBuffer> frags;
+    for (usize off = 0; off < parameter.size(); off += kMaxFragSz) {
+      auto frag = ::rdmaio::Marshal::dump<SFragHeader>(
+          {.key = key,
+           .id = id,
+           .total = static_cast<u32>(parameter.size()),
+           .offset = static_cast<u32>(off)});
+      frag.append(parameter, off, kMaxFragSz);
+      frags.push_back(std::move(frag));
+    }
+    auto res = call_many(kFragPut, frags);
+    if (res != IOCode::Ok)
+      return ::rdmaio::Err(std::string("failed to upload the fragments"));
+
+    sync_checksum = checksum++;
+    return send_one(kFragCall, sync_checksum,
+                    ::rdmaio::Marshal::dump<SFragHeader>(
+                        {.key = key,
+                         .id = id,
+                         .total = static_cast<u32>(parameter.size()),
+                         .offset = 0}));
+  }
 
-        // first we handle heartbeat reply
-        if (header.dummy) {
-          if (!heartbeat)
-            goto retry; // ignore the heartbeat reply
+  /*!
+    Fetch the rest fragments of a large reply
+    \param first: the first fragment, with its SFragHeader
+   */
+  Result<ByteBuffer> fetch_rest(const ByteBuffer &first,
+                                const double &timeout_usec = 1000000) {
+    auto header_o = ::rdmaio::Marshal::dedump<SFragHeader>(first);
+    if (!header_o || header_o.value().total > kMaxLargeMsgSz)
+      return ::rdmaio::Err(ByteBuffer("decode reply error"));
+    const auto header = header_o.value();
+
+    ByteBuffer reply;
+    reply.reserve(header.total);
+    reply.append(first, sizeof(SFragHeader), ByteBuffer::npos);
+
+    std::vector<ByteBuffer> gets;
+    for (usize off = reply.size(); off < header.total; off += kMaxFragSz) {
+      gets.push_back(::rdmaio::Marshal::dump<SFragHeader>(
+          {.key = header.key,
+           .id = header.id,
+           .total = header.total,
+           .offset = static_cast<u32>(off)}));
+    }
+    auto res = call_many(kFragGet, gets, timeout_usec);
+    if (res != IOCode::Ok)
+      return ::rdmaio::Err(ByteBuffer("failed to fetch the fragments"));
+    for (auto &r : res.desc)
+      reply.append(r);
+
+    if (reply.size() != header.total)
+      return ::rdmaio::Err(ByteBuffer("decode reply error"));
+    return ::rdmaio::Ok(std::move(reply));
+  }
 
-          return ::rdmaio::Ok(ByteBuffer(""));
+  /*!
+    Call the RPC with each of the params, at most kFragWindow outstanding,
+    and wait for all the replies
+    \ret: the replies in the order of params
+   */
+  Result<std::vector<ByteBuffer>>
+  call_many(const rpc_id_t &id, const std::vector<ByteBuffer> &params,
+            const double &timeout_usec = 1000000) {
+    std::vector<ByteBuffer> replies;
+    std::deque<u64> ids;
+    for (usize i = 0; i < params.size() || !ids.empty();) {
+      if (i < params.size() && ids.size() < kFragWindow) {
+        auto res = call_async(id, params[i], timeout_usec);
+        if (res == IOCode::Ok) {
+          ids.push_back(res.desc);
+          i += 1;
+          continue;
         }
+        if (res != IOCode::NotReady || ids.empty())
+          break; // the window is full of other calls
+      }
 
-        // then we handle normal reply
-        if (header.checksum == checksum) {
-          checksum += 1;
-          switch (header.callstatus) {
-          case CallStatus::Ok:
-            return ::rdmaio::Ok(decoded_reply.query_one(1).value());
-          case CallStatus::Nop:
-            return ::rdmaio::Err(ByteBuffer("Not ready"));
-          default:
-            return ::rdmaio::Err(ByteBuffer("unknown error"));
-          }
-        } else
-          return ::rdmaio::Err(ByteBuffer("Fatal checksum error"));
-      } catch (std::exception &e) {
+      auto reply = wait_reply(ids.front());
+      ids.pop_front();
+      if (reply != IOCode::Ok)
+        break;
+      replies.push_back(std::move(reply.desc));
+    }
 
-        return ::rdmaio::Err(ByteBuffer("decode reply error"));
+    if (replies.size() == params.size())
+      return ::rdmaio::Ok(std::move(replies));
+    for (auto id : ids)
+      cancel(id);
+    return ::rdmaio::Err(std::move(replies));
+  }
+
+  /*!
+    Decode the (header, reply) pairs of a msg, and pass them to f.
+    The reply follows the header only if the call status is Ok (or
+    Fragmented).
+    \ret: false if the msg is malformed
+   */
+  template <typename F> static bool decode_replies(ByteBuffer &msg, F &&f) {
+    auto mm_o = MultiMsg<kMaxMsgSz>::create_from(msg);
+    if (!mm_o)
+      return false;
+    auto &mm = mm_o.value();
+
+    for (usize i = 0; i < mm.num_msg();) {
+      auto header =
+          ::rdmaio::Marshal::dedump<SReplyHeader>(mm.view_one(i++).value());
+      if (!header)
+        return false;
+
+      Result<ByteBuffer> r = ::rdmaio::Err(ByteBuffer("unknown error"));
+      switch (header.value().callstatus) {
+      case CallStatus::Ok:
+      case CallStatus::Fragmented: {
+        auto payload = mm.view_one(i++);
+        if (!payload)
+          return false;
+        r = ::rdmaio::Ok(payload.value().to_buffer());
+      } break;
+      case CallStatus::Nop:
+        r = ::rdmaio::Err(ByteBuffer("Not ready"));
+        break;
+      default:
+        break;
       }
-    } else {
-      // the receive has error, just return
-      return res;
+      f(header.value(), r);
     }
+    return true;
   }
 };
 
@@ -124,9 +501,11 @@ class RPCFactory {
   friend class SRpcHandler;
   /*!
   A simple RPC function:
-  handle(const ByteBuffer &req) -> ByteBuffer
+  handle(const ByteView &req) -> ByteBuffer
+  The request views the received msg, so it should be copied if kept after
+  the call. A handler taking a ByteBuffer also works, with a copy.
    */
-  using req_handler_f = std::function<ByteBuffer(const ByteBuffer &req)>;
+  using req_handler_f = std::function<ByteBuffer(const ByteView &req)>;
   std::map<rpc_id_t, req_handler_f> registered_handlers;
 
   std::mutex lock;
@@ -138,22 +517,34 @@ class RPCFactory {
   };
 
 public:
-  bool register_handler(rpc_id_t id, req_handler_f val) {
+  /*!
+    \param serialized: if true, the calls of the handler are serialized,
+    so a handler which is not thread-safe can be served by the workers
+    (see SRpcHandler::start_workers)
+   */
+  bool register_handler(rpc_id_t id, req_handler_f val,
+                        const bool &serialized = false) {
     std::lock_guard<std::mutex> guard(lock);
-    if (registered_handlers.find(id) == registered_handlers.end()) {
-      registered_handlers.insert(std::make_pair(id, val));
-      return true;
+    if (registered_handlers.find(id) != registered_handlers.end())
+      return false;
+    if (serialized) {
+      auto m = std::make_shared<std::mutex>();
+      val = [m, val](const ByteView &req) {
+        std::lock_guard<std::mutex> guard(*m);
+        return val(req);
+      };
     }
-    return false;
+    registered_handlers.insert(std::make_pair(id, val));
+    return true;
   }
 
-  ByteBuffer call_one(rpc_id_t id, const ByteBuffer &parameter) {
+  ByteBuffer call_one(rpc_id_t id, const ByteView &parameter) {
     auto fn = registered_handlers.find(id)->second;
     return fn(parameter);
   }
 
 private:
-  static ByteBuffer heartbeat_handler(const ByteBuffer &b) {
+  static ByteBuffer heartbeat_handler(const ByteView &b) {
     return ByteBuffer("1"); // a null reply is ok
   }
 };
@@ -162,89 +553,390 @@ class SRpcHandler {
   Arc<RecvChannel> channel;
   RPCFactory factory;
 
+  // a request to be served by the workers
+  struct Job {
+    ByteBuffer msg;
+    sockaddr client;
+  };
+
+  std::mutex job_lock;
+  std::condition_variable job_cv;
+  std::deque<Job> jobs;
+  bool stopping = false;
+  std::vector<std::thread> workers;
+
+  // RPCs served by the event loop directly, even if there are workers
+  std::set<rpc_id_t> fast_paths = {RCtrlBinderIdType::HeartBeat, kFragPut,
+                                   kFragGet};
+
+  // a large request being reassembled, or a large reply being fetched
+  struct Fragments {
+    ByteBuffer buf;
+    // whether each fragment of a request is received
+    std::vector<bool> received;
+    usize missing = 0;
+    // in usec, measured by frag_timer
+    double last_used = 0;
+  };
+
+  // the large msgs are identified by the client's address and their keys
+  using frag_key_t = std::pair<ByteBuffer, u64>;
+
+  std::mutex frag_lock;
+  std::map<frag_key_t, Fragments> requests;
+  std::map<frag_key_t, Fragments> replies;
+  Timer frag_timer;
+
 public:
+  // the large msgs not used for this time (in usec) are dropped
+  double frag_timeout_usec = 10000000;
+
   explicit SRpcHandler(const usize &port, const std::string &h = "localhost")
       : channel(RecvChannel::create(port, h).value()) {}
 
-  bool register_handler(rpc_id_t id, RPCFactory::req_handler_f val) {
-    return factory.register_handler(id, val);
+  ~SRpcHandler() { stop_workers(); }
+
+  bool register_handler(rpc_id_t id, RPCFactory::req_handler_f val,
+                        const bool &serialized = false) {
+    return factory.register_handler(id, val, serialized);
+  }
+
+  /*!
+    Serve the RPC *id* in the event loop, instead of the workers.
+    It is used for the cheap RPCs, e.g., heartbeats,
+    so they are not delayed by the slow ones queued at the workers.
+    \note: should be called before start_workers()
+   */
+  void add_fast_path(rpc_id_t id) { fast_paths.insert(id); }
+
+  /*!
+    Start *num* worker threads, then the event loop only receives requests,
+    and dispatches them (except for the fast paths) to the workers.
+    The workers reply through the event loop's socket.
+    \note: the handlers must be thread-safe, or registered as serialized
+   */
+  void start_workers(const usize &num) {
+    for (uint i = 0; i < num; ++i)
+      workers.push_back(std::thread(&SRpcHandler::worker, this));
   }
 
+  /*!
+    Stop the workers after they serve all the queued requests
+   */
+  void stop_workers() {
+    {
+      std::lock_guard<std::mutex> guard(job_lock);
+      stopping = true;
+    }
+    job_cv.notify_all();
+    for (auto &w : workers)
+      w.join();
+    workers.clear();
+    stopping = false;
+  }
+
+  usize num_workers() const { return workers.size(); }
+
   /*!
     Run a event loop to call received RPC calls
-    \ret: number of PRCs served
+    \ret: number of PRCs served (or dispatched to the workers)
    */
   usize run_one_event_loop() {
     usize count = 0;
-    for (channel->start(1000000); channel->has_msg(); channel->next(), count += 1) {
-
+    for (channel->start(1000000); channel->has_msg();
+         channel->next(), count += 1) {
       auto &msg = channel->cur();
 
-      u64 checksum = SRpc::invalid_checksum;
-      try {
-        MultiMsg<kMaxMsgSz> segmeneted_msg;
-        SRpcHeader header;
-        try {
-          // create from move the cur_msg to a MuiltiMsg
-          segmeneted_msg = MultiMsg<kMaxMsgSz>::create_from(msg).value();
-
-          // query the RPC call id
-          header = ::rdmaio::Marshal::dedump<SRpcHeader>(
-                       segmeneted_msg.query_one(0).value())
-                       .value();
-
-          checksum = header.checksum;
-        } catch (std::exception &e) {
-          // some error happens, which is fatal because we cannot decode the
-          // checksum
-
-          MultiMsg<kMaxMsgSz> coded_reply =
-            MultiMsg<kMaxMsgSz>::create_exact(sizeof(SReplyHeader)).value();
-
-          coded_reply.append(::rdmaio::Marshal::dump<SReplyHeader>(
-              {.callstatus = CallStatus::FatalErr,
-               .checksum = checksum,
-               .dummy = 0}));
-          channel->reply_cur(*coded_reply.buf);
-
-          continue;
+      if (!workers.empty() && !all_fast(msg)) {
+        // the workers reply the malformed requests as well
+        {
+          std::lock_guard<std::mutex> guard(job_lock);
+          jobs.push_back({.msg = msg, .client = channel->cur_client()});
         }
+        job_cv.notify_one();
+        continue;
+      }
+      serve(msg, channel->cur_client(),
+            [this](const ByteBuffer &reply) { channel->reply_cur(reply); });
+    }
 
-        // really handles the request
-        rpc_id_t id = header.id;
+    return count;
+  }
 
-        ByteBuffer parameter = segmeneted_msg.query_one(1).value();
+private:
+  void worker() {
+    while (true) {
+      Job job;
+      {
+        std::unique_lock<std::mutex> guard(job_lock);
+        job_cv.wait(guard, [this]() { return stopping || !jobs.empty(); });
+        if (jobs.empty())
+          return; // stopping
+        job = std::move(jobs.front());
+        jobs.pop_front();
+      }
+      serve(job.msg, job.client, [this, &job](const ByteBuffer &reply) {
+        channel->reply_to(reply, job.client);
+      });
+    }
+  }
 
-        // call the RPC
-        ByteBuffer reply = factory.call_one(id, parameter);
-
-        MultiMsg<kMaxMsgSz> coded_reply =
-            MultiMsg<kMaxMsgSz>::create_exact(sizeof(SReplyHeader) +
-                                              reply.size())
-                .value();
-        coded_reply.append(::rdmaio::Marshal::dump<SReplyHeader>(
-            {.callstatus = CallStatus::Ok,
-             .checksum = checksum,
-             .dummy = (id == RCtrlBinderIdType::HeartBeat)
-                          ? static_cast<u8>(1)
-                          : static_cast<u8>(0)}));
-        coded_reply.append(reply);
-
-        // send the reply to the client
-        channel->reply_cur(*coded_reply.buf);
+  /*!
+    \ret: whether all the RPCs in a request are fast paths,
+    false if the request cannot be decoded
+   */
+  bool all_fast(ByteBuffer &msg) const {
+    auto segmeneted_msg = MultiMsg<kMaxMsgSz>::create_from(msg);
+    if (!segmeneted_msg || segmeneted_msg.value().num_msg() == 0)
+      return false;
+    auto &mm = segmeneted_msg.value();
+    for (usize i = 0; i < mm.num_msg(); i += 2) {
+      auto header =
+          ::rdmaio::Marshal::dedump<SRpcHeader>(mm.view_one(i).value());
+      if (!header || fast_paths.find(header.value().id) == fast_paths.end())
+        return false;
+    }
+    return true;
+  }
 
-      } catch (std::exception &e) {
-        MultiMsg<kMaxMsgSz> coded_reply =
-          MultiMsg<kMaxMsgSz>::create_exact(sizeof(SReplyHeader)).value();
+  Option<ByteBuffer> call_one(const rpc_id_t &id, const ByteView &parameter,
+                              const sockaddr &client) {
+    switch (id) {
+    case kFragPut:
+      return put_fragment(parameter, client);
+    case kFragGet:
+      return get_fragment(parameter, client);
+    case kFragCall:
+      return call_large(parameter, client);
+    default:
+      return factory.call_one(id, parameter);
+    }
+  }
 
-        // some error happens
-        coded_reply.append(::rdmaio::Marshal::dump<SReplyHeader>(
-            {.callstatus = CallStatus::Nop, .checksum = checksum}));
-        channel->reply_cur(*coded_reply.buf);
+  static frag_key_t frag_key(const sockaddr &client, const u64 &key) {
+    return std::make_pair(
+        ByteBuffer(reinterpret_cast<const char *>(&client), sizeof(sockaddr)),
+        key);
+  }
+
+  /*!
+    Drop the large msgs not used for frag_timeout_usec,
+    e.g., of the clients failed
+    \note: frag_lock should be held
+   */
+  void gc_fragments() {
+    const double now = frag_timer.passed_msec();
+    for (auto m : {&requests, &replies}) {
+      for (auto it = m->begin(); it != m->end();) {
+        if (now - it->second.last_used > frag_timeout_usec)
+          it = m->erase(it);
+        else
+          ++it;
       }
     }
+  }
 
-    return count;
+  /*!
+    Store a fragment of a large request
+    \ret: an empty reply if ok
+   */
+  Option<ByteBuffer> put_fragment(const ByteView &parameter,
+                                  const sockaddr &client) {
+    auto header_o = ::rdmaio::Marshal::dedump<SFragHeader>(parameter);
+    if (!header_o)
+      return {};
+    const auto header = header_o.value();
+    const auto payload = parameter.sub(sizeof(SFragHeader));
+
+    const usize total = header.total;
+    const usize offset = header.offset;
+    if (total > kMaxLargeMsgSz || offset % kMaxFragSz != 0 ||
+        offset + payload.size() > total ||
+        (payload.size() != kMaxFragSz && offset + payload.size() != total))
+      return {};
+
+    std::lock_guard<std::mutex> guard(frag_lock);
+    gc_fragments();
+
+    auto &f = requests[frag_key(client, header.key)];
+    if (f.received.empty()) {
+      f.buf.resize(total);
+      f.missing = (total + kMaxFragSz - 1) / kMaxFragSz;
+      f.received.resize(f.missing, false);
+    }
+    if (f.buf.size() != total)
+      return {};
+
+    const usize idx = offset / kMaxFragSz;
+    if (!f.received[idx]) {
+      memcpy(&f.buf[offset], payload.data(), payload.size());
+      f.received[idx] = true;
+      f.missing -= 1;
+    }
+    f.last_used = frag_timer.passed_msec();
+    return ByteBuffer("");
+  }
+
+  /*!
+    Call the RPC with a large request reassembled from its fragments
+   */
+  Option<ByteBuffer> call_large(const ByteView &parameter,
+                                const sockaddr &client) {
+    auto header_o = ::rdmaio::Marshal::dedump<SFragHeader>(parameter);
+    if (!header_o || header_o.value().id == kFragPut ||
+        header_o.value().id == kFragGet || header_o.value().id == kFragCall)
+      return {};
+    const auto header = header_o.value();
+
+    ByteBuffer request;
+    {
+      std::lock_guard<std::mutex> guard(frag_lock);
+      auto it = requests.find(frag_key(client, header.key));
+      if (it == requests.end() || it->second.missing != 0 ||
+          it->second.buf.size() != header.total)
+        return {};
+      request = std::move(it->second.buf);
+      requests.erase(it);
+    }
+    return factory.call_one(header.id, request);
+  }
+
+  /*!
+    Keep a large reply, which is fetched by get_fragment()
+    \ret: its first fragment
+   */
+  Option<ByteBuffer> keep_reply(const sockaddr &client, const u64 &checksum,
+                                ByteBuffer &&reply) {
+    if (reply.size() > kMaxLargeMsgSz)
+      return {};
+
+    auto first = ::rdmaio::Marshal::dump<SFragHeader>(
+        {.key = checksum,
+         .id = 0,
+         .total = static_cast<u32>(reply.size()),
+         .offset = 0});
+    first.append(reply, 0, kMaxFragSz);
+
+    std::lock_guard<std::mutex> guard(frag_lock);
+    gc_fragments();
+    auto &f = replies[frag_key(client, checksum)];
+    f.buf = std::move(reply);
+    f.last_used = frag_timer.passed_msec();
+    return first;
+  }
+
+  /*!
+    Reply a fragment of a large reply, which is dropped after the last one
+   */
+  Option<ByteBuffer> get_fragment(const ByteView &parameter,
+                                  const sockaddr &client) {
+    auto header_o = ::rdmaio::Marshal::dedump<SFragHeader>(parameter);
+    if (!header_o)
+      return {};
+    const auto header = header_o.value();
+
+    std::lock_guard<std::mutex> guard(frag_lock);
+    auto it = replies.find(frag_key(client, header.key));
+    if (it == replies.end() || header.offset >= it->second.buf.size())
+      return {};
+    auto ret = it->second.buf.substr(header.offset, kMaxFragSz);
+    if (header.offset + ret.size() >= it->second.buf.size())
+      replies.erase(it);
+    else
+      it->second.last_used = frag_timer.passed_msec();
+    return ret;
+  }
+
+  static SReplyHeader reply_header(const u8 &status, const u64 &checksum,
+                                   const u8 &dummy = 0) {
+    return SReplyHeader(
+        {.callstatus = status, .checksum = checksum, .dummy = dummy});
+  }
+
+  /*!
+    Decode a request, which may batch several calls as (header, parameter)
+    pairs, call their handlers, and encode the replies.
+    The replies are batched as well, and passed to *send* in as few
+    msgs as possible.
+    The parameters are passed to the handlers as views of msg,
+    and the replies are encoded in a per-thread batch which is reused,
+    so besides the handlers, serving a request does no heap allocation.
+    A reply too large for one msg is kept, and its first fragment is
+    replied with CallStatus::Fragmented.
+   */
+  template <typename F>
+  void serve(ByteBuffer &msg, const sockaddr &client, F &&send) {
+    thread_local MsgBatch batch;
+    batch.clear();
+
+    auto segmeneted_msg = MultiMsg<kMaxMsgSz>::create_from(msg);
+    if (!segmeneted_msg || segmeneted_msg.value().num_msg() == 0) {
+      // some error happens, which is fatal because we cannot decode the
+      // checksum
+      batch.append_struct(
+          reply_header(CallStatus::FatalErr, SRpc::invalid_checksum));
+      send(batch.buffer());
+      return;
+    }
+    auto &mm = segmeneted_msg.value();
+
+    for (usize i = 0; i < mm.num_msg(); i += 2) {
+      auto header =
+          ::rdmaio::Marshal::dedump<SRpcHeader>(mm.view_one(i).value());
+      if (!header) {
+        // the rest of the request cannot be decoded
+        if (!batch.fits(1, sizeof(SReplyHeader))) {
+          send(batch.buffer());
+          batch.clear();
+        }
+        batch.append_struct(
+            reply_header(CallStatus::FatalErr, SRpc::invalid_checksum));
+        break;
+      }
+      const rpc_id_t id = header.value().id;
+      const u64 checksum = header.value().checksum;
+
+      Option<ByteBuffer> reply = {};
+      try {
+        // call the RPC
+        reply = call_one(id, mm.view_one(i + 1).value(), client);
+      } catch (std::exception &e) {
+        // some error happens
+      }
+
+      u8 status = CallStatus::Ok;
+      if (reply && sizeof(MsgsHeader) + sizeof(SReplyHeader) +
+                           reply.value().size() >
+                       kMaxMsgSz) {
+        reply = keep_reply(client, checksum, std::move(reply.value()));
+        status = CallStatus::Fragmented;
+      }
+
+      const usize num = reply ? 2 : 1;
+      const usize bytes =
+          sizeof(SReplyHeader) + (reply ? reply.value().size() : 0);
+      if (!batch.fits(num, bytes)) {
+        if (!batch.empty()) {
+          send(batch.buffer());
+          batch.clear();
+        }
+        // the reply is too large even for a single msg
+        if (!batch.fits(num, bytes))
+          reply = {};
+      }
+
+      if (reply) {
+        batch.append_struct(reply_header(
+            status, checksum,
+            (id == RCtrlBinderIdType::HeartBeat) ? static_cast<u8>(1)
+                                                 : static_cast<u8>(0)));
+        batch.append(reply.value());
+      } else {
+        batch.append_struct(reply_header(CallStatus::Nop, checksum));
+      }
+    }
+    if (!batch.empty())
+      send(batch.buffer());
   }
 };
 
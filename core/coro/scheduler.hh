@@ -0,0 +1,255 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include "../qps/mod.hh"
+
+#include "../qps/cq_mux.hh"
+
+namespace rdmaio {
+
+namespace coro {
+
+using coro_id_t = u32;
+
+enum class CoroStatus {
+  Yield = 0, // the coroutine gives up the CPU, and is ready to run again
+  Wait,      // the coroutine waits for its pending completions
+  Done,
+};
+
+/*!
+  Stackless coroutine, in the style of protothreads.
+  The states that live across yields must be stored as the class members,
+  since locals are lost once the coroutine yields.
+
+  Example:
+  `
+  class ReadCoro : public Coroutine {
+    Arc<RC> qp;
+    Op<> op;
+    int i = 0;
+
+  public:
+    CoroStatus run() override {
+      RLIB_CORO_BEGIN(this);
+      for (i = 0; i < 10; ++i) {
+        // post a request, whose user wr_id is the coroutine id
+        op.execute(qp, IBV_SEND_SIGNALED, id);
+        RLIB_CORO_WAIT(this, 1); // resumed after the completion arrives
+        if (failed)
+          break;
+      }
+      RLIB_CORO_END(this);
+    }
+  };
+
+  Scheduler s;
+  s.add_qp(qp);
+  s.spawn(std::make_shared<ReadCoro>(...));
+  s.run(); // until all coroutines are done
+  `
+ */
+class Coroutine {
+public:
+  coro_id_t id = 0;
+
+  // the source line to resume at, 0 for the beginning
+  int resume_point = 0;
+
+  // #of completions the coroutine is waiting for
+  usize pending_comps = 0;
+  // #of completions arrived before the coroutine waits for them,
+  // e.g., the op completes before the coroutine yields
+  usize arrived = 0;
+
+  // whether a completion with an error status is received
+  bool failed = false;
+  ibv_wc_status err_status = IBV_WC_SUCCESS;
+
+  virtual CoroStatus run() = 0;
+
+  /*!
+    Wait for *n* more completions, the early arrived ones are counted first.
+    \ret: whether the coroutine should yield, i.e., some are still pending
+   */
+  bool wait(const usize &n) {
+    pending_comps += n;
+    const usize early = std::min(arrived, pending_comps);
+    arrived -= early;
+    pending_comps -= early;
+    return pending_comps > 0;
+  }
+
+  virtual ~Coroutine() = default;
+};
+
+#define RLIB_CORO_BEGIN(c)                                                     \
+  switch ((c)->resume_point) {                                                 \
+  case 0:
+
+#define RLIB_CORO_YIELD(c)                                                     \
+  do {                                                                         \
+    (c)->resume_point = __LINE__;                                              \
+    return ::rdmaio::coro::CoroStatus::Yield;                                  \
+  __attribute__((fallthrough));                                                \
+  case __LINE__:;                                                              \
+  } while (0)
+
+// yield until *n* completions of the coroutine have arrived,
+// continue immediately if they have all arrived
+#define RLIB_CORO_WAIT(c, n)                                                   \
+  do {                                                                         \
+    (c)->resume_point = __LINE__;                                              \
+    if ((c)->wait(n))                                                          \
+      return ::rdmaio::coro::CoroStatus::Wait;                                 \
+  __attribute__((fallthrough));                                                \
+  case __LINE__:;                                                              \
+  } while (0)
+
+#define RLIB_CORO_END(c)                                                       \
+  }                                                                            \
+  (c)->resume_point = -1;                                                      \
+  return ::rdmaio::coro::CoroStatus::Done;
+
+/*!
+  A per-thread scheduler for the coroutines.
+  It runs the ready coroutines in a FIFO order, and batch-polls the CQs
+  of the registered QPs (or CQMuxes) to wake up the waiting coroutines.
+  A completion is matched to its coroutine by the user wr_id,
+  i.e., the coroutine's id.
+
+  \note: the registered QPs should not enable the selective signaling
+  (RC::enable_selective_signal), whose reclaiming consumes the completions
+  of the coroutines, and signals the requests no coroutine waits for.
+  So every signaled request should be waited for by its coroutine.
+  \note: not thread-safe, each thread should use its own scheduler.
+ */
+class Scheduler {
+  std::vector<Arc<Coroutine>> coros;
+  std::deque<coro_id_t> ready;
+
+  std::vector<Arc<qp::RC>> qps;
+  std::vector<Arc<qp::CQMux>> muxes;
+
+  usize alive = 0;
+
+  static constexpr const int kPollBatch = 64;
+  ibv_wc wcs[kPollBatch];
+
+public:
+  coro_id_t spawn(const Arc<Coroutine> &c) {
+    c->id = static_cast<coro_id_t>(coros.size());
+    coros.push_back(c);
+    ready.push_back(c->id);
+    alive += 1;
+    return c->id;
+  }
+
+  /*!
+    \ret: false if the QP has enabled the selective signaling
+   */
+  bool add_qp(const Arc<qp::RC> &qp) {
+    if (qp->selective_signaled())
+      return false;
+    qps.push_back(qp);
+    return true;
+  }
+
+  void add_mux(const Arc<qp::CQMux> &mux) { muxes.push_back(mux); }
+
+  usize alive_coros() const { return alive; }
+
+  usize ready_coros() const { return ready.size(); }
+
+  /*!
+    Notify one completion of the coroutine *id*,
+    which is resumed if all its pending completions have arrived.
+    A completion arriving before the coroutine waits is counted,
+    and consumed by its next wait.
+   */
+  void complete(const coro_id_t &id,
+                const ibv_wc_status &status = IBV_WC_SUCCESS) {
+    if (unlikely(id >= coros.size())) {
+      RDMA_LOG(4) << "ignore a completion of unknown coroutine: " << id;
+      return;
+    }
+    auto &c = coros[id];
+    if (unlikely(status != IBV_WC_SUCCESS)) {
+      c->failed = true;
+      c->err_status = status;
+    }
+    if (c->pending_comps == 0) {
+      c->arrived += 1;
+      return;
+    }
+    c->pending_comps -= 1;
+    if (c->pending_comps == 0)
+      ready.push_back(id);
+  }
+
+  /*!
+    Poll all the registered CQs once.
+    \ret #of completions polled
+   */
+  usize poll_once() {
+    usize polled = 0;
+    for (auto &qp : qps) {
+      auto comps = qp->poll_rc_comps(wcs);
+      for (auto &wc : comps)
+        complete(static_cast<coro_id_t>(wc.wr_id), wc.status);
+      polled += comps.size();
+    }
+    for (auto &mux : muxes) {
+      auto comps = mux->poll_comps(wcs);
+      for (auto &wc : comps)
+        complete(static_cast<coro_id_t>(wc.wr_id), wc.status);
+      polled += comps.size();
+    }
+    return polled;
+  }
+
+  /*!
+    Run each currently ready coroutine for one step.
+   */
+  void run_ready() {
+    for (usize n = ready.size(); n > 0; --n) {
+      auto id = ready.front();
+      ready.pop_front();
+
+      auto &c = coros[id];
+      switch (c->run()) {
+      case CoroStatus::Yield:
+        ready.push_back(id);
+        break;
+      case CoroStatus::Wait:
+        // RLIB_CORO_WAIT only returns Wait with pending completions, since
+        // the early ones are consumed by Coroutine::wait(); the coroutine
+        // is resumed by the complete() of its last one.
+        // a coroutine returning Wait by itself may wait for nothing
+        if (c->pending_comps == 0)
+          ready.push_back(id);
+        break;
+      case CoroStatus::Done:
+        alive -= 1;
+        break;
+      }
+    }
+  }
+
+  /*!
+    The scheduler loop, returns when all the coroutines are done.
+   */
+  void run() {
+    while (alive > 0) {
+      run_ready();
+      poll_once();
+    }
+  }
+};
+
+} // namespace coro
+
+} // namespace rdmaio
@@ -65,6 +65,19 @@ protected:
   const std::string err_not_found = "attribute not found";
   const std::string err_unknown_status = "Unknown status code";
 
+public:
+  // max #of QPs created in one call of cc_rc_batch(),
+  // so both the request and the reply fit in one message
+  static constexpr const usize kMaxRCBatch =
+      std::min((kMaxMsgSz - sizeof(MsgsHeader) - sizeof(SRpcHeader) -
+                sizeof(proto::RCBatchReq)) /
+                   sizeof(proto::RCBatchEntry),
+               (kMaxMsgSz - sizeof(MsgsHeader) - sizeof(SReplyHeader) -
+                sizeof(proto::RCBatchReply)) /
+                   sizeof(proto::RCReply));
+  static_assert(kMaxRCBatch > 0 && kMaxRCBatch <= 255,
+                "the batch size should fit the u8 num");
+
 public:
   explicit ConnectManager(const std::string &addr) : rpc(addr) {}
 
@@ -117,7 +130,7 @@ public:
       } catch (std::exception &e) {
       }
     }
-    ::rdmaio::Err(std::string("fatal error"));
+    return ::rdmaio::Err(std::string("fatal error"));
   }
 
   /*!
@@ -197,6 +210,131 @@ public:
     return ::rdmaio::Err(std::make_pair(err_str, temp_key));
   }
 
+  /*!
+    Create and connect a batch of RC QPs at the remote end, like calling
+    cc_rc() for each (names[i], qps[i]) pair, while saving the round trips:
+    the QPs are packed into as few RPCs as possible, kMaxRCBatch QPs each
+    (limited by the size of one message).
+
+    \ret: the keys of the remote QPs, in the order of *names*.
+    On errors, the keys of the QPs connected before the error are returned.
+    The remote QPs created after the error (in the same RPC) are deleted,
+    so they are not left orphaned at the server.
+   */
+  using cc_rc_batch_ret_t = std::pair<std::string, std::vector<u64>>;
+  Result<cc_rc_batch_ret_t>
+  cc_rc_batch(const std::vector<std::string> &names,
+              const std::vector<Arc<::rdmaio::qp::RC>> &qps,
+              const ::rdmaio::nic_id_t &nic_id,
+              const ::rdmaio::qp::QPConfig &config,
+              const double &timeout_usec = 1000000) {
+
+    auto err_str = std::string("unknown error");
+    std::vector<u64> keys;
+
+    if (unlikely(names.size() != qps.size())) {
+      err_str = "names mismatch the qps";
+      goto ErrCase;
+    }
+    for (auto &name : names) {
+      if (unlikely(name.size() > ::rdmaio::qp::kMaxQPNameLen)) {
+        err_str = err_name_to_long;
+        goto ErrCase;
+      }
+    }
+
+    for (usize start = 0; start < names.size(); start += kMaxRCBatch) {
+      const usize num =
+          std::min(static_cast<usize>(kMaxRCBatch),
+                   static_cast<usize>(names.size()) - start);
+
+      proto::RCBatchReq req;
+      req.num = static_cast<u8>(num);
+      req.nic_id = nic_id;
+      req.config = config;
+
+      auto param = ::rdmaio::Marshal::dump<proto::RCBatchReq>(req);
+      for (usize i = start; i < start + num; ++i) {
+        proto::RCBatchEntry entry = {};
+        memcpy(entry.name, names[i].data(), names[i].size());
+        entry.attr = qps[i]->my_attr();
+        param.append(::rdmaio::Marshal::dump<proto::RCBatchEntry>(entry));
+      }
+
+      auto res = rpc.call(proto::CreateRCBatch, param);
+      if (unlikely(res != IOCode::Ok)) {
+        err_str = res.desc;
+        goto ErrCase;
+      }
+
+      auto res_reply = rpc.receive_reply(timeout_usec);
+      if (res_reply != IOCode::Ok)
+        return ::rdmaio::transfer(res_reply,
+                                  std::make_pair(res_reply.desc, keys));
+
+      auto &reply = res_reply.desc;
+      auto header_o = ::rdmaio::Marshal::dedump<proto::RCBatchReply>(reply);
+      if (!header_o || header_o.value().num != num ||
+          reply.size() !=
+              sizeof(proto::RCBatchReply) + num * sizeof(proto::RCReply)) {
+        err_str = err_decode_reply;
+        goto ErrCase;
+      }
+      if (header_o.value().status != proto::CallbackStatus::Ok) {
+        err_str = "Wrong arguments";
+        goto ErrCase;
+      }
+
+      // the index of the first failed QP in this batch
+      usize failed = num;
+      for (usize i = 0; i < num; ++i) {
+        auto qp_reply = ::rdmaio::Marshal::dedump<proto::RCReply>(
+                            reply.substr(sizeof(proto::RCBatchReply) +
+                                             i * sizeof(proto::RCReply),
+                                         sizeof(proto::RCReply)))
+                            .value();
+        const auto &name = names[start + i];
+        if (failed < num) {
+          // the remote QP is created, but the caller will not know its key
+          if (qp_reply.status == proto::CallbackStatus::Ok)
+            delete_orphan(name, qp_reply.key, timeout_usec);
+          continue;
+        }
+
+        switch (qp_reply.status) {
+        case proto::CallbackStatus::Ok: {
+          auto ret = qps[start + i]->connect(qp_reply.attr);
+          if (ret != IOCode::Ok) {
+            err_str = ret.desc;
+            failed = i;
+            delete_orphan(name, qp_reply.key, timeout_usec);
+            break;
+          }
+          keys.push_back(qp_reply.key);
+          break;
+        }
+        case proto::CallbackStatus::ConnectErr:
+          err_str = "Remote connect error";
+          failed = i;
+          break;
+        case proto::CallbackStatus::WrongArg:
+          err_str = "Wrong arguments, possible the QP has exsists";
+          failed = i;
+          break;
+        default:
+          err_str = err_unknown_status;
+          failed = i;
+        }
+      }
+      if (failed < num)
+        goto ErrCase;
+    }
+    return ::rdmaio::Ok(std::make_pair(std::string(""), keys));
+
+  ErrCase:
+    return ::rdmaio::Err(std::make_pair(err_str, keys));
+  }
+
   Result<cc_rc_ret_t> cc_rc_msg(const std::string &qp_name,
                                 const std::string &channel_name,
                                 const usize &msg_sz,
@@ -407,6 +545,19 @@ public:
   ErrCase:
     return ::rdmaio::Err(std::make_pair(err_str, ::rdmaio::qp::DCAttr()));
   }
+
+private:
+  /*!
+    Delete a remote QP created by cc_rc_batch() which cannot be returned,
+    the failure is only logged, since the batch has already failed
+   */
+  void delete_orphan(const std::string &name, const u64 &key,
+                     const double &timeout_usec) {
+    auto res = delete_remote_rc(name, key, timeout_usec);
+    if (res != IOCode::Ok)
+      RDMA_LOG(4) << "failed to delete the orphaned remote QP " << name
+                  << ": " << res.desc;
+  }
 };
 
 // a helper for hide wait_ready process
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <fstream>
 #include <iostream>
 #include <map>
 #include <mutex>
@@ -60,6 +61,21 @@ public:
     return pd;
   }
 
+  /*!
+    The NUMA node the nic attaches to, read from sysfs
+    \ret: {} if unknown, e.g., on a machine with a single node
+   */
+  Option<int> numa_node() const {
+    if (!valid())
+      return {};
+    std::ifstream f(std::string(ctx->device->ibdev_path) +
+                    "/device/numa_node");
+    int node = -1;
+    if (f >> node && node >= 0)
+      return node;
+    return {};
+  }
+
   /*!
    */
   Result<std::string> is_active() const {
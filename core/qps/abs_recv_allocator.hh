@@ -20,6 +20,14 @@ public:
    */
   virtual Option<std::pair<rmem::RMem::raw_ptr_t, rmem::RegAttr>>
   alloc_one_for_remote(const usize &sz) = 0;
+
+  /*!
+    return a buffer of *sz* bytes allocated by alloc_one(_for_remote)
+    \note: by default the buffer is not reused, e.g., for bump allocators
+   */
+  virtual void dealloc_one(rmem::RMem::raw_ptr_t ptr, const usize &sz) {}
+
+  virtual ~AbsRecvAllocator() = default;
 };
 
 } // namespace qp
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <fcntl.h>
+#include <poll.h>
+
+#include "../nic.hh"
+#include "../utils/timer.hh"
+
+namespace rdmaio {
+
+namespace qp {
+
+/*!
+  Counters of the paths taken by CompChannel::wait
+ */
+struct CompWaitStats {
+  // completions found while spinning
+  u64 spin_hits = 0;
+  // completions found right after arming the CQ, i.e., no block needed
+  u64 armed_hits = 0;
+  // #of times the caller blocked on the channel fd
+  u64 blocks = 0;
+  // CQ events received from the channel
+  u64 events = 0;
+  u64 timeouts = 0;
+};
+
+/*!
+  A completion channel, which notifies the completions of the CQs created on
+  it through a file descriptor.
+
+  wait() is a hybrid of busy polling and blocking:
+  it first spins on the CQ for spin_usec, then arms the CQ
+  (ibv_req_notify_cq), and blocks on the channel fd until the next completion.
+  So an idle waiter does not burn a core, while a busy one never blocks.
+  - spin_usec = Timer::no_timeout() gives the original 100% busy polling
+  - spin_usec = 0 blocks immediately if the CQ is empty
+
+  The fd is non-blocking, so it can also be registered to an epoll loop
+  shared with other fds; call arm() before waiting on it, and
+  ack_events() once it is readable.
+
+  \note: a channel should serve the CQs of one thread.
+
+  Example:
+  `
+  auto ch = CompChannel::create(nic).value();
+  auto ud = UD::create(nic, QPConfig(), ch).value();
+  // or, RC::create(nic, config, ch->create_cq(sz), ch->create_cq(sz))
+  // and qp->bind_comp_channel(ch)
+  auto res = ud->wait_one_comp(); // spin, then block
+  `
+ */
+class CompChannel {
+  ibv_comp_channel *channel = nullptr;
+
+  explicit CompChannel(Arc<RNic> nic, const double &spin_usec)
+      : nic(nic), spin_usec(spin_usec) {
+    channel = ibv_create_comp_channel(nic->get_ctx());
+    if (channel == nullptr) {
+      RDMA_LOG(4) << "failed to create the comp channel: " << strerror(errno);
+      return;
+    }
+    int flags = fcntl(channel->fd, F_GETFL);
+    if (flags < 0 || fcntl(channel->fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+      RDMA_LOG(4) << "failed to set the comp channel non-blocking: "
+                  << strerror(errno);
+      ibv_destroy_comp_channel(channel);
+      channel = nullptr;
+    }
+  }
+
+public:
+  const Arc<RNic> nic;
+
+  // time to spin before blocking, in microseconds
+  double spin_usec;
+
+  CompWaitStats stats;
+
+  static Option<Arc<CompChannel>> create(Arc<RNic> nic,
+                                         const double &spin_usec = 50) {
+    auto res = Arc<CompChannel>(new CompChannel(nic, spin_usec));
+    if (res->valid())
+      return res;
+    return {};
+  }
+
+  bool valid() const { return channel != nullptr; }
+
+  ibv_comp_channel *get() const { return channel; }
+
+  int fd() const { return channel->fd; }
+
+  void set_spin_usec(const double &usec) { spin_usec = usec; }
+
+  /*!
+    Create a CQ whose completions are notified by this channel.
+    \note: the CQ should be destroyed by the user, before the channel.
+   */
+  ibv_cq *create_cq(const int &cq_sz) {
+    auto cq = ibv_create_cq(nic->get_ctx(), cq_sz, nullptr, channel, 0);
+    RDMA_VERIFY(WARNING, cq != nullptr)
+        << "failed to create cq on the channel: " << strerror(errno);
+    return cq;
+  }
+
+  /*!
+    Request a notification for the next completion of the CQ.
+   */
+  bool arm(ibv_cq *cq) { return ibv_req_notify_cq(cq, 0) == 0; }
+
+  /*!
+    Consume the pending CQ events of the channel (non-blocking).
+    \ret #of events
+   */
+  usize ack_events() {
+    usize num = 0;
+    ibv_cq *ev_cq;
+    void *ev_ctx;
+    while (ibv_get_cq_event(channel, &ev_cq, &ev_ctx) == 0) {
+      ibv_ack_cq_events(ev_cq, 1);
+      num += 1;
+    }
+    stats.events += num;
+    return num;
+  }
+
+  /*!
+    Wait until f() polls some completions of the cq, or timeout
+    (in microseconds). f should poll the cq (e.g., with ibv_poll_cq), and
+    return true if some completions are polled.
+    \ret true if f succeeds before the timeout
+   */
+  template <typename F>
+  bool wait(ibv_cq *cq, F &&f,
+            const double &timeout = ::rdmaio::Timer::no_timeout()) {
+    Timer t;
+
+    // 1. spin
+    const double spin = std::min(spin_usec, timeout);
+    do {
+      if (f()) {
+        stats.spin_hits += 1;
+        return true;
+      }
+    } while (t.passed_msec() < spin);
+
+    while (true) {
+      // 2. arm the cq, and poll again for the completions that arrive
+      // before the arming
+      if (unlikely(!arm(cq))) {
+        RDMA_LOG(4) << "failed to arm the cq: " << strerror(errno);
+        return false;
+      }
+      if (f()) {
+        stats.armed_hits += 1;
+        return true;
+      }
+
+      // 3. block on the fd
+      const double left = timeout - t.passed_msec();
+      if (left <= 0) {
+        stats.timeouts += 1;
+        return false;
+      }
+      const int timeout_ms = timeout == ::rdmaio::Timer::no_timeout()
+                                 ? -1
+                                 : static_cast<int>(left / 1000) + 1;
+      struct pollfd pfd = {.fd = channel->fd, .events = POLLIN, .revents = 0};
+      stats.blocks += 1;
+      auto rc = poll(&pfd, 1, timeout_ms);
+      if (unlikely(rc < 0 && errno != EINTR)) {
+        RDMA_LOG(4) << "failed to poll the comp channel: " << strerror(errno);
+        return false;
+      }
+      ack_events();
+
+      if (f())
+        return true;
+    }
+  }
+
+  ~CompChannel() {
+    if (channel) {
+      int rc = ibv_destroy_comp_channel(channel);
+      RDMA_VERIFY(WARNING, rc == 0)
+          << "Failed to destroy the comp channel " << strerror(errno)
+          << "; is some CQ using it still alive?";
+    }
+  }
+};
+
+} // namespace qp
+
+} // namespace rdmaio
@@ -13,6 +13,7 @@ const u32 kDefaultPSN = 3185;
 const u32 kRcMaxSendSz = 128;
 const u32 kRcMaxRecvSz = 2048;
 const u32 kDcKey = 1024;
+const usize kMaxInlinSz = 64;
 
 class RC;
 class UD;
@@ -64,6 +65,52 @@ public:
     return max_recv_size;
   }
 
+  /*!
+    The maximum number of SGEs in a send (recv) request.
+    They are validated against the device's limit when creating the QP.
+   */
+  QPConfig &set_max_send_sge(int num) {
+    max_send_sge = num;
+    return *this;
+  }
+
+  int max_send_sges() const { return max_send_sge; }
+
+  QPConfig &set_max_recv_sge(int num) {
+    max_recv_sge = num;
+    return *this;
+  }
+
+  int max_recv_sges() const { return max_recv_sge; }
+
+  /*!
+    The max inline data size requested when creating the QP.
+    The QP's actual limit may be larger, check Dummy::max_inline_data.
+   */
+  QPConfig &set_max_inline(int sz) {
+    max_inline = sz;
+    return *this;
+  }
+
+  int max_inline_sz() const { return max_inline; }
+
+  /*!
+    The RNR (receiver not ready) retry count of the sender, 7 for infinite,
+    and the min RNR NAK timer (in the IB encoding) of the receiver.
+    When the receives are flow-controlled by credits (e.g., RCTransport),
+    RNR should never happen, so a small retry count surfaces the bugs
+    instead of stalling the QP.
+   */
+  QPConfig &set_rnr(int retry, int min_timer) {
+    rnr_retry = retry;
+    min_rnr_timer = min_timer;
+    return *this;
+  }
+
+  int rnr_retry_cnt() const { return rnr_retry; }
+
+  int min_rnr_time() const { return min_rnr_timer; }
+
   QPConfig &add_access_write() {
     access_flags |= IBV_ACCESS_REMOTE_WRITE;
     return *this;
@@ -116,6 +163,11 @@ private:
   int timeout = 20;
   int max_send_size = kRcMaxSendSz;
   int max_recv_size = kRcMaxRecvSz;
+  int max_send_sge = 1;
+  int max_recv_sge = 1;
+  int max_inline = kMaxInlinSz;
+  int rnr_retry = 7;
+  int min_rnr_timer = 20;
 
   int qkey = kDefaultQKey;
 
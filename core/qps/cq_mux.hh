@@ -0,0 +1,165 @@
+#pragma once
+
+#include <vector>
+
+#include "./impl.hh"
+#include "./rc.hh"
+
+namespace rdmaio {
+
+namespace qp {
+
+/*!
+  CQMux shares one send CQ among many RC QPs, so that a thread driving many
+  QPs (e.g., one per remote node) only polls one CQ.
+
+  Each QP created by (or added to) the CQMux is assigned an index, which is
+  encoded in the highest 16 bits of the wr_id (see RC::encode_my_wr).
+  Upon polling, the CQMux finds the owner QP of each completion, and updates
+  its progress and out_signaled, as RC::poll_rc_comps does.
+
+  \note: the completions of a multiplexed QP should only be polled through
+  the CQMux, and the user wr_id should fit in 32 bits.
+  So a multiplexed QP cannot enable the selective signaling (which polls
+  the send CQ by itself), nor be used by RCTransport or WriteRing.
+  \note: the CQMux keeps the QPs alive until itself is destroyed.
+
+  Example:
+  `
+  auto mux = CQMux::create(nic).value();
+  auto qp0 = mux->create_rc(QPConfig()).value();
+  auto qp1 = mux->create_rc(QPConfig()).value();
+  // connect the QPs, and post requests using Op as usual
+
+  ibv_wc wcs[64];
+  RC *owners[64];
+  auto comps = mux->poll_comps(wcs, 64, owners);
+  for (uint i = 0; i < comps.size(); ++i) {
+    // comps[i].wr_id is the user wr_id, owners[i] is the QP posting it
+  }
+  `
+ */
+class CQMux {
+  ibv_cq *cq = nullptr;
+
+  // qps[i] is the QP with mux_idx == i + 1
+  std::vector<Arc<RC>> qps;
+
+  explicit CQMux(Arc<RNic> nic, const int &cq_sz) : nic(nic) {
+    auto res = Impl::create_cq(nic, cq_sz);
+    if (res != IOCode::Ok) {
+      RDMA_LOG(4) << "Error on creating CQ: " << std::get<1>(res.desc);
+      return;
+    }
+    this->cq = std::get<0>(res.desc);
+  }
+
+public:
+  const Arc<RNic> nic;
+
+  /*!
+    \param cq_sz: should be large enough to hold the signaled requests of all
+    the QPs sharing the CQ
+   */
+  static Option<Arc<CQMux>> create(Arc<RNic> nic, const int &cq_sz = 4096) {
+    auto res = Arc<CQMux>(new CQMux(nic, cq_sz));
+    if (res->valid())
+      return res;
+    return {};
+  }
+
+  bool valid() const { return cq != nullptr; }
+
+  ibv_cq *get_cq() const { return cq; }
+
+  usize num_qps() const { return qps.size(); }
+
+  /*!
+    Create an RC QP using the shared CQ as its send CQ.
+   */
+  Option<Arc<RC>> create_rc(const QPConfig &config,
+                            ibv_cq *recv_cq = nullptr) {
+    auto res = RC::create(nic, config, recv_cq, cq);
+    if (!res)
+      return {};
+    if (add(res.value()) != IOCode::Ok)
+      return {};
+    return res;
+  }
+
+  /*!
+    Add an RC created on the shared CQ (i.e., RC::create(.., mux->get_cq()))
+    \ret
+    - Ok: the mux_idx of the QP
+    - Err: the QP uses another CQ, has enabled the selective signaling,
+      or too many QPs
+   */
+  Result<u16> add(const Arc<RC> &qp) {
+    if (qp->cq != cq || qp->mux_idx != 0 || qp->selective_signaled())
+      return Err(static_cast<u16>(0));
+    if (qps.size() >= std::numeric_limits<u16>::max())
+      return Err(static_cast<u16>(0));
+
+    qps.push_back(qp);
+    qp->mux_idx = static_cast<u16>(qps.size());
+    return Ok(qp->mux_idx);
+  }
+
+  /*!
+    Poll at most *num* completions from the shared CQ with one ibv_poll_cq.
+    The wr_id of each returned wc is decoded **in place** to the user wr_id.
+    The completions of unknown QPs (e.g., created on the shared CQ but not
+    added) are logged and skipped, so they are not returned.
+    \param owners: if not null, owners[i] stores the QP of the ith completion
+   */
+  CompView poll_comps(ibv_wc *wcs, const int &num, RC **owners = nullptr) {
+    CompView comps = {.wcs = wcs, .num = ibv_poll_cq(cq, num, wcs)};
+
+    int kept = 0;
+    for (uint i = 0; i < comps.size(); ++i) {
+      auto &wc = wcs[i];
+      const usize idx = wc.wr_id >> RC::kMuxIdxShift;
+      if (unlikely(idx == 0 || idx > qps.size())) {
+        RDMA_LOG(4) << "skip a completion with unknown mux idx " << idx
+                    << " in the wr_id: " << wc.wr_id;
+        continue;
+      }
+
+      RC *qp = qps[idx - 1].get();
+      qp->out_signaled -= 1;
+
+      // completions of one QP are in order, so the watermark only grows
+      auto mark = RC::decode_watermark(wc.wr_id);
+      wc.wr_id = RC::decode_user_wr(wc.wr_id) & bitmask<u64>(32);
+      qp->complete_upto(mark, wc);
+
+      wcs[kept] = wc;
+      if (owners != nullptr)
+        owners[kept] = qp;
+      kept += 1;
+    }
+    if (!comps.error())
+      comps.num = kept;
+    return comps;
+  }
+
+  template <usize N>
+  CompView poll_comps(ibv_wc (&wcs)[N], RC **owners = nullptr) {
+    return poll_comps(wcs, N, owners);
+  }
+
+  ~CQMux() {
+    // the QPs must be destroyed before the CQ
+    qps.clear();
+    if (cq) {
+      int rc = ibv_destroy_cq(cq);
+      RDMA_VERIFY(WARNING, rc == 0)
+          << "Failed to destroy the shared cq " << strerror(errno)
+          << "; is some QP using it still alive?";
+    }
+  }
+};
+
+} // namespace qp
+
+} // namespace rdmaio
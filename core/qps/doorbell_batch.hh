@@ -0,0 +1,195 @@
+#pragma once
+
+#include "../utils/timer.hh"
+
+#include "./doorbell_helper.hh"
+#include "./op.hh"
+
+namespace rdmaio {
+
+namespace qp {
+
+/*!
+  DoorbellBatch batches one-sided requests (described by Op) of an RC QP,
+  and posts them to the NIC with one doorbell (i.e., one ibv_post_send).
+
+  The batch is flushed when:
+  - it is full (N requests), or
+  - flush() is called, or
+  - the flush timeout (in usec) passed since the first request of the batch,
+    which is checked upon add() and flush_if_timeout().
+
+  Only the last request of a batch can be signaled.
+  If the selective signaling is enabled at the QP (RC::enable_selective_signal),
+  the QP decides whether the last request is signaled.
+  Otherwise, the last request is always signaled.
+  User can force a signal by adding an Op with IBV_SEND_SIGNALED.
+
+  Example:
+  `
+  Arc<RC> qp; // some connected QP
+  DoorbellBatch<8> batch(qp);
+
+  Op<> op;
+  op.set_rdma_rbuf(rbuf_ptr, rmr.key).set_read();
+  op.set_payload(lbuf_ptr, sizeof(u64), lmr.key);
+
+  auto res = batch.add(op, 73); // 73 is the user wr_id
+  ...
+  res = batch.flush(); // post the remaining requests
+  `
+ */
+template <usize N = kNMaxDoorbell> class DoorbellBatch {
+  static_assert(N > 0 && N <= kNMaxDoorbell, "Wrong doorbell batch size");
+
+  DoorbellHelper<N> doorbell;
+  // the user wr_id of the pending requests, encoded during flush
+  u64 user_wrs[N];
+  // flags (i.e., IBV_SEND_SIGNALED) requested for the last request
+  int batch_flags = 0;
+
+  Arc<RC> qp;
+
+  const double flush_timeout_usec;
+  Timer timer; // started when the first request is added
+
+public:
+  explicit DoorbellBatch(const Arc<RC> &qp,
+                         const double &timeout_usec = Timer::no_timeout())
+      : doorbell(IBV_WR_RDMA_READ), qp(qp), flush_timeout_usec(timeout_usec) {}
+
+  usize size() const { return doorbell.size(); }
+
+  bool empty() const { return doorbell.empty(); }
+
+  /*!
+    Add a request described by the op to the batch.
+    The op is copied, so it can be reused after the call.
+    \note: flush the batch if it is full or timeout
+   */
+  Result<std::string> add(const Op<1> &op, const u64 &wr_id = 0) {
+    doorbell.next();
+    if (doorbell.size() == 1)
+      timer.reset();
+
+    auto &wr = doorbell.cur_wr();
+    auto next = wr.next;
+
+    wr = op.wr;
+    wr.next = next;
+    wr.num_sge = 1;
+    wr.sg_list = &(doorbell.cur_sge());
+    doorbell.cur_sge() = op.sges[0];
+    wr.send_flags =
+        qp->inline_flags(wr, op.wr.send_flags & (~IBV_SEND_SIGNALED));
+
+    user_wrs[doorbell.size() - 1] = wr_id;
+    batch_flags |= (op.wr.send_flags & IBV_SEND_SIGNALED);
+
+    if (doorbell.full())
+      return flush();
+    return flush_if_timeout();
+  }
+
+  /*!
+    Below are handy helpers to add requests,
+    using the default MRs binded to the QP.
+    \note: these function will panic if no MR is bind to this QP.
+   */
+  Result<std::string> read(const u64 &remote_off, void *local_addr,
+                           const u32 &sz, const u64 &wr_id = 0) {
+    Op<> op;
+    op.set_read().set_rdma_addr(remote_off, qp->remote_mr.value());
+    op.set_payload(local_addr, sz, qp->local_mr.value().lkey);
+    return add(op, wr_id);
+  }
+
+  Result<std::string> write(const u64 &remote_off, void *local_addr,
+                            const u32 &sz, const u64 &wr_id = 0) {
+    Op<> op;
+    op.set_write().set_rdma_addr(remote_off, qp->remote_mr.value());
+    op.set_payload(local_addr, sz, qp->local_mr.value().lkey);
+    return add(op, wr_id);
+  }
+
+  Result<std::string> cas(const u64 &remote_off, u64 *local_addr,
+                          const u64 &compare, const u64 &swap,
+                          const u64 &wr_id = 0) {
+    Op<> op;
+    auto rmr = qp->remote_mr.value();
+    op.set_atomic_rbuf(reinterpret_cast<u64 *>(rmr.buf + remote_off), rmr.key)
+        .set_cas(compare, swap);
+    op.set_payload(local_addr, sizeof(u64), qp->local_mr.value().lkey);
+    return add(op, wr_id);
+  }
+
+  Result<std::string> faa(const u64 &remote_off, u64 *local_addr,
+                          const u64 &add_val, const u64 &wr_id = 0) {
+    Op<> op;
+    auto rmr = qp->remote_mr.value();
+    op.set_atomic_rbuf(reinterpret_cast<u64 *>(rmr.buf + remote_off), rmr.key)
+        .set_fetch_add(add_val);
+    op.set_payload(local_addr, sizeof(u64), qp->local_mr.value().lkey);
+    return add(op, wr_id);
+  }
+
+  /*!
+    Flush the batch if the flush timeout passed since its first request.
+   */
+  inline Result<std::string> flush_if_timeout() {
+    if (!empty() && timer.passed_msec() >= flush_timeout_usec)
+      return flush();
+    return ::rdmaio::Ok(std::string(""));
+  }
+
+  /*!
+    Post all the pending requests with one doorbell.
+    \note: if failed, the pending requests are dropped
+   */
+  Result<std::string> flush() {
+    if (empty())
+      return ::rdmaio::Ok(std::string(""));
+
+    RC *qp_ptr = qp.get();
+    const usize num = size();
+
+    auto flags = qp_ptr->selective_signaled() ? batch_flags
+                                              : (batch_flags | IBV_SEND_SIGNALED);
+    auto res_f = qp_ptr->prepare_signal(flags, num);
+    if (unlikely(res_f != IOCode::Ok)) {
+      clear();
+      return ::rdmaio::Err(std::string("failed to reclaim the send queue"));
+    }
+
+    for (uint i = 0; i < num; ++i) {
+      doorbell.get_wr_ptr(i)->wr_id = qp_ptr->encode_my_wr(user_wrs[i], 1);
+    }
+    doorbell.cur_wr().send_flags |= res_f.desc;
+    if (res_f.desc & IBV_SEND_SIGNALED)
+      qp_ptr->out_signaled += 1;
+
+    doorbell.freeze();
+    struct ibv_send_wr *bad_sr;
+    auto res = ibv_post_send(qp_ptr->qp, doorbell.first_wr_ptr(), &bad_sr);
+    clear();
+
+    if (0 == res)
+      return ::rdmaio::Ok(std::string(""));
+    return ::rdmaio::Err(std::string(strerror(errno)));
+  }
+
+  ~DoorbellBatch() {
+    RDMA_LOG_IF(4, !empty()) << "doorbell batch destroyed with " << size()
+                             << " pending requests not flushed";
+  }
+
+private:
+  void clear() {
+    doorbell.clear();
+    batch_flags = 0;
+  }
+};
+
+} // namespace qp
+
+} // namespace rdmaio
@@ -35,6 +35,9 @@ const usize kNMaxDoorbell = 16;
   doorbell.freeze_done(); // re-set this doorbell to reuse, (optional)
   doorbell.clear(); // re-set the counter
   `
+
+  For one-sided RC requests, check DoorbellBatch (./doorbell_batch.hh),
+  which manages the above process automatically.
 */
 template <usize N = kNMaxDoorbell>
 struct DoorbellHelper {
@@ -99,7 +102,7 @@ struct DoorbellHelper {
 
   inline void freeze_done() {
     assert(!empty());
-    wrs[cur_idx].next = &(wrs[cur_idx + 1]);
+    freeze_done_at(cur_idx);
   }
 
   inline void clear() {
@@ -52,7 +52,7 @@ public:
     qp_attr.dest_qp_num = attr.qpn;
     qp_attr.rq_psn = config.rq_psn; // should this match the sender's psn ?
     qp_attr.max_dest_rd_atomic = config.max_dest_rd_atomic;
-    qp_attr.min_rnr_timer = 20;
+    qp_attr.min_rnr_timer = config.min_rnr_time();
 
     qp_attr.ah_attr.dlid = attr.lid;
     qp_attr.ah_attr.sl = 0;
@@ -84,7 +84,7 @@ public:
     qp_attr.sq_psn = config.sq_psn;
     qp_attr.timeout = config.timeout;
     qp_attr.retry_cnt = 7;
-    qp_attr.rnr_retry = 7;
+    qp_attr.rnr_retry = config.rnr_retry_cnt();
     qp_attr.max_rd_atomic = config.max_rd_atomic;
     qp_attr.max_dest_rd_atomic = config.max_dest_rd_atomic;
 
@@ -112,17 +112,43 @@ public:
     return Ok(std::make_pair(ccq, std::string("")));
   }
 
+  /*!
+    check whether the SGE limits in the config are supported by the device
+   */
+  static Result<std::string> check_sges(Arc<RNic> nic,
+                                        const QPConfig &config) {
+    if (config.max_send_sges() <= 0 || config.max_recv_sges() <= 0)
+      return Err(std::string("the number of SGEs should be positive"));
+
+    ibv_device_attr attr;
+    if (ibv_query_device(nic->get_ctx(), &attr) != 0)
+      return Err(std::string(strerror(errno)));
+
+    if (config.max_send_sges() > attr.max_sge ||
+        config.max_recv_sges() > attr.max_sge)
+      return Err(std::string("too many SGEs, the device supports at most ") +
+                 std::to_string(attr.max_sge));
+    return Ok(std::string(""));
+  }
+
   using CreateQPRes_t = Result<std::pair<ibv_qp *, std::string>>;
   static CreateQPRes_t create_qp(Arc<RNic> nic, ibv_qp_type type,
                                  const QPConfig &config,
                                  ibv_cq *cq, // send cq
-                                 ibv_cq *recv_cq = nullptr) {
+                                 ibv_cq *recv_cq = nullptr,
+                                 ibv_srq *srq = nullptr) {
 
     if (cq == nullptr) {
       return Err(std::make_pair<ibv_qp *, std::string>(nullptr,
                                                        "CQ passed in as null"));
     }
 
+    auto res_sge = check_sges(nic, config);
+    if (res_sge != IOCode::Ok) {
+      return Err(std::make_pair<ibv_qp *, std::string>(
+          nullptr, std::move(res_sge.desc)));
+    }
+
     if (recv_cq == nullptr) {
       recv_cq = cq;
     }
@@ -131,14 +157,15 @@ public:
 
     qp_init_attr.send_cq = cq;
     qp_init_attr.recv_cq = recv_cq;
+    qp_init_attr.srq = srq;
     qp_init_attr.qp_type = type;
     qp_init_attr.sq_sig_all = 0;
 
     qp_init_attr.cap.max_send_wr = config.max_send_sz();
     qp_init_attr.cap.max_recv_wr = config.max_recv_sz();
-    qp_init_attr.cap.max_send_sge = 1;
-    qp_init_attr.cap.max_recv_sge = 1;
-    qp_init_attr.cap.max_inline_data = kMaxInlinSz;
+    qp_init_attr.cap.max_send_sge = config.max_send_sges();
+    qp_init_attr.cap.max_recv_sge = config.max_recv_sges();
+    qp_init_attr.cap.max_inline_data = config.max_inline_sz();
 
     auto qp = ibv_create_qp(nic->get_pd(), &qp_init_attr);
     if (qp == nullptr) {
@@ -209,6 +236,12 @@ public:
                                               "CQ passed in as null"));
     }
 
+    auto res_sge = check_sges(nic, config);
+    if (res_sge != IOCode::Ok) {
+      return Err(std::make_pair<ibv_qp *, std::string>(
+          nullptr, std::move(res_sge.desc)));
+    }
+
     if (recv_cq == nullptr) {
       recv_cq = cq;
     }
@@ -216,8 +249,8 @@ public:
     qp_init_attr.send_cq = cq;
     qp_init_attr.recv_cq = recv_cq;
     qp_init_attr.cap.max_send_wr = config.max_send_sz();
-    qp_init_attr.cap.max_send_sge = 1;
-    qp_init_attr.cap.max_inline_data = kMaxInlinSz;
+    qp_init_attr.cap.max_send_sge = config.max_send_sges();
+    qp_init_attr.cap.max_inline_data = config.max_inline_sz();
     qp_init_attr.qp_type = IBV_EXP_QPT_DC_INI;
     qp_init_attr.pd = nic->get_pd();
     qp_init_attr.comp_mask = IBV_QP_INIT_ATTR_PD;
@@ -7,14 +7,14 @@
 #include "../utils/mod.hh"
 #include "../utils/abs_factory.hh"
 
+#include "./comp_channel.hh"
+#include "./config.hh"
 #include "./recv_helper.hh"
 
 namespace rdmaio {
 
 namespace qp {
 
-const usize kMaxInlinSz = 64;
-
 using ProgressMark_t = u16;
 // Track the out-going and acknowledged reqs
 struct Progress {
@@ -38,6 +38,36 @@ struct Progress {
   }
 };
 
+/*!
+  A view over a batch of completions polled from a CQ.
+  It does not own the wcs, which are provided by the caller.
+
+  Example:
+  `
+  ibv_wc wcs[16];
+  for (auto &wc : qp->poll_send_comps(wcs)) {
+    // handle the wc
+  }
+  `
+ */
+struct CompView {
+  ibv_wc *wcs = nullptr;
+  // the return value of ibv_poll_cq, negative if the poll failed
+  int num = 0;
+
+  usize size() const { return num > 0 ? static_cast<usize>(num) : 0; }
+
+  bool empty() const { return size() == 0; }
+
+  bool error() const { return num < 0; }
+
+  ibv_wc *begin() const { return wcs; }
+
+  ibv_wc *end() const { return wcs + size(); }
+
+  ibv_wc &operator[](const usize &idx) const { return wcs[idx]; }
+};
+
 /*!
   Below structures are make packed to allow communicating
   between servers
@@ -60,6 +90,31 @@ public:
   // #of outsignaled RDMA requests
   usize out_signaled = 0;
 
+  // false if the send cq is shared with other QPs, so it is not destroyed
+  // together with the QP
+  bool own_cq = true;
+  bool own_recv_cq = true;
+
+  /*!
+    Write and send requests whose payload is no larger than inline_threshold
+    are inlined automatically (see inline_flags()), so the NIC needs not
+    DMA-read the local buffer.
+    max_inline_data is the QP's actual limit, queried after its creation.
+   */
+  u32 max_inline_data = 0;
+  u32 inline_threshold = 0;
+
+  // #of write/send requests posted inlined, or with DMA
+  usize inlined_reqs = 0;
+  usize dma_reqs = 0;
+
+  /*!
+    If bound, the waits on the send cq (e.g., wait_one_comp) spin for a
+    while and then block on the channel, see CompChannel::wait.
+    The send cq must be created on the channel.
+   */
+  Arc<CompChannel> comp_channel;
+
   Arc<RNic> nic;
 
   ~Dummy() {
@@ -71,14 +126,14 @@ public:
       qp = nullptr;
     }
 
-    if (cq) {
+    if (cq && own_cq) {
       int res = ibv_destroy_cq(cq);
       RDMA_VERIFY(WARNING, res == 0)
         << "Failed to destroy cq " << strerror(errno);
       cq = nullptr;
     }
 
-    if (recv_cq) {
+    if (recv_cq && own_recv_cq) {
       int res = ibv_destroy_cq(recv_cq);
       RDMA_VERIFY(WARNING, res == 0)
         << "Failed to destroy recv_cq " << strerror(errno);
@@ -94,6 +149,57 @@ public:
 
   inline usize ongoing_signaled() const { return out_signaled; }
 
+  void bind_comp_channel(const Arc<CompChannel> &ch) { comp_channel = ch; }
+
+  /*!
+    Query the QP's max inline data, and use it as the inline threshold.
+    Should be called after the QP is created.
+   */
+  void init_inline() {
+    struct ibv_qp_attr attr;
+    struct ibv_qp_init_attr init_attr;
+    if (ibv_query_qp(qp, &attr, IBV_QP_CAP, &init_attr) == 0)
+      max_inline_data = attr.cap.max_inline_data;
+    inline_threshold = max_inline_data;
+  }
+
+  /*!
+    Set the max payload size to inline, bounded by max_inline_data.
+    0 disables the auto inline.
+   */
+  void set_inline_threshold(const u32 &sz) {
+    inline_threshold = std::min(sz, max_inline_data);
+  }
+
+  /*!
+    Add IBV_SEND_INLINE to the flags if the wr is a write/send request,
+    whose total payload fits the inline threshold.
+    \ret the flags to post the wr with
+   */
+  inline int inline_flags(const ibv_send_wr &wr, const int &flags) {
+    switch (wr.opcode) {
+    case IBV_WR_RDMA_WRITE:
+    case IBV_WR_RDMA_WRITE_WITH_IMM:
+    case IBV_WR_SEND:
+    case IBV_WR_SEND_WITH_IMM:
+      break;
+    default:
+      return flags;
+    }
+
+    if (!(flags & IBV_SEND_INLINE)) {
+      u64 sz = 0;
+      for (int i = 0; i < wr.num_sge; ++i)
+        sz += wr.sg_list[i].length;
+      if (sz > inline_threshold) {
+        dma_reqs += 1;
+        return flags;
+      }
+    }
+    inlined_reqs += 1;
+    return flags | IBV_SEND_INLINE;
+  }
+
   /*!
     Send the requests specificed by the sr
     \ret: errno
@@ -120,6 +226,21 @@ public:
     return std::make_pair(poll_result,wc);
   }
 
+  /*!
+    Poll at most *num* completions from the send_cq with one ibv_poll_cq.
+    \note: the polled completions are stored in wcs
+   */
+  inline CompView poll_send_comps(ibv_wc *wcs, const int &num) {
+    auto poll_result = ibv_poll_cq(cq, num, wcs);
+    if (poll_result > 0)
+      out_signaled -= poll_result;
+    return {.wcs = wcs, .num = poll_result};
+  }
+
+  template <usize N> inline CompView poll_send_comps(ibv_wc (&wcs)[N]) {
+    return poll_send_comps(wcs, N);
+  }
+
   static std::string wc_status(const ibv_wc &wc) {
     return std::string(ibv_wc_status_str(wc.status));
   }
@@ -129,13 +250,23 @@ public:
     \note timeout is measured in microseconds
    */
   Result<ibv_wc> wait_one_comp(const double &timeout = ::rdmaio::Timer::no_timeout()) {
-    Timer t;
     std::pair<int,ibv_wc> res;
-    do {
-      // poll one comp
-      res = poll_send_comp();
-    } while (res.first == 0 && // poll result is 0
-             t.passed_msec() <= timeout);
+    if (comp_channel) {
+      comp_channel->wait(
+          cq,
+          [this, &res]() {
+            res = poll_send_comp();
+            return res.first != 0;
+          },
+          timeout);
+    } else {
+      Timer t;
+      do {
+        // poll one comp
+        res = poll_send_comp();
+      } while (res.first == 0 && // poll result is 0
+               t.passed_msec() <= timeout);
+    }
     if(res.first == 0)
       return Timeout(res.second);
     if(unlikely(res.first < 0 || res.second.status != IBV_WC_SUCCESS))
@@ -165,8 +296,8 @@ public:
   - Err: errono
   - Ok: -
  */
-  template <usize entries>
-  Result<int> post_recvs(RecvEntries<entries> &r, int num) {
+  template <usize entries, usize nsge>
+  Result<int> post_recvs(RecvEntries<entries, nsge> &r, int num) {
 
     auto tail = r.header + num - 1;
     if (tail >= entries)
@@ -177,11 +308,12 @@ public:
     struct ibv_recv_wr *bad_rr;
     auto rc = ibv_post_recv(this->qp, r.header_ptr(), &bad_rr);
 
+    // re-set the link, so the entries can be posted again on failures
+    r.wr_ptr(tail)->next = temp;
     if (rc != 0)
       return Err(errno);
 
-    // re-set the header, tailer
-    r.wr_ptr(tail)->next = temp;
+    // re-set the header
     r.header = (tail + 1) % entries;
 
     return Ok(0);
@@ -39,6 +39,14 @@ enum op_type {
       op.set_atomic_rbuf(rbuf_ptr, rmr.key).set_fetch_add(add_data);
       op.set_payload(lbuf_ptr, sizeof(u64), lmr.key)
       auto ret = op.execute(qp, IBV_SEND_SIGNALED);
+ gather write: write a header and a payload (stored separately) to a
+ continuous remote buffer. The QP must be created with at least 2 send sges,
+ i.e., QPConfig().set_max_send_sge(2).
+      ::rdmaio::qp::Op<2> op;
+      op.set_write().set_rdma_rbuf(rbuf_ptr, rmr.key);
+      op.set_gather(header_ptr, sizeof(Header), lmr.key,
+                    payload_ptr, payload_sz, lmr.key);
+      auto ret = op.execute(qp, IBV_SEND_SIGNALED);
  */
 template <usize NSGE = 1> struct Op {
   static_assert(NSGE > 0 && NSGE <= 64, "shoud use NSGE in (0,64]");
@@ -146,6 +154,21 @@ public:
     return true;
   }
 
+  /*!
+    Use the first two sges to gather a header and a payload stored in two
+    (non-continuous) registered buffers.
+   */
+  template <typename H, typename P>
+  inline Op &set_gather(const H *header, const u32 &header_sz,
+                        const u32 &header_lkey, const P *payload,
+                        const u32 &payload_sz, const u32 &payload_lkey) {
+    static_assert(NSGE >= 2, "gather requires at least 2 sges");
+    this->wr.num_sge = 2;
+    this->set_payload(header, header_sz, header_lkey, 0);
+    this->set_payload(payload, payload_sz, payload_lkey, 1);
+    return *this;
+  }
+
   inline auto execute_batch(const Arc<RC> &qp) -> Result<std::string> {
     // to avoid performance overhead of Arc, we first extract QP's raw pointer
     // out
@@ -168,20 +191,74 @@ public:
 
   inline auto execute(const Arc<RC> &qp, const int &flags = 0, u64 wr_id = 0)
       -> Result<std::string> {
+    auto res = prepare_wr(qp.get(), flags, wr_id);
+    if (unlikely(res != IOCode::Ok))
+      return res;
+    return execute_batch(qp);
+  }
 
-    RC *qp_ptr = ({  // unsafe code
-      RC *temp = qp.get();
-      temp;
-    });
+  /*!
+    Post the op, and call cb(ctx, wc) upon its completion,
+    where wc is the completion covering the op.
+    The op is signaled unless the QP enables selective signaling, in which
+    case it is completed by a later signaled request.
+
+    \note: the continuation is called when the completion is polled from
+    the QP, e.g., using poll_rc_comps, or by a CQMux.
+    \note: the op is copied at post time, so it can be reused immediately.
+
+    Example:
+    `
+    void on_read(void *ctx, const ibv_wc &wc) {
+      if (wc.status == IBV_WC_SUCCESS) ...
+    }
+    op.execute_async(qp, on_read, &my_ctx);
+    `
+   */
+  inline auto execute_async(const Arc<RC> &qp, async_cb_t cb, void *ctx,
+                            const int &flags = 0, u64 wr_id = 0)
+      -> Result<std::string> {
+    RC *qp_ptr = qp.get();
+    auto res = prepare_wr(qp_ptr,
+                          qp_ptr->selective_signaled()
+                              ? flags
+                              : (flags | IBV_SEND_SIGNALED),
+                          wr_id);
+    if (unlikely(res != IOCode::Ok))
+      return res;
+
+    auto mark = RC::decode_watermark(this->wr.wr_id);
+    qp_ptr->reg_async(mark, cb, ctx);
+    res = execute_batch(qp);
+    if (unlikely(res != IOCode::Ok))
+      qp_ptr->reg_async(mark, nullptr, nullptr);
+    return res;
+  }
+
+private:
+  /*!
+    Fill the wr_id and flags of the wr to post
+   */
+  inline auto prepare_wr(RC *qp_ptr, const int &flags, const u64 &wr_id)
+      -> Result<std::string> {
+    if (unlikely(this->wr.num_sge > qp_ptr->my_config.max_send_sges()))
+      return ::rdmaio::Err(
+          std::string("the QP does not support so many send sges"));
+
+    // the selective signaling (if enabled) may reclaim the send queue,
+    // so it must be done before the progress is forwarded
+    auto res_f = qp_ptr->prepare_signal(flags);
+    if (unlikely(res_f != IOCode::Ok))
+      return ::rdmaio::Err(std::string("failed to reclaim the send queue"));
 
     this->wr.wr_id = qp_ptr->encode_my_wr(wr_id, 1);
     this->wr.next = nullptr;
     this->wr.sg_list = &(this->sges[0]);
-    this->wr.send_flags = flags;
-
-    return execute_batch(qp);
+    this->wr.send_flags = qp_ptr->inline_flags(this->wr, res_f.desc);
+    return ::rdmaio::Ok(std::string(""));
   }
 
+public:
   friend std::ostream &operator<<(std::ostream &os, const Op &i) {
     return os << "{wr-" << i.wr.wr_id << "}";
   }
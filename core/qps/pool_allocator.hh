@@ -0,0 +1,266 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "../nic.hh"
+#include "../rmem/handler.hh"
+
+#include "./abs_recv_allocator.hh"
+
+namespace rdmaio {
+
+namespace qp {
+
+/*!
+  A pool allocator over one large registered region, which serves buffers in
+  several size classes, and reuses the freed ones.
+  So messages are not all sized to the max message size,
+  and the buffers of a destroyed QP are returned to the pool
+  (see release_recv_entries in ./recv_helper.hh).
+
+  - A request is served by the smallest class no smaller than it.
+    Requests larger than the largest class fail.
+  - The region is carved into buffers lazily, kCacheBatch at a time.
+  - Each thread has a cache of free buffers per class, so the allocation
+    and deallocation are lock-free in the common case. The cache is refilled
+    from (or returns to) the shared free lists in batches of kCacheBatch.
+    The buffers cached by a thread are returned once it exits.
+
+  Example:
+  `
+  auto pool = PoolAllocator::create(nic, 64 * 1024 * 1024).value();
+  auto entries = RecvEntriesFactory<PoolAllocator, 128, 1024>::create(*pool);
+  ...
+  // after the QP is destroyed
+  release_recv_entries(*entries, *pool);
+  `
+ */
+class PoolAllocator : public AbsRecvAllocator {
+public:
+  static constexpr const usize kCacheBatch = 32;
+  static constexpr const usize kAlign = 64;
+
+  static std::vector<usize> default_classes() {
+    return {64, 256, 1024, 4096, 16384, 65536};
+  }
+
+private:
+  // free lists shared by all the threads
+  struct Central {
+    std::mutex lock;
+    std::vector<std::vector<char *>> free;
+    char *cur = nullptr; // the region not carved yet is [cur, end)
+    char *end = nullptr;
+  };
+
+  struct ThreadCache {
+    std::weak_ptr<Central> central;
+    std::vector<std::vector<char *>> free;
+
+    ~ThreadCache() {
+      auto c = central.lock();
+      if (!c)
+        return;
+      std::lock_guard<std::mutex> guard(c->lock);
+      for (uint i = 0; i < free.size(); ++i)
+        c->free[i].insert(c->free[i].end(), free[i].begin(), free[i].end());
+    }
+  };
+
+  Arc<rmem::RMem> mem;
+  // null if the region is registered by the user
+  Arc<rmem::RegHandler> handler;
+  const rmem::RegAttr attr;
+
+  // sorted sizes of the classes
+  const std::vector<usize> classes;
+  Arc<Central> central;
+
+  // identify the pool in the thread caches, never reused
+  const u64 id;
+
+public:
+  /*!
+    Create a pool over a newly allocated and registered region of *sz* bytes
+   */
+  static Option<Arc<PoolAllocator>>
+  create(Arc<RNic> nic, const u64 &sz,
+         const std::vector<usize> &classes = default_classes()) {
+    auto mem = Arc<rmem::RMem>(new rmem::RMem(sz));
+    if (!mem->valid())
+      return {};
+    auto handler = rmem::RegHandler::create(mem, nic);
+    if (!handler)
+      return {};
+    return create(mem, handler.value()->get_reg_attr().value(), classes,
+                  handler.value());
+  }
+
+  /*!
+    Create a pool over a region registered with *attr*
+   */
+  static Option<Arc<PoolAllocator>>
+  create(Arc<rmem::RMem> mem, const rmem::RegAttr &attr,
+         const std::vector<usize> &classes = default_classes(),
+         Arc<rmem::RegHandler> handler = nullptr) {
+    if (!mem->valid() || classes.empty())
+      return {};
+    return Arc<PoolAllocator>(new PoolAllocator(mem, attr, classes, handler));
+  }
+
+  usize num_classes() const { return classes.size(); }
+
+  /*!
+    \ret the size of the class serving sz, or 0 if sz is too large
+   */
+  usize class_sz(const usize &sz) const {
+    auto c = class_of(sz);
+    return c < 0 ? 0 : classes[c];
+  }
+
+  /*!
+    \ret #of bytes carved from the region
+   */
+  u64 carved_bytes() {
+    std::lock_guard<std::mutex> guard(central->lock);
+    return central->cur - static_cast<char *>(mem->raw_ptr);
+  }
+
+  Option<std::pair<rmem::RMem::raw_ptr_t, rmem::mr_key_t>>
+  alloc_one(const usize &sz) override {
+    auto ptr = alloc_raw(sz);
+    if (ptr == nullptr)
+      return {};
+    return std::make_pair(static_cast<rmem::RMem::raw_ptr_t>(ptr), attr.lkey);
+  }
+
+  /*!
+    The returned attr is of the whole region, so the remote accesses the
+    buffer at (ptr - attr.buf) of it.
+   */
+  Option<std::pair<rmem::RMem::raw_ptr_t, rmem::RegAttr>>
+  alloc_one_for_remote(const usize &sz) override {
+    auto ptr = alloc_raw(sz);
+    if (ptr == nullptr)
+      return {};
+    return std::make_pair(static_cast<rmem::RMem::raw_ptr_t>(ptr), attr);
+  }
+
+  void dealloc_one(rmem::RMem::raw_ptr_t ptr, const usize &sz) override {
+    auto c = class_of(sz);
+    auto p = static_cast<char *>(ptr);
+    RDMA_ASSERT(c >= 0 && p >= static_cast<char *>(mem->raw_ptr) &&
+                p < static_cast<char *>(mem->raw_ptr) + mem->sz)
+        << "dealloc a buffer not from the pool: " << ptr << " " << sz;
+
+    auto &cache = my_cache().free[c];
+    cache.push_back(p);
+    if (cache.size() >= 2 * kCacheBatch) {
+      std::lock_guard<std::mutex> guard(central->lock);
+      auto &free = central->free[c];
+      free.insert(free.end(), cache.end() - kCacheBatch, cache.end());
+      cache.resize(cache.size() - kCacheBatch);
+    }
+  }
+
+private:
+  PoolAllocator(Arc<rmem::RMem> mem, const rmem::RegAttr &attr,
+                const std::vector<usize> &cs, Arc<rmem::RegHandler> handler)
+      : mem(mem), handler(handler), attr(attr), classes(sorted_classes(cs)),
+        central(std::make_shared<Central>()), id(next_id()) {
+    central->free.resize(classes.size());
+
+    auto start = reinterpret_cast<uintptr_t>(mem->raw_ptr);
+    auto aligned = (start + kAlign - 1) & ~(static_cast<uintptr_t>(kAlign) - 1);
+    central->cur = reinterpret_cast<char *>(std::min(aligned, start + mem->sz));
+    central->end = static_cast<char *>(mem->raw_ptr) + mem->sz;
+  }
+
+  static std::vector<usize> sorted_classes(std::vector<usize> cs) {
+    for (auto &c : cs)
+      c = (c + kAlign - 1) & ~(kAlign - 1);
+    std::sort(cs.begin(), cs.end());
+    cs.erase(std::unique(cs.begin(), cs.end()), cs.end());
+    return cs;
+  }
+
+  static u64 next_id() {
+    static std::atomic<u64> id(0);
+    return id.fetch_add(1);
+  }
+
+  int class_of(const usize &sz) const {
+    auto it = std::lower_bound(classes.begin(), classes.end(), sz);
+    if (unlikely(it == classes.end()))
+      return -1;
+    return static_cast<int>(it - classes.begin());
+  }
+
+  char *alloc_raw(const usize &sz) {
+    auto c = class_of(sz);
+    if (unlikely(c < 0))
+      return nullptr;
+
+    auto &cache = my_cache().free[c];
+    if (unlikely(cache.empty()))
+      refill(c, cache);
+    if (unlikely(cache.empty()))
+      return nullptr;
+
+    auto ret = cache.back();
+    cache.pop_back();
+    return ret;
+  }
+
+  /*!
+    Move kCacheBatch free buffers of the class c to the cache,
+    carve new ones if the shared free list runs out.
+   */
+  void refill(const int &c, std::vector<char *> &cache) {
+    std::lock_guard<std::mutex> guard(central->lock);
+    auto &free = central->free[c];
+    const usize n = std::min(static_cast<usize>(kCacheBatch),
+                             static_cast<usize>(free.size()));
+    cache.insert(cache.end(), free.end() - n, free.end());
+    free.resize(free.size() - n);
+
+    const auto carved = cache.size();
+    for (usize i = n; i < kCacheBatch; ++i) {
+      if (central->end - central->cur < static_cast<i64>(classes[c]))
+        break;
+      cache.push_back(central->cur);
+      central->cur += classes[c];
+    }
+    // so the new buffers are allocated in the address order
+    std::reverse(cache.begin() + carved, cache.end());
+  }
+
+  ThreadCache &my_cache() {
+    thread_local std::vector<std::pair<u64, std::unique_ptr<ThreadCache>>>
+        caches;
+    for (auto &c : caches) {
+      if (c.first == id)
+        return *c.second;
+    }
+
+    // drop the caches of the destroyed pools
+    caches.erase(std::remove_if(caches.begin(), caches.end(),
+                                [](const auto &c) {
+                                  return c.second->central.expired();
+                                }),
+                 caches.end());
+
+    auto cache = new ThreadCache();
+    cache->central = central;
+    cache->free.resize(classes.size());
+    caches.emplace_back(id, std::unique_ptr<ThreadCache>(cache));
+    return *cache;
+  }
+};
+
+} // namespace qp
+
+} // namespace rdmaio
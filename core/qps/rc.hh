@@ -1,5 +1,8 @@
 #pragma once
 
+#include <utility>
+#include <vector>
+
 #include "../rmem/handler.hh"
 
 #include "./mod.hh"
@@ -42,6 +45,12 @@ namespace qp {
                                 .imm_data = 0}
   );
 */
+/*!
+  The continuation of an op posted by Op::execute_async,
+  called with the user provided ctx, and the completion covering the op.
+ */
+using async_cb_t = void (*)(void *ctx, const ibv_wc &wc);
+
 class RC : public Dummy, public std::enable_shared_from_this<RC> {
 public:
   // default local MR used by this QP
@@ -53,6 +62,34 @@ public:
 
   // pending requests monitor
   Progress progress;
+
+  /*!
+    States of the selective signaling policy, see enable_selective_signal().
+    signal_every == 0 means the policy is disabled.
+   */
+  usize signal_every = 0;
+  usize unsignaled_reqs = 0;
+
+  /*!
+    The index of this QP at the CQMux (./cq_mux.hh) sharing its send cq.
+    It is encoded in the highest 16 bits of the wr_id, so the CQMux can find
+    the owner of a completion. 0 means the QP is not multiplexed.
+   */
+  static constexpr const u32 kMuxIdxShift = 48;
+  u16 mux_idx = 0;
+
+  /*!
+    Continuations of the async ops (see Op::execute_async),
+    indexed by the watermark of the op.
+    The table is sized to a power of two larger than the send queue,
+    so the in-flight ops never collide.
+    It is allocated upon the first async op, so no allocation is made per op.
+   */
+  struct AsyncSlot {
+    async_cb_t cb = nullptr;
+    void *ctx = nullptr;
+  };
+  std::vector<AsyncSlot> async_slots;
 public:
   const QPConfig my_config;
 
@@ -65,7 +102,9 @@ public:
      }
   */
 private:
-  RC(Arc<RNic> nic, const QPConfig &config,ibv_cq *recv_cq = nullptr) : Dummy(nic), my_config(config) {
+  RC(Arc<RNic> nic, const QPConfig &config, ibv_cq *recv_cq = nullptr,
+     ibv_cq *send_cq = nullptr, ibv_srq *srq = nullptr)
+      : Dummy(nic), my_config(config) {
     /*
       It takes 3 steps to create an RC QP during the initialization
       according to the RDMA programming mannal.
@@ -73,27 +112,36 @@ private:
       Then, we create the qp.
       Finally, we change the qp to read_to_init status.
      */
-    // 1 cq
-    auto res = Impl::create_cq(nic, my_config.max_send_sz());
-    if (res != IOCode::Ok) {
-      RDMA_LOG(4) << "Error on creating CQ: " << std::get<1>(res.desc);
-      return;
+    // 1 cq, unless a (shared) send cq is provided
+    if (send_cq != nullptr) {
+      this->cq = send_cq;
+      this->own_cq = false;
+    } else {
+      auto res = Impl::create_cq(nic, my_config.max_send_sz());
+      if (res != IOCode::Ok) {
+        RDMA_LOG(4) << "Error on creating CQ: " << std::get<1>(res.desc);
+        return;
+      }
+      this->cq = std::get<0>(res.desc);
     }
-    this->cq = std::get<0>(res.desc);
 
     // FIXME: we donot sanity check the the incoming recv_cq
-    // The choice is that the recv cq could be shared among other QPs
+    // The choice is that the recv cq could be shared among other QPs,
+    // so the RC does not destroy it
     // shall we replace this with smart pointers ?
     this->recv_cq = recv_cq;
+    this->own_recv_cq = false;
 
     // 2 qp
     auto res_qp =
-        Impl::create_qp(nic, IBV_QPT_RC, my_config, this->cq, this->recv_cq);
+        Impl::create_qp(nic, IBV_QPT_RC, my_config, this->cq, this->recv_cq,
+                        srq);
     if (res_qp != IOCode::Ok) {
-      RDMA_LOG(4) << "Error on creating QP: " << std::get<1>(res.desc);
+      RDMA_LOG(4) << "Error on creating QP: " << std::get<1>(res_qp.desc);
       return;
     }
     this->qp = std::get<0>(res_qp.desc);
+    this->init_inline();
 
     // 3 -> init
     auto res_init =
@@ -104,10 +152,19 @@ private:
   }
 
 public:
+  /*!
+    \param send_cq: if not null, the RC uses it as its send cq (which can be
+    shared with other QPs, e.g., using a CQMux) instead of creating one.
+    The caller must keep the send_cq alive until the RC is destroyed.
+    \param srq: if not null, the RC receives messages using the shared
+    receive queue (see ./srq.hh), and recv_cq should be the SRQ's recv_cq.
+   */
   static Option<Arc<RC>> create(Arc<RNic> nic,
                                 const QPConfig &config = QPConfig(),
-                                ibv_cq *recv_cq = nullptr) {
-    auto res = Arc<RC>(new RC(nic, config,recv_cq));
+                                ibv_cq *recv_cq = nullptr,
+                                ibv_cq *send_cq = nullptr,
+                                ibv_srq *srq = nullptr) {
+    auto res = Arc<RC>(new RC(nic, config, recv_cq, send_cq, srq));
     if (res->valid()) {
       return Option<Arc<RC>>(std::move(res));
     }
@@ -201,8 +258,82 @@ public:
     return send_normal(desc, payload, local_mr.value(), remote_mr.value());
   }
 
+  /*!
+    Let the RC manage signaling for the posted requests.
+    After enabled, user can post requests without IBV_SEND_SIGNALED;
+    the RC signals one out of every *every* requests, and reclaims the send
+    queue (by polling the covering completion) before it overflows.
+
+    \note: *every* is bounded by half of the send queue, so that there is
+    always a signaled request in flight when the queue is full.
+    \note: completions polled during reclaiming are consumed by the RC.
+    So it cannot be enabled at a QP multiplexed by a CQMux, otherwise the
+    RC would steal the completions of the other QPs from the shared CQ.
+    \ret: false if the QP is multiplexed
+   */
+  bool enable_selective_signal(const usize &every) {
+    if (unlikely(mux_idx != 0)) {
+      RDMA_LOG(4) << "selective signaling is not supported on a muxed QP";
+      return false;
+    }
+    const usize max_every = std::max(max_send_sz() / 2, 1);
+    signal_every = std::min(std::max(every, static_cast<usize>(1)), max_every);
+    unsignaled_reqs = 0;
+    return true;
+  }
+
+  void disable_selective_signal() { signal_every = 0; }
+
+  bool selective_signaled() const { return signal_every != 0; }
+
+  /*!
+    Prepare the flags for posting *num* requests.
+    If the selective signaling is enabled, it first waits until there is
+    room for *num* requests in the send queue, and then decides whether the
+    last request of them should be signaled.
+    Otherwise, the flags are returned untouched.
+
+    \note: it must be called **before** the progress is forwarded
+    (i.e., encode_my_wr) for these requests.
+
+    \ret
+    - Ok: the flags to post the last request with
+    - Err: a completion with error status is polled, or the send queue
+      cannot be reclaimed since there is no signaled request in flight
+   */
+  inline Result<int> prepare_signal(const int &flags, const usize &num = 1) {
+    if (likely(!selective_signaled()))
+      return ::rdmaio::Ok(flags);
+
+    RDMA_ASSERT(num <= static_cast<usize>(max_send_sz() / 2))
+        << "too many requests to post at once: " << num;
+
+    // reclaim the send queue
+    while (progress.pending_reqs() + num > static_cast<usize>(max_send_sz())) {
+      if (unlikely(out_signaled == 0))
+        return ::rdmaio::Err(flags);
+      auto res = poll_rc_comp();
+      if (res && std::get<1>(res.value()).status != IBV_WC_SUCCESS)
+        return ::rdmaio::Err(flags);
+    }
+
+    unsignaled_reqs += num;
+    if ((flags & IBV_SEND_SIGNALED) || unsignaled_reqs >= signal_every) {
+      unsignaled_reqs = 0;
+      return ::rdmaio::Ok(flags | IBV_SEND_SIGNALED);
+    }
+    return ::rdmaio::Ok(flags);
+  }
+
+  /*!
+    \note: if the QP is multiplexed (mux_idx != 0), the user wr should fit
+    in 32 bits, since the higher bits carry the mux_idx.
+   */
   u64 encode_my_wr(const u64 &wr, int forward_num) {
-    return (static_cast<u64>(wr) << Progress::num_progress_bits) |
+    RDMA_ASSERT(mux_idx == 0 || wr <= bitmask<u64>(32))
+        << "the wr_id of a muxed QP should fit in 32 bits: " << wr;
+    return (static_cast<u64>(mux_idx) << kMuxIdxShift) |
+           (static_cast<u64>(wr) << Progress::num_progress_bits) |
            static_cast<u64>(progress.forward(forward_num));
   }
 
@@ -220,18 +351,22 @@ public:
 
     struct ibv_send_wr sr, *bad_sr;
 
+    auto flags = prepare_signal(desc.flags);
+    if (unlikely(flags != IOCode::Ok))
+      return Err(std::string("failed to reclaim the send queue"));
+
     sr.wr_id = encode_my_wr(desc.wr_id, 1);
     sr.opcode = desc.op;
     sr.num_sge = 1;
     sr.next = nullptr;
     sr.sg_list = &sge;
-    sr.send_flags = desc.flags;
+    sr.send_flags = inline_flags(sr, flags.desc);
     sr.imm_data = payload.imm_data;
 
     sr.wr.rdma.remote_addr = remote_mr.buf + payload.remote_addr;
     sr.wr.rdma.rkey = remote_mr.key;
 
-    if (desc.flags & IBV_SEND_SIGNALED)
+    if (flags.desc & IBV_SEND_SIGNALED)
       out_signaled += 1;
 
     auto rc = ibv_post_send(qp, &sr, &bad_sr);
@@ -251,13 +386,98 @@ public:
     if (std::get<0>(num_wc) == 0)
       return {};
     auto &wc = std::get<1>(num_wc);
-    u64 user_wr = wc.wr_id >> (Progress::num_progress_bits);
+    complete_upto(decode_watermark(wc.wr_id), wc);
+
+    return std::make_pair(decode_user_wr(wc.wr_id), wc);
+  }
+
+  /*!
+    Register the continuation of the op with the watermark *mark*
+   */
+  void reg_async(const ProgressMark_t &mark, async_cb_t cb, void *ctx) {
+    if (unlikely(async_slots.empty())) {
+      usize sz = 1;
+      while (sz <= static_cast<usize>(max_send_sz()))
+        sz <<= 1;
+      async_slots.resize(sz);
+    }
+    async_slots[mark & (async_slots.size() - 1)] = {.cb = cb, .ctx = ctx};
+  }
 
-    const auto mask = bitmask<u64>(Progress::num_progress_bits);
-    u64 water_mark = wc.wr_id & bitmask<u64>(Progress::num_progress_bits);
-    progress.done(water_mark);
+  /*!
+    Mark the requests until the watermark *mark* as done,
+    and fire the continuations of the async ops among them,
+    i.e., a signaled completion also completes the unsignaled ops before it.
+    \note: the progress is updated before firing the continuations,
+    so they can post new requests.
+   */
+  inline void complete_upto(const ProgressMark_t &mark, const ibv_wc &wc) {
+    auto m = progress.low_watermark;
+    progress.done(mark);
+    if (likely(async_slots.empty()))
+      return;
 
-    return std::make_pair(user_wr, wc);
+    const usize mask = async_slots.size() - 1;
+    while (m != mark) {
+      m += 1;
+      auto &slot = async_slots[m & mask];
+      if (slot.cb != nullptr) {
+        auto cb = std::exchange(slot.cb, nullptr);
+        cb(slot.ctx, wc);
+      }
+    }
+  }
+
+  /*!
+    A batched version of poll_rc_comp.
+    It drains at most *num* completions with one ibv_poll_cq,
+    and updates the out_signaled and the progress only once for the batch.
+
+    \note: the wr_id of each returned wc is decoded **in place**,
+    i.e., it is the user's wr_id passed to encode_my_wr.
+
+    Example:
+    `
+    ibv_wc wcs[64];
+    auto comps = qp->poll_rc_comps(wcs);
+    for (auto &wc : comps) {
+      // wc.wr_id is the user wr
+    }
+    `
+   */
+  CompView poll_rc_comps(ibv_wc *wcs, const int &num) {
+    auto comps = poll_send_comps(wcs, num);
+    if (comps.empty())
+      return comps;
+
+    // completions of a send queue are in order,
+    // so the last one carries the latest watermark
+    if (likely(async_slots.empty())) {
+      progress.done(decode_watermark(comps[comps.size() - 1].wr_id));
+      for (auto &wc : comps)
+        wc.wr_id = decode_user_wr(wc.wr_id);
+      return comps;
+    }
+
+    for (auto &wc : comps) {
+      auto mark = decode_watermark(wc.wr_id);
+      wc.wr_id = decode_user_wr(wc.wr_id);
+      complete_upto(mark, wc);
+    }
+    return comps;
+  }
+
+  template <usize N> CompView poll_rc_comps(ibv_wc (&wcs)[N]) {
+    return poll_rc_comps(wcs, N);
+  }
+
+  static inline u64 decode_user_wr(const u64 &wr_id) {
+    return wr_id >> (Progress::num_progress_bits);
+  }
+
+  static inline ProgressMark_t decode_watermark(const u64 &wr_id) {
+    return static_cast<ProgressMark_t>(
+        wr_id & bitmask<u64>(Progress::num_progress_bits));
   }
 
   Result<std::pair<u64, ibv_wc>>
@@ -265,11 +485,21 @@ public:
     Timer t;
     ibv_wc wc;
     Option<std::pair<u64, ibv_wc>> res = {};
-    do {
-      // poll one comp
-      res = poll_rc_comp();
-    } while (!res && // poll result is 0
-             t.passed_msec() < timeout);
+    if (comp_channel) {
+      comp_channel->wait(
+          cq,
+          [this, &res]() {
+            res = poll_rc_comp();
+            return res.has_value();
+          },
+          timeout);
+    } else {
+      do {
+        // poll one comp
+        res = poll_rc_comp();
+      } while (!res && // poll result is 0
+               t.passed_msec() < timeout);
+    }
     if (!res)
       return Timeout(std::make_pair(0lu, wc));
     if (std::get<1>(res.value()).status != IBV_WC_SUCCESS)
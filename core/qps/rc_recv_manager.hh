@@ -3,6 +3,7 @@
 #include "../rctrl.hh"
 
 #include "./recv_helper.hh"
+#include "./srq.hh"
 
 namespace rdmaio {
 
@@ -33,24 +34,36 @@ public:
   Factory<std::string, RecvCommon> reg_recv_cqs;
   Factory<std::string, RecvEntries<R>> reg_recv_entries;
 
+  /*!
+    QPs created with a name_recv registered here are attached to the SRQ,
+    so no per-QP RecvEntries is allocated.
+   */
+  Factory<std::string, SRQ<>> reg_srqs;
+
   /*!
     we assume RCtrl is a global static variable which never freed.
    */
   RCtrl *rctrl_p = nullptr;
 
+  /*!
+    The handler is serialized, since the allocators of the registered
+    RecvCommons are not thread-safe, while RCtrl may serve it with workers.
+   */
   explicit RecvManager(RCtrl &ctr) : rctrl_p(&ctr) {
     RDMA_ASSERT(ctr.rpc.register_handler(
         proto::CreateRCM,
-        std::bind(&RecvManager::msg_rc_handler, this, std::placeholders::_1)));
+        std::bind(&RecvManager::msg_rc_handler, this, std::placeholders::_1),
+        true));
   }
 
   /*!
     The handler for creating a QP which is ready for recv.
     This handler should register with RCtrl (defined in ../rctrl.hh).
     \note: the implementation is similar to the RCtrl's rc_handler,
-    but additionally allocate a RecvEntries<R> for the QP.
+    but additionally allocate a RecvEntries<R> for the QP,
+    or attach the QP to the SRQ registered with the name_recv.
   */
-  ByteBuffer msg_rc_handler(const ByteBuffer &b) {
+  ByteBuffer msg_rc_handler(const ByteView &b) {
     auto rc_req_o = ::rdmaio::Marshal::dedump<proto::RCReq>(b);
     if (!rc_req_o)
       goto WA;
@@ -72,16 +85,25 @@ public:
 
         // 1.0 check whether we are able to use the registered recv_cq
         ibv_cq *recv_cq = nullptr;
+        Option<Arc<SRQ<>>> srq = {};
         if (rc_req.whether_recv == 1) {
+          srq = reg_srqs.query(rc_req.name_recv);
           auto recv_c_res = reg_recv_cqs.query(rc_req.name_recv);
-          if (!recv_c_res)
+          if (srq)
+            recv_cq = srq.value()->recv_cq;
+          else if (!recv_c_res)
             recv_cq = nullptr;
           else
             recv_cq = recv_c_res.value()->cq;
         }
 
         // 1.1 try to create and register this QP
-        auto rc = qp::RC::create(nic.value(), rc_req.config, recv_cq).value();
+        auto rc_o = qp::RC::create(nic.value(), rc_req.config, recv_cq,
+                                   nullptr,
+                                   srq ? srq.value()->srq : nullptr);
+        if (!rc_o)
+          goto WA;
+        auto rc = rc_o.value();
         auto rc_status = rctrl_p->registered_qps.reg(rc_req.name, rc);
 
         if (!rc_status) {
@@ -97,6 +119,10 @@ public:
         }
         key = rc_status.value();
 
+        // the SRQ has already been filled with recv buffers
+        if (srq)
+          return rctrl_p->fetch_qp_attr(rc_req, key);
+
         // 1.3 this QP is done, alloc the recv; entries
         auto recv_c_res = reg_recv_cqs.query(rc_req.name_recv); // must exsist, because we have checked in step 1.0
         auto recv_entries = RecvEntriesFactoryv2<R>::create(recv_c_res.value()->allocator, rc_req.max_recv_sz);
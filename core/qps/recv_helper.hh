@@ -7,14 +7,17 @@ namespace rdmaio {
 namespace qp {
 
 /*!
-  helper data struture for two-sided QP recv
+  helper data struture for two-sided QP recv.
+  Each recv entry has NSGE sges, stored continuously in *sges*,
+  i.e., the sges of the ith entry are sges[i * NSGE, (i + 1) * NSGE).
  */
-template <usize N> struct RecvEntries {
+template <usize N, usize NSGE = 1> struct RecvEntries {
+  static_assert(NSGE > 0, "a recv entry should have at least one sge");
   /*!
    internal data structure used for send/recv verbs
   */
   struct ibv_recv_wr rs[N];
-  struct ibv_sge sges[N];
+  struct ibv_sge sges[N * NSGE];
   struct ibv_wc wcs[N];
 
   /*!
@@ -29,11 +32,13 @@ template <usize N> struct RecvEntries {
 
   ibv_recv_wr *header_ptr() { return wr_ptr(header); }
 
+  ibv_sge *sges_ptr(const usize &idx) { return sges + idx * NSGE; }
+
   void sanity_check() {
     for (uint i = 0; i < N - 1; ++i) {
       RDMA_ASSERT((u64)(wr_ptr(i)->next) == (u64)(wr_ptr(i + 1)));
-      RDMA_ASSERT((u64)(wr_ptr(i)->sg_list) == (u64)(&sges[i]));
-      RDMA_ASSERT(wr_ptr(i)->num_sge == 1);
+      RDMA_ASSERT((u64)(wr_ptr(i)->sg_list) == (u64)(sges_ptr(i)));
+      RDMA_ASSERT(wr_ptr(i)->num_sge == NSGE);
     }
   }
 };
@@ -99,5 +104,60 @@ public:
   }
 };
 
+/*!
+  Create recv entries with two sges: a header and a payload, which are
+  allocated separately. The header is stored in the first sge, so a message
+  of "header + payload" sent by the remote is scattered into the two buffers.
+
+  \note: the wr_id of each entry is the address of the header,
+  so RecvIter::cur_msg() returns the header, while the payload can be found
+  using RecvIter::cur_sges()[1].
+ */
+template <class AbsAllocator, usize N, usize header_sz, usize payload_sz>
+class SplitRecvEntriesFactory {
+public:
+  static Arc<RecvEntries<N, 2>> create(AbsAllocator &allocator) {
+
+    Arc<RecvEntries<N, 2>> ret(new RecvEntries<N, 2>);
+
+    for (uint i = 0; i < N; ++i) {
+      auto header_buf = allocator.alloc_one(header_sz).value();
+      auto payload_buf = allocator.alloc_one(payload_sz).value();
+
+      auto sges = ret->sges_ptr(i);
+      sges[0] = {.addr = reinterpret_cast<uintptr_t>(std::get<0>(header_buf)),
+                 .length = static_cast<u32>(header_sz),
+                 .lkey = std::get<1>(header_buf)};
+      sges[1] = {.addr = reinterpret_cast<uintptr_t>(std::get<0>(payload_buf)),
+                 .length = static_cast<u32>(payload_sz),
+                 .lkey = std::get<1>(payload_buf)};
+
+      { // unsafe code
+        ret->rs[i].wr_id = sges[0].addr;
+        ret->rs[i].sg_list = sges;
+        ret->rs[i].num_sge = 2;
+        ret->rs[i].next = (i < N - 1) ? (&(ret->rs[i + 1])) : (&(ret->rs[0]));
+      }
+    }
+    return ret;
+  }
+};
+
+/*!
+  Return the buffers of the recv entries to the allocator creating them,
+  e.g., after the QP using the entries is destroyed.
+ */
+template <usize N, usize NSGE>
+inline void release_recv_entries(RecvEntries<N, NSGE> &entries,
+                                 AbsRecvAllocator &alloc) {
+  for (uint i = 0; i < N * NSGE; ++i) {
+    auto &sge = entries.sges[i];
+    if (sge.addr != 0)
+      alloc.dealloc_one(reinterpret_cast<rmem::RMem::raw_ptr_t>(sge.addr),
+                        sge.length);
+    sge.addr = 0;
+  }
+}
+
 } // namespace qp
 } // namespace rdmaio
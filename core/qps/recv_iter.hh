@@ -1,11 +1,24 @@
 #pragma once
 
+#include "./comp_channel.hh"
 #include "./recv_helper.hh"
 
 namespace rdmaio {
 
 namespace qp {
 
+/*!
+  Repost the recv entries of the *num* polled completions to the QP.
+  It is overloaded for QPs using a different recv structure, e.g., SRQ.
+ */
+template <typename QP, usize es, usize NSGE>
+inline Result<int> repost_recvs(QP *qp, RecvEntries<es, NSGE> *entries,
+                                const ibv_wc *wcs, const int &num) {
+  if (entries == nullptr)
+    return ::rdmaio::Ok(0);
+  return qp->post_recvs(*entries, num);
+}
+
 /*!
   RecvIter helps traversing two-sided messages, using recv_cq.
 
@@ -22,9 +35,9 @@ namespace qp {
   }
   `
  */
-template <typename QP, usize es> class RecvIter {
+template <typename QP, usize es, usize NSGE = 1> class RecvIter {
   QP *qp = nullptr;
-  RecvEntries<es> *entries = nullptr;
+  RecvEntries<es, NSGE> *entries = nullptr;
   ibv_wc *wcs;
 
   int idx = 0;
@@ -39,11 +52,12 @@ public:
   RecvIter(Arc<QP> &qp, ibv_wc *wcs)
       : qp(qp.get()), wcs(wcs), total_msgs(ibv_poll_cq(qp->recv_cq, es, wcs)) {}
 
-  RecvIter(Arc<QP> &qp, Arc<RecvEntries<es>> &e) : RecvIter(qp, e->wcs) {
+  RecvIter(Arc<QP> &qp, Arc<RecvEntries<es, NSGE>> &e)
+      : RecvIter(qp, e->wcs) {
     entries = e.get();
   }
 
-  auto set_meta(Arc<QP> &qp, Arc<RecvEntries<es>> &e) {
+  auto set_meta(Arc<QP> &qp, Arc<RecvEntries<es, NSGE>> &e) {
     this->entries = e.get();
     this->qp  = qp.get();
     this->wcs = e->wcs;
@@ -54,6 +68,26 @@ public:
     this->idx = 0;
   }
 
+  /*!
+    Wait for the next messages with the channel's hybrid spin-then-block,
+    the QP's recv_cq must be created on the channel.
+    The messages of the previous poll are reposted first.
+    \ret true if some messages arrive before the timeout (in microseconds)
+   */
+  bool wait(CompChannel &ch,
+            const double &timeout = ::rdmaio::Timer::no_timeout()) {
+    RDMA_ASSERT(qp != nullptr);
+    this->clear();
+    this->idx = 0;
+    return ch.wait(
+        qp->recv_cq,
+        [this]() {
+          this->total_msgs = ibv_poll_cq(qp->recv_cq, es, wcs);
+          return this->total_msgs > 0;
+        },
+        timeout);
+  }
+
   /*!
     \ret (imm_data, recv_buffer)
     */
@@ -65,13 +99,35 @@ public:
     return {};
   }
 
+  /*!
+    \ret the sges of the recv entry storing the current message
+    \note: the iter must be created with the recv entries, and the entries
+    should only be posted to one QP, so that messages are received in order
+   */
+  ibv_sge *cur_sges() const {
+    RDMA_ASSERT(entries != nullptr);
+    return entries->sges_ptr((entries->header + idx) % es);
+  }
+
+  /*!
+    \ret the qp_num of the QP receiving the current message,
+    useful if the recv_cq is shared, e.g., using an SRQ
+   */
+  u32 cur_qp_num() const { return wcs[idx].qp_num; }
+
+  /*!
+    \ret the completion of the current message, e.g., for its byte_len,
+    or the src_qp/slid of a UD message
+   */
+  const ibv_wc &cur_wc() const { return wcs[idx]; }
+
   inline void next() { idx += 1; }
 
   inline bool has_msgs() const { return idx < total_msgs; }
 
   void clear() {
-    if (total_msgs > 0 && qp != nullptr && entries != nullptr) {
-      auto res = qp->post_recvs(*entries, total_msgs);
+    if (total_msgs > 0 && qp != nullptr) {
+      auto res = repost_recvs(qp, entries, wcs, total_msgs);
       if (unlikely(res != IOCode::Ok))
         RDMA_LOG(4) << "post recv error: " << strerror(res.desc);
     }
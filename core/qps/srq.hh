@@ -0,0 +1,192 @@
+#pragma once
+
+#include <algorithm>
+#include <utility>
+
+#include "./abs_recv_allocator.hh"
+#include "./impl.hh"
+#include "./recv_helper.hh"
+
+namespace rdmaio {
+
+namespace qp {
+
+/*!
+  A shared receive queue (SRQ), whose recv buffers are shared by many RC QPs.
+  So the memory for recv buffers does not grow with the number of QPs.
+
+  The completions of all the attached QPs go to the SRQ's recv_cq,
+  use RecvIter::cur_qp_num() to identify the source QP of a message.
+
+  Refill policy: the buffers of consumed messages are reposted in batches of
+  *refill_batch* (see refill()), which is done automatically by RecvIter.
+  Since the messages may complete out of the posted order,
+  a buffer is reposted only after its completion is polled.
+
+  \note: all the recv buffers should be allocated from one MR.
+  \note: the QPs attached to the SRQ must be destroyed before it.
+
+  Example:
+  `
+  auto srq = SRQ<>::create(nic, alloc, 4096).value();
+  auto qp = RC::create(nic, config, srq->recv_cq, nullptr, srq->srq).value();
+
+  for (RecvIter<SRQ<>, 64> iter(srq, srq->wcs); iter.has_msgs(); iter.next()) {
+    auto imm_msg = iter.cur_msg().value();
+    auto src_qpn = iter.cur_qp_num();
+  }
+  `
+ */
+template <usize R = 4096> class SRQ {
+  // buffers of the consumed messages, which are waiting to be reposted
+  struct ibv_recv_wr rs[R];
+  struct ibv_sge sges[R];
+  usize pending = 0;
+
+  const usize refill_batch;
+
+public:
+  ibv_srq *srq = nullptr;
+  ibv_cq *recv_cq = nullptr;
+
+  // for RecvIter to poll the completions
+  struct ibv_wc wcs[R];
+
+  const usize msg_sz;
+  rmem::mr_key_t lkey = 0;
+
+  // #of recv buffers in the SRQ
+  usize posted = 0;
+
+  Arc<RNic> nic;
+
+  static Option<Arc<SRQ>> create(Arc<RNic> nic,
+                                 Arc<AbsRecvAllocator> alloc,
+                                 const usize &msg_sz,
+                                 const usize &refill_batch = 32) {
+    auto res = Arc<SRQ>(new SRQ(nic, msg_sz, refill_batch));
+    if (!res->valid())
+      return {};
+    if (res->fill(alloc) != IOCode::Ok)
+      return {};
+    return res;
+  }
+
+  bool valid() const { return srq != nullptr && recv_cq != nullptr; }
+
+  usize pending_refill() const { return pending; }
+
+  /*!
+    Repost the recv buffers of *num* polled completions.
+    The buffers are actually posted when *refill_batch* are pending,
+    or *force* is true.
+   */
+  Result<int> refill(const ibv_wc *wcs, const int &num,
+                     const bool &force = false) {
+    for (int i = 0; i < num; ++i) {
+      sges[pending] = {.addr = wcs[i].wr_id,
+                       .length = static_cast<u32>(msg_sz),
+                       .lkey = lkey};
+      rs[pending].wr_id = wcs[i].wr_id;
+      pending += 1;
+    }
+    posted -= num;
+
+    if (pending >= refill_batch || (force && pending > 0))
+      return flush();
+    return ::rdmaio::Ok(0);
+  }
+
+  ~SRQ() {
+    if (srq) {
+      int rc = ibv_destroy_srq(srq);
+      RDMA_VERIFY(WARNING, rc == 0)
+          << "Failed to destroy srq " << strerror(errno);
+    }
+    if (recv_cq) {
+      int rc = ibv_destroy_cq(recv_cq);
+      RDMA_VERIFY(WARNING, rc == 0)
+          << "Failed to destroy the recv_cq of srq " << strerror(errno);
+    }
+  }
+
+private:
+  SRQ(Arc<RNic> nic, const usize &msg_sz, const usize &refill_batch)
+      : refill_batch(
+            std::min(std::max(refill_batch, static_cast<usize>(1)), R)),
+        msg_sz(msg_sz), nic(nic) {
+    for (uint i = 0; i < R; ++i) {
+      rs[i].sg_list = &sges[i];
+      rs[i].num_sge = 1;
+      rs[i].next = (i < R - 1) ? (&rs[i + 1]) : nullptr;
+    }
+
+    auto res = Impl::create_cq(nic, R);
+    if (res != IOCode::Ok) {
+      RDMA_LOG(4) << "Error on creating recv CQ: " << std::get<1>(res.desc);
+      return;
+    }
+    this->recv_cq = std::get<0>(res.desc);
+
+    auto res_srq = Impl::create_srq(nic, R, 1);
+    if (res_srq != IOCode::Ok) {
+      RDMA_LOG(4) << "Error on creating SRQ: " << std::get<1>(res_srq.desc);
+      return;
+    }
+    this->srq = std::get<0>(res_srq.desc);
+  }
+
+  /*!
+    Fill the SRQ with R buffers from the allocator
+   */
+  Result<std::string> fill(Arc<AbsRecvAllocator> &alloc) {
+    for (uint i = 0; i < R; ++i) {
+      auto buf = alloc->alloc_one(msg_sz);
+      if (!buf)
+        return ::rdmaio::Err(std::string("failed to allocate recv buffers"));
+
+      auto key = std::get<1>(buf.value());
+      if (i == 0)
+        lkey = key;
+      else if (key != lkey)
+        return ::rdmaio::Err(std::string("recv buffers should be in one MR"));
+
+      auto addr = reinterpret_cast<u64>(std::get<0>(buf.value()));
+      sges[pending] = {.addr = addr,
+                       .length = static_cast<u32>(msg_sz),
+                       .lkey = lkey};
+      rs[pending].wr_id = addr;
+      pending += 1;
+    }
+    if (flush() != IOCode::Ok)
+      return ::rdmaio::Err(std::string(strerror(errno)));
+    return ::rdmaio::Ok(std::string(""));
+  }
+
+  Result<int> flush() {
+    auto temp = std::exchange(rs[pending - 1].next, nullptr);
+
+    struct ibv_recv_wr *bad_rr;
+    auto rc = ibv_post_srq_recv(srq, &rs[0], &bad_rr);
+    rs[pending - 1].next = temp;
+
+    if (rc != 0)
+      return ::rdmaio::Err(errno);
+    posted += pending;
+    pending = 0;
+    return ::rdmaio::Ok(0);
+  }
+};
+
+/*!
+  RecvIter over an SRQ reposts the consumed buffers with SRQ::refill
+ */
+template <usize R, usize es, usize NSGE>
+inline Result<int> repost_recvs(SRQ<R> *srq, RecvEntries<es, NSGE> *entries,
+                                const ibv_wc *wcs, const int &num) {
+  return srq->refill(wcs, num);
+}
+
+} // namespace qp
+
+} // namespace rdmaio
@@ -1,8 +1,14 @@
 #pragma once
 
+#include <algorithm>
+#include <map>
 #include <memory>
+#include <tuple>
+
+#include "../rmem/handler.hh"
 
 #include "./config.hh"
+#include "./doorbell_helper.hh"
 #include "./mod.hh"
 #include "./impl.hh"
 #include "./recv_helper.hh"
@@ -17,11 +23,25 @@ namespace qp {
 */
 const usize kGRHSz = 40;
 
+/*!
+  A request sent by UD::send_batch
+ */
+struct UDReq {
+  const QPAttr *dest = nullptr; // the remote UD QP to send to
+  const void *buf = nullptr;    // must be in the local MR binded to the UD
+  u32 len = 0;
+  u32 imm = 0;
+};
+
 /*!
   an abstraction of unreliable datagram
   example usage:
   `
-  // TODO
+  Arc<UD> ud = UD::create(nic, QPConfig()).value();
+  ud->bind_local_mr(mr); // the MR storing the messages to send
+
+  QPAttr dest; // fetched from the remote, e.g., using ConnectManager
+  auto res = ud->send_to(dest, buf, sizeof(u64), 73);
   `
   // check tests/test_ud.cc
  */
@@ -35,12 +55,34 @@ public:
 
   const usize kMaxUdRecvEntries = 2048;
 
+  // #of un-signaled requests posted since the last signaled one
   usize pending_reqs = 0;
 
   const QPConfig my_config;
 
-  static Option<Arc<UD>> create(Arc<RNic> nic, const QPConfig &config) {
-    auto ud_ptr = Arc<UD>(new UD(nic, config));
+  // default local MR used by send_to and send_batch
+  Option<RegAttr> local_mr;
+
+private:
+  /*!
+    Cached address handlers.
+    An address handler only depends on the address of the remote host,
+    so it is indexed by the (lid, gid), and shared by all QPs at that host.
+   */
+  using ah_key_t = std::tuple<u64, u64, u64>;
+  std::map<ah_key_t, ibv_ah *> ah_cache;
+
+  DoorbellHelper<kNMaxDoorbell> doorbell;
+
+public:
+
+  /*!
+    \param channel: if not null, the send and recv cqs are created on it,
+    so the waits on them can block (see CompChannel)
+   */
+  static Option<Arc<UD>> create(Arc<RNic> nic, const QPConfig &config,
+                                Arc<CompChannel> channel = nullptr) {
+    auto ud_ptr = Arc<UD>(new UD(nic, config, channel));
     if (ud_ptr->valid())
       return ud_ptr;
     return {};
@@ -55,10 +97,135 @@ public:
             .qkey = static_cast<u64>(my_config.qkey)};
   }
 
+  void bind_local_mr(const RegAttr &mr) { local_mr = Option<RegAttr>(mr); }
+
   /*!
-    create address handler from a QP attribute
+    query the address handler of a QP attribute;
+    the address handler is created at the first time, and cached afterwards.
+    \note: the returned address handler is owned by this UD
    */
   ibv_ah *create_ah(const QPAttr &attr) {
+    auto key = std::make_tuple(attr.lid, attr.addr.subnet_prefix,
+                               attr.addr.interface_id);
+    auto it = ah_cache.find(key);
+    if (likely(it != ah_cache.end()))
+      return it->second;
+
+    auto ah = create_raw_ah(attr);
+    if (ah != nullptr)
+      ah_cache.insert(std::make_pair(key, ah));
+    return ah;
+  }
+
+  usize cached_ahs() const { return ah_cache.size(); }
+
+  /*!
+    Send a message to the remote UD QP.
+    The message must be stored in the local MR binded to this UD.
+
+    Similar to the RC's selective signaling, UD signals one out of every
+    max_send_sz() / 2 requests, and reclaims the send queue before posting the
+    next signaled one. User can force a signal by passing IBV_SEND_SIGNALED in
+    the flags.
+   */
+  Result<std::string> send_to(const QPAttr &dest, const void *buf,
+                              const u32 &len, const u32 &imm = 0,
+                              const int &flags = 0) {
+    UDReq req = {.dest = &dest, .buf = buf, .len = len, .imm = imm};
+    return send_batch(&req, 1, flags);
+  }
+
+  /*!
+    Send at most kNMaxDoorbell messages with one ibv_post_send.
+    \note: the flags only apply to the last request
+   */
+  Result<std::string> send_batch(const UDReq *reqs, const usize &num,
+                                 const int &flags = 0) {
+    if (unlikely(num == 0 || num > kNMaxDoorbell))
+      return Err(std::string("wrong batch size"));
+
+    const auto lkey = local_mr.value().lkey;
+    for (uint i = 0; i < num; ++i) {
+      auto ah = create_ah(*(reqs[i].dest));
+      if (unlikely(ah == nullptr)) {
+        if (!doorbell.empty())
+          doorbell.clear();
+        return Err(std::string("failed to create the address handler"));
+      }
+
+      doorbell.next();
+      auto &wr = doorbell.cur_wr();
+      wr.opcode = IBV_WR_SEND_WITH_IMM;
+      wr.imm_data = reqs[i].imm;
+      wr.send_flags = 0;
+      wr.wr_id = 0;
+      wr.wr.ud.ah = ah;
+      wr.wr.ud.remote_qpn = reqs[i].dest->qpn;
+      wr.wr.ud.remote_qkey = reqs[i].dest->qkey;
+
+      doorbell.cur_sge() = {.addr = reinterpret_cast<u64>(reqs[i].buf),
+                            .length = reqs[i].len,
+                            .lkey = lkey};
+    }
+
+    auto res_f = prepare_signal(flags, num);
+    if (unlikely(res_f != IOCode::Ok)) {
+      doorbell.clear();
+      return Err(std::string("failed to reclaim the send queue"));
+    }
+    for (uint i = 0; i < num; ++i) {
+      auto &wr = doorbell.wrs[i];
+      wr.send_flags = inline_flags(wr, i == num - 1 ? res_f.desc : 0);
+    }
+    if (res_f.desc & IBV_SEND_SIGNALED)
+      out_signaled += 1;
+
+    doorbell.freeze();
+    struct ibv_send_wr *bad_sr;
+    auto rc = ibv_post_send(qp, doorbell.first_wr_ptr(), &bad_sr);
+    doorbell.clear();
+
+    if (0 == rc)
+      return Ok(std::string(""));
+    return Err(std::string(strerror(errno)));
+  }
+
+  ~UD() {
+    for (auto &ah : ah_cache) {
+      auto rc = ibv_destroy_ah(ah.second);
+      RDMA_VERIFY(WARNING, rc == 0) << "Failed to destroy ah "
+                                    << strerror(errno);
+    }
+  }
+
+private:
+  /*!
+    decide whether the last of *num* requests to post is signaled.
+    Before posting a signaled request, we wait for the previous one, so at most
+    max_send_sz() / 2 + num requests are in-flight.
+   */
+  Result<int> prepare_signal(const int &flags, const usize &num) {
+    RDMA_ASSERT(num <= static_cast<usize>(my_config.max_send_sz() / 2));
+
+    pending_reqs += num;
+    if (!(flags & IBV_SEND_SIGNALED) &&
+        pending_reqs < static_cast<usize>(
+                           std::max(my_config.max_send_sz() / 2, 1)))
+      return Ok(flags);
+
+    while (out_signaled > 0) {
+      auto res = wait_one_comp();
+      if (unlikely(res != IOCode::Ok))
+        return Err(flags);
+    }
+    pending_reqs = 0;
+    return Ok(flags | IBV_SEND_SIGNALED);
+  }
+
+  /*!
+    create address handler from a QP attribute
+   */
+  ibv_ah *create_raw_ah(const QPAttr &attr) {
     struct ibv_ah_attr ah_attr = {};
 #if 1
     ah_attr.is_global = 1;
@@ -82,11 +249,13 @@ public:
     return ibv_create_ah(nic->get_pd(), &ah_attr);
   }
 
-private:
-  UD(Arc<RNic> nic, const QPConfig &config) : Dummy(nic), my_config(config) {
+  UD(Arc<RNic> nic, const QPConfig &config, Arc<CompChannel> channel)
+      : Dummy(nic), my_config(config), doorbell(IBV_WR_SEND_WITH_IMM) {
+    this->comp_channel = channel;
+    auto ch = channel ? channel->get() : nullptr;
 
     // create qp, cq, recv_cq
-    auto res = Impl::create_cq(nic, my_config.max_send_sz());
+    auto res = Impl::create_cq(nic, my_config.max_send_sz(), nullptr, ch);
 
     if (res != IOCode::Ok) {
       RDMA_LOG(4) << "Error on creating CQ: " << std::get<1>(res.desc);
@@ -94,7 +263,8 @@ private:
     }
     this->cq = std::get<0>(res.desc);
 
-    auto res_recv = Impl::create_cq(nic, my_config.max_recv_sz());
+    auto res_recv =
+        Impl::create_cq(nic, my_config.max_recv_sz(), nullptr, ch);
     if (res_recv != IOCode::Ok) {
       RDMA_LOG(4) << "Error on creating recv CQ: " << std::get<1>(res_recv.desc);
       return;
@@ -109,6 +279,7 @@ private:
       return;
     }
     this->qp = std::get<0>(res_qp.desc);
+    this->init_inline();
 
     // finally, change it to ready_to_recv & ready_to_send
     if (valid()) {
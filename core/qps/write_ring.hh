@@ -0,0 +1,320 @@
+#pragma once
+
+#include <utility>
+
+#include "./op.hh"
+
+namespace rdmaio {
+
+namespace qp {
+
+const u32 kWriteRingWrapBit = 1u << 31;
+const u64 kWriteRingAlign = 8;
+
+inline u64 write_ring_align(const u64 &sz) {
+  return (sz + kWriteRingAlign - 1) & ~(kWriteRingAlign - 1);
+}
+
+/*!
+  The credits returned by the receiver, written to the sender's credit slot
+ */
+struct WriteRingCredit {
+  // #bytes consumed
+  u64 bytes = 0;
+  // #recv entries reposted (besides the ones posted at the start)
+  u64 msgs = 0;
+};
+
+/*!
+  WriteRing is a message channel built on RDMA_WRITE_WITH_IMM.
+  The receiver exports a registered ring buffer (e.g., using
+  RCtrl::registered_mrs), and the sender writes variable-length messages
+  directly into it. So small messages are densely packed, and large messages
+  are only bounded by the ring size.
+
+  - The imm of each write carries the message length. The offset is implicit:
+    since RC writes are delivered in order, both sides advance the same
+    tail/head. If a message cannot fit in the remaining space at the end of
+    the ring, it is written at the ring's start, with kWrapBit set in the imm.
+  - Each write also consumes a recv entry of the receiver, so the sender is
+    bounded by both the free space of the ring, and the recv entries.
+    The receiver returns both (WriteRingCredit) to the sender's credit slot,
+    once every *credit_batch* bytes consumed, once it reposts the recv
+    entries, or once no message arrives, so a waiting sender is not blocked.
+  - A message up to half of the ring always fits once the ring drains.
+    A larger one may not fit at the current tail even if the ring is empty,
+    and fails.
+
+  Both sides rely on the RC's selective signaling to reclaim the send queue,
+  which is enabled at creation if not yet.
+  So the QPs should not be multiplexed by a CQMux.
+
+  Example:
+  `
+  // receiver, the RC must be created with a recv_cq
+  ctrl.registered_mrs.reg(73, ring_handler);
+  auto receiver = WriteRingReceiver<>::create(recv_qp, ring_ptr, ring_sz,
+                                              sender_credit_mr, credit_off)
+                      .value();
+  for (auto msg = receiver->next_msg(); msg; msg = receiver->next_msg()) {
+    // msg.value() is (ptr, len), valid until the next call of next_msg()
+  }
+
+  // sender
+  auto ring_mr = cm.fetch_remote_mr(73); // the receiver's ring
+  auto sender =
+      WriteRingSender::create(send_qp, ring_attr, ring_sz, credit_ptr)
+          .value();
+  auto res = sender->send(buf, len); // NotReady if the ring is full
+  `
+ */
+class WriteRingSender {
+  Arc<RC> qp;
+  const RegAttr remote_ring;
+  const u64 ring_sz;
+  // #recv entries posted by the receiver at its start
+  const u64 recv_entries;
+
+  // written back by the receiver
+  volatile WriteRingCredit *credit;
+
+  // #bytes sent, including the space skipped due to wrapping
+  u64 tail = 0;
+  // #messages sent, each consumes a recv entry of the receiver
+  u64 sent_msgs = 0;
+
+  WriteRingSender(const Arc<RC> &qp, const RegAttr &remote_ring,
+                  const u64 &ring_sz, WriteRingCredit *credit,
+                  const u64 &recv_entries)
+      : qp(qp), remote_ring(remote_ring), ring_sz(ring_sz),
+        recv_entries(recv_entries), credit(credit) {
+    credit->bytes = 0;
+    credit->msgs = 0;
+  }
+
+public:
+  /*!
+    \param remote_ring: the registered ring at the receiver, starts at its buf
+    \param credit: the local (registered) slot receiving the credits
+    \param recv_entries: the R of the WriteRingReceiver
+    \ret {} if the ring is malformed, or the QP is multiplexed
+   */
+  static Option<Arc<WriteRingSender>>
+  create(const Arc<RC> &qp, const RegAttr &remote_ring, const u64 &ring_sz,
+         WriteRingCredit *credit, const u64 &recv_entries = 128) {
+    if (ring_sz > remote_ring.sz || ring_sz % kWriteRingAlign != 0 ||
+        ring_sz == 0 || recv_entries == 0)
+      return {};
+    if (!qp->selective_signaled() &&
+        !qp->enable_selective_signal(qp->max_send_sz() / 2))
+      return {};
+    return Arc<WriteRingSender>(
+        new WriteRingSender(qp, remote_ring, ring_sz, credit, recv_entries));
+  }
+
+  u64 free_space() const { return ring_sz - (tail - credit->bytes); }
+
+  /*!
+    \ret #of messages which can be sent before the receiver reposts
+   */
+  u64 free_msgs() const { return recv_entries + credit->msgs - sent_msgs; }
+
+  /*!
+    Write a message to the ring. The msg should be in the local MR binded to
+    the QP, unless it is small enough to be inlined.
+    \ret
+    - Ok: the message is posted
+    - NotReady: no enough free space (or recv entries) at the receiver,
+      retry after the receiver returns the credits
+    - Err: the message is too large (or cannot fit at the current tail even
+      if the ring drains), or the post failed
+   */
+  Result<std::string> send(const void *msg, const u32 &len) {
+    const u64 sz = write_ring_align(len);
+    if (unlikely(sz > ring_sz || (len & kWriteRingWrapBit)))
+      return ::rdmaio::Err(std::string("message too large"));
+
+    u64 off = tail % ring_sz;
+    const u64 skip = (off + sz > ring_sz) ? (ring_sz - off) : 0;
+    if (unlikely(skip + sz > ring_sz))
+      return ::rdmaio::Err(std::string("message cannot fit at the tail"));
+    if (skip + sz > free_space() || free_msgs() == 0)
+      return ::rdmaio::NotReady(std::string(""));
+    if (skip != 0)
+      off = 0;
+
+    Op<> op;
+    op.set_op(IBV_WR_RDMA_WRITE_WITH_IMM)
+        .set_rdma_addr(off, remote_ring)
+        .set_imm(len | (skip != 0 ? kWriteRingWrapBit : 0));
+    const auto lkey = qp->local_mr ? qp->local_mr.value().lkey : 0;
+    op.set_payload(msg, len, lkey);
+
+    auto res = op.execute(qp);
+    if (res == IOCode::Ok) {
+      tail += skip + sz;
+      sent_msgs += 1;
+    }
+    return res;
+  }
+};
+
+/*!
+  R: #of recv entries posted to the QP, each consumed by one message
+ */
+template <usize R = 128> class WriteRingReceiver {
+  static_assert(R > 1, "too few recv entries");
+
+  Arc<RC> qp;
+  char *ring;
+  const u64 ring_sz;
+
+  // the sender's credit slot
+  const RegAttr remote_credit;
+  const u64 credit_off;
+  const u64 credit_batch;
+
+  // the consumed bytes and reposted recv entries so far,
+  // and the last ones returned to the sender
+  WriteRingCredit cur;
+  WriteRingCredit returned;
+  // size of the message returned by the last next_msg()
+  u64 cur_sz = 0;
+
+  // WRITE_WITH_IMM consumes a recv entry without sges
+  ibv_recv_wr rs[R];
+  usize consumed_recvs = 0;
+
+  // a recv completion with an error status is polled
+  bool err = false;
+
+  WriteRingReceiver(const Arc<RC> &qp, void *ring, const u64 &ring_sz,
+                    const RegAttr &remote_credit, const u64 &credit_off,
+                    const u64 &credit_batch)
+      : qp(qp), ring(static_cast<char *>(ring)), ring_sz(ring_sz),
+        remote_credit(remote_credit), credit_off(credit_off),
+        credit_batch(credit_batch == 0 ? ring_sz / 4 : credit_batch) {
+    for (uint i = 0; i < R; ++i) {
+      rs[i].wr_id = i;
+      rs[i].sg_list = nullptr;
+      rs[i].num_sge = 0;
+      rs[i].next = (i < R - 1) ? (&rs[i + 1]) : nullptr;
+    }
+  }
+
+public:
+  /*!
+    \param qp: should be created with a recv_cq
+    \param ring: the local registered ring, written by the sender
+    \param remote_credit, credit_off: the sender's credit slot
+    \param credit_batch: #bytes consumed before returning credits to sender,
+    default to a quarter of the ring
+    \ret {} if the arguments are malformed, the QP is multiplexed,
+    or the recv entries cannot be posted
+   */
+  static Option<Arc<WriteRingReceiver>>
+  create(const Arc<RC> &qp, void *ring, const u64 &ring_sz,
+         const RegAttr &remote_credit, const u64 &credit_off,
+         const u64 &credit_batch = 0) {
+    if (qp->recv_cq == nullptr || ring_sz % kWriteRingAlign != 0 ||
+        ring_sz == 0)
+      return {};
+    if (!qp->selective_signaled() &&
+        !qp->enable_selective_signal(qp->max_send_sz() / 2))
+      return {};
+
+    auto res = Arc<WriteRingReceiver>(new WriteRingReceiver(
+        qp, ring, ring_sz, remote_credit, credit_off, credit_batch));
+    struct ibv_recv_wr *bad_rr;
+    if (ibv_post_recv(qp->qp, &res->rs[0], &bad_rr) != 0) {
+      RDMA_LOG(4) << "failed to post recvs: " << strerror(errno);
+      return {};
+    }
+    return res;
+  }
+
+  /*!
+    Fetch the next message.
+    \note: the message returned by the previous call is consumed,
+    i.e., its buffer may be overwritten by the sender.
+    \ret (ptr, len) of the message, or {} if no message arrives,
+    or the QP fails (see failed())
+   */
+  Option<std::pair<char *, u32>> next_msg() {
+    consume_cur();
+
+    ibv_wc wc;
+    if (ibv_poll_cq(qp->recv_cq, 1, &wc) <= 0) {
+      // idle, so retry a failed repost, and return all the credits
+      if (consumed_recvs >= R / 2)
+        repost_recvs();
+      if (cur.bytes != returned.bytes || cur.msgs != returned.msgs)
+        return_credits();
+      return {};
+    }
+
+    consumed_recvs += 1;
+    if (unlikely(wc.status != IBV_WC_SUCCESS)) {
+      // e.g., flushed since the QP is in the error state
+      RDMA_LOG(4) << "WriteRing recv error: " << RC::wc_status(wc);
+      err = true;
+      return {};
+    }
+    if (consumed_recvs >= R / 2)
+      repost_recvs();
+
+    const u32 imm = wc.imm_data;
+    if (imm & kWriteRingWrapBit)
+      cur.bytes += ring_sz - (cur.bytes % ring_sz);
+
+    const u32 len = imm & (~kWriteRingWrapBit);
+    cur_sz = write_ring_align(len);
+    return std::make_pair(ring + (cur.bytes % ring_sz), len);
+  }
+
+  u64 consumed_bytes() const { return cur.bytes + cur_sz; }
+
+  bool failed() const { return err; }
+
+private:
+  void consume_cur() {
+    cur.bytes += std::exchange(cur_sz, 0);
+    if (cur.bytes - returned.bytes >= credit_batch)
+      return_credits();
+  }
+
+  void return_credits() {
+    Op<> op;
+    op.set_write().set_rdma_addr(credit_off, remote_credit);
+    op.set_payload(&cur, sizeof(WriteRingCredit), 0);
+
+    // the credit is inlined, so it can be updated after the post.
+    // if the post fails, returned is kept, so the next call retries
+    auto res = op.execute(qp, IBV_SEND_INLINE);
+    if (res == IOCode::Ok)
+      returned = cur;
+    else
+      RDMA_LOG(4) << "failed to return the credits: " << res.desc;
+  }
+
+  /*!
+    Repost the consumed recv entries, and return them to the sender.
+    If the post fails, they are kept consumed, so the next call retries.
+   */
+  void repost_recvs() {
+    auto temp = std::exchange(rs[consumed_recvs - 1].next, nullptr);
+    struct ibv_recv_wr *bad_rr;
+    auto rc = ibv_post_recv(qp->qp, &rs[0], &bad_rr);
+    rs[consumed_recvs - 1].next = temp;
+    if (unlikely(rc != 0)) {
+      RDMA_LOG(4) << "failed to post recvs: " << strerror(errno);
+      return;
+    }
+    cur.msgs += std::exchange(consumed_recvs, 0);
+    return_credits();
+  }
+};
+
+} // namespace qp
+
+} // namespace rdmaio
@@ -45,6 +45,10 @@ public:
         proto::CreateRC,
         std::bind(&RCtrl::rc_handler, this, std::placeholders::_1)));
 
+    RDMA_ASSERT(rpc.register_handler(
+        proto::CreateRCBatch,
+        std::bind(&RCtrl::rc_batch_handler, this, std::placeholders::_1)));
+
     RDMA_ASSERT(rpc.register_handler(
         proto::DeleteRC,
         std::bind(&RCtrl::delete_rc, this, std::placeholders::_1)));
@@ -56,6 +60,11 @@ public:
     RDMA_ASSERT(rpc.register_handler(
         proto::FetchDCAttr,
         std::bind(&RCtrl::fetch_dc_attr_wrapper, this, std::placeholders::_1)));
+
+    // the queries are cheap, so they are not queued after the QP creations
+    rpc.add_fast_path(proto::FetchMr);
+    rpc.add_fast_path(proto::FetchQPAttr);
+    rpc.add_fast_path(proto::FetchDCAttr);
   }
 
   ~RCtrl() {
@@ -63,9 +72,17 @@ public:
   }
 
   /*!
-    Start the daemon thread for handling RDMA connection requests
+    Start the daemon thread for handling RDMA connection requests.
+    \param num_workers: if not 0, the requests creating (or deleting) QPs are
+    handled by a pool of worker threads, so a connection storm is handled in
+    parallel, and does not delay the heartbeats and queries, which are still
+    handled by the daemon thread.
+    \note: with workers, the handlers registered at rpc run concurrently,
+    so they must be thread-safe, or registered as serialized
+    (e.g., RecvManager's, which allocates from a non-thread-safe allocator).
    */
-  bool start_daemon() {
+  bool start_daemon(const usize &num_workers = 0) {
+    rpc.start_workers(num_workers);
     running = true;
     asm volatile("" ::: "memory");
 
@@ -84,6 +101,7 @@ public:
       asm volatile("" ::: "memory");
       pthread_join(handler_tid, nullptr);
     }
+    rpc.stop_workers();
   }
 
   static void *daemon(void *ctx) {
@@ -99,7 +117,7 @@ public:
 
   // handlers of the dameon call
 private:
-  ByteBuffer fetch_mr_handler(const ByteBuffer &b) {
+  ByteBuffer fetch_mr_handler(const ByteView &b) {
     auto o_id = ::rdmaio::Marshal::dedump<proto::MRReq>(b);
     if (o_id) {
       auto req_id = o_id.value();
@@ -118,7 +136,7 @@ private:
         {.status = proto::CallbackStatus::WrongArg});
   }
 
-  ByteBuffer delete_rc(const ByteBuffer &b) {
+  ByteBuffer delete_rc(const ByteView &b) {
     auto rc_req_o = ::rdmaio::Marshal::dedump<proto::DelRCReq>(b);
     if (!rc_req_o)
       goto WA;
@@ -139,7 +157,7 @@ private:
         {.status = proto::CallbackStatus::WrongArg});
   }
 
-  ByteBuffer fetch_qp_attr_wrapper(const ByteBuffer &b) {
+  ByteBuffer fetch_qp_attr_wrapper(const ByteView &b) {
     auto req_o = ::rdmaio::Marshal::dedump<proto::QPReq>(b);
     if (!req_o)
       return ::rdmaio::Marshal::dump<proto::RCReply>(
@@ -149,7 +167,7 @@ private:
     return fetch_qp_attr(req, 0);
   }
 
-  ByteBuffer fetch_dc_attr_wrapper(const ByteBuffer &b) {
+  ByteBuffer fetch_dc_attr_wrapper(const ByteView &b) {
     auto req_o = ::rdmaio::Marshal::dedump<proto::QPReq>(b);
     if (!req_o)
       return ::rdmaio::Marshal::dump<proto::DCReply>(
@@ -189,6 +207,69 @@ public:
   }
 
 private:
+  /*!
+    Create an RC QP, register it with *name*, and connect it to *attr*
+    \ret: the RCReply carrying the created QP's attr and key
+   */
+  proto::RCReply create_rc(const std::string &name, const nic_id_t &nic_id,
+                           const qp::QPConfig &config,
+                           const qp::QPAttr &attr) {
+    // 1. find the Nic to create this QP
+    auto nic = opened_nics.query(nic_id);
+    if (!nic)
+      return {.status = proto::CallbackStatus::WrongArg};
+
+    // 2. try to create and register this QP
+    auto rc_o = qp::RC::create(nic.value(), config);
+    if (!rc_o)
+      return {.status = proto::CallbackStatus::ConnectErr};
+    auto rc = rc_o.value();
+
+    auto rc_status = registered_qps.reg(name, rc);
+    if (!rc_status)
+      return {.status = proto::CallbackStatus::WrongArg};
+
+    // 3. finally we connect the QP
+    if (rc->connect(attr) != IOCode::Ok) {
+      registered_qps.dereg(name, rc_status.value());
+      return {.status = proto::CallbackStatus::ConnectErr};
+    }
+    return {.status = proto::CallbackStatus::Ok,
+            .attr = rc->my_attr(),
+            .key = rc_status.value()};
+  }
+
+  /*!
+    Handling a batch of RC requests, see proto::RCBatchReq.
+    Each QP is created independently, so the failure of one QP is reported
+    in its RCReply, and does not affect the others.
+   */
+  ByteBuffer rc_batch_handler(const ByteView &b) {
+    auto req_o = ::rdmaio::Marshal::dedump<proto::RCBatchReq>(b);
+    if (!req_o || b.size() != sizeof(proto::RCBatchReq) +
+                                  req_o.value().num *
+                                      sizeof(proto::RCBatchEntry))
+      return ::rdmaio::Marshal::dump<proto::RCBatchReply>(
+          {.status = proto::CallbackStatus::WrongArg});
+
+    auto req = req_o.value();
+    auto reply = ::rdmaio::Marshal::dump<proto::RCBatchReply>(
+        {.status = proto::CallbackStatus::Ok, .num = req.num});
+    reply.reserve(reply.size() + req.num * sizeof(proto::RCReply));
+
+    for (uint i = 0; i < req.num; ++i) {
+      auto entry = ::rdmaio::Marshal::dedump<proto::RCBatchEntry>(
+                       b.sub(sizeof(proto::RCBatchReq) +
+                                 i * sizeof(proto::RCBatchEntry),
+                             sizeof(proto::RCBatchEntry)))
+                       .value();
+      entry.name[::rdmaio::qp::kMaxQPNameLen] = '\0';
+      reply.append(::rdmaio::Marshal::dump<proto::RCReply>(
+          create_rc(entry.name, req.nic_id, req.config, entry.attr)));
+    }
+    return reply;
+  }
+
   /*!
     Handling the RC request
     The process has two steps:
@@ -196,7 +277,7 @@ private:
     2. if so, create it using the provided parameters
     3. query the RC attribute and returns to the user
    */
-  ByteBuffer rc_handler(const ByteBuffer &b) {
+  ByteBuffer rc_handler(const ByteView &b) {
 
     auto rc_req_o = ::rdmaio::Marshal::dedump<proto::RCReq>(b);
     if (!rc_req_o)
@@ -212,35 +293,11 @@ private:
       // 1. check whether we need to create the QP
       u64 key = 0;
       if (rc_req.whether_create == 1) {
-        // 1.0 find the Nic to create this QP
-        auto nic = opened_nics.query(rc_req.nic_id);
-        if (!nic)
-          goto WA; // failed to find Nic
-
-        // 1.0 check whether we are able to use the registered recv_cq
-        ibv_cq *recv_cq = nullptr;
-#if 0 // we move this to a separte class
-        if (rc_req.whether_recv == 1) {
-          recv_cq = rc_recv_cqs.query_or_default(rc_req.name_recv,nullptr).get();
-        }
-#endif
-
-        // 1.1 try to create and register this QP
-        auto rc = qp::RC::create(nic.value(), rc_req.config, recv_cq).value();
-        auto rc_status = registered_qps.reg(rc_req.name, rc);
-
-        if (!rc_status) {
-          // clean up
-          goto WA;
-        }
-
-        // 1.2 finally we connect the QP
-        if (rc->connect(rc_req.attr) != IOCode::Ok) {
-          // in connect error
-          registered_qps.dereg(rc_req.name, rc_status.value());
+        auto reply = create_rc(rc_req.name, rc_req.nic_id, rc_req.config,
+                               rc_req.attr);
+        if (reply.status != proto::CallbackStatus::Ok)
           goto WA;
-        }
-        key = rc_status.value();
+        key = reply.key;
       }
 
       // 2. fetch the QP result
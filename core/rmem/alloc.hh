@@ -0,0 +1,200 @@
+#pragma once
+
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "../nic.hh"
+#include "./mem.hh"
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+// the memory policies of mbind(2), defined here so libnuma is not required
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+
+namespace rdmaio {
+
+namespace rmem {
+
+const u64 kPage4K = 4096;
+const u64 kPage2M = 2 * 1024 * 1024;
+const u64 kPage1G = 1024 * 1024 * 1024;
+
+/*!
+  How RMemAlloc allocates the memory of an RMem
+ */
+struct AllocPolicy {
+  // the largest page to back the memory: kPage4K, kPage2M or kPage1G
+  u64 page_sz = kPage2M;
+
+  // if the hugepages are not available (e.g., not reserved),
+  // try the smaller pages (and finally transparent hugepages),
+  // otherwise the allocation fails
+  bool fallback = true;
+
+  // the NUMA node to place the memory, -1 for no binding
+  int numa_node = -1;
+  // strict: the memory must be on numa_node (MPOL_BIND),
+  // otherwise numa_node is only preferred (MPOL_PREFERRED).
+  // the hugepages are only used if the node has enough free ones
+  bool strict_numa = false;
+
+  // touch all the pages at allocation,
+  // so the first accesses (e.g., by the NIC) do not fault
+  bool prefault = true;
+
+  /*!
+    A policy which places the memory on the NUMA node of the nic
+   */
+  static AllocPolicy near(const Arc<RNic> &nic, const u64 &page_sz = kPage2M) {
+    AllocPolicy p;
+    p.page_sz = page_sz;
+    auto node = nic->numa_node();
+    if (node)
+      p.numa_node = node.value();
+    return p;
+  }
+};
+
+/*!
+  Allocate RMem with mmap according to an AllocPolicy.
+  Large regions backed by hugepages use much fewer NIC translation entries
+  (MTT), so random accesses to them do not thrash the NIC's cache.
+
+  Example:
+  `
+  auto nic = RNic::create(...).value();
+  auto mem = RMemAlloc::create(64 * 1024 * 1024, AllocPolicy::near(nic))
+                 .value();
+  // mem->page_sz is the page actually used
+  auto handler = RegHandler::create(mem, nic).value();
+  `
+ */
+class RMemAlloc {
+  // shared by the alloc and dealloc functions of an RMem
+  struct Mapping {
+    u64 len = 0;
+    u64 page_sz = 0;
+  };
+
+public:
+  static Option<Arc<RMem>> create(const u64 &sz,
+                                  const AllocPolicy &policy = AllocPolicy()) {
+    auto m = std::make_shared<Mapping>();
+    auto mem = Arc<RMem>(new RMem(
+        sz,
+        [m, policy](u64 s) -> RMem::raw_ptr_t { return map(s, policy, *m); },
+        [m](RMem::raw_ptr_t p) {
+          if (p != nullptr)
+            munmap(p, m->len);
+        }));
+    if (!mem->valid())
+      return {};
+    mem->page_sz = m->page_sz;
+    return mem;
+  }
+
+private:
+  static u64 round_up(const u64 &sz, const u64 &page) {
+    return (std::max(sz, static_cast<u64>(1)) + page - 1) / page * page;
+  }
+
+  static RMem::raw_ptr_t map(const u64 &sz, const AllocPolicy &policy,
+                             Mapping &m) {
+    for (u64 page : {kPage1G, kPage2M, kPage4K}) {
+      if (page > policy.page_sz)
+        continue;
+      if (page != policy.page_sz && !policy.fallback)
+        break;
+
+      const u64 len = round_up(sz, page);
+      // the hugepages are reserved from the global pool at mmap, not from
+      // the node, so a strictly bound fault on a node without free ones
+      // would SIGBUS
+      if (page != kPage4K && policy.strict_numa && policy.numa_node >= 0 &&
+          free_hugepages(policy.numa_node, page) * page < len) {
+        RDMA_LOG(2) << "no enough free hugepages of " << page << " on node "
+                    << policy.numa_node;
+        continue;
+      }
+
+      int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+      if (page != kPage4K)
+        flags |= MAP_HUGETLB | (__builtin_ctzll(page) << MAP_HUGE_SHIFT);
+      auto p = mmap(nullptr, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+      if (p == MAP_FAILED) {
+        RDMA_LOG(2) << "failed to map " << len << " bytes with page " << page
+                    << ": " << strerror(errno);
+        continue;
+      }
+      if (page == kPage4K && policy.page_sz != kPage4K)
+        madvise(p, len, MADV_HUGEPAGE); // the last resort
+
+      // bind before the pages are touched, so they are placed on the node
+      if (policy.numa_node >= 0 && !bind(p, len, policy)) {
+        munmap(p, len);
+        return nullptr;
+      }
+      if (policy.prefault)
+        prefault(p, len, page);
+
+      m.len = len;
+      m.page_sz = page;
+      return p;
+    }
+    return nullptr;
+  }
+
+  /*!
+    \ret: false if the memory cannot be bound to a strict numa_node
+   */
+  static bool bind(void *p, const u64 &len, const AllocPolicy &policy) {
+    const usize kBitsPerLong = sizeof(unsigned long) * 8;
+    unsigned long mask[16] = {};
+    if (static_cast<usize>(policy.numa_node) >= 16 * kBitsPerLong)
+      return !policy.strict_numa;
+    mask[policy.numa_node / kBitsPerLong] |=
+        1UL << (policy.numa_node % kBitsPerLong);
+
+    auto rc = syscall(SYS_mbind, p, len,
+                      policy.strict_numa ? MPOL_BIND : MPOL_PREFERRED, mask,
+                      16 * kBitsPerLong, 0);
+    if (rc != 0) {
+      RDMA_LOG(2) << "failed to bind memory to node " << policy.numa_node
+                  << ": " << strerror(errno);
+      return !policy.strict_numa;
+    }
+    return true;
+  }
+
+  /*!
+    \ret: #of free hugepages of the size on the NUMA node, 0 if unknown
+   */
+  static u64 free_hugepages(const int &node, const u64 &page) {
+    std::ifstream f("/sys/devices/system/node/node" + std::to_string(node) +
+                    "/hugepages/hugepages-" + std::to_string(page / 1024) +
+                    "kB/free_hugepages");
+    u64 num = 0;
+    if (!(f >> num))
+      return 0;
+    return num;
+  }
+
+  static void prefault(void *p, const u64 &len, const u64 &page) {
+    auto base = static_cast<volatile char *>(p);
+    for (u64 off = 0; off < len; off += page)
+      base[off] = 0;
+  }
+};
+
+} // namespace rmem
+
+} // namespace rdmaio
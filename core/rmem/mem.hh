@@ -34,6 +34,10 @@ struct RMem : public std::enable_shared_from_this<RMem>  { // state for "R"egist
   raw_ptr_t raw_ptr;
   const u64 sz;
 
+  // the page backing the memory, 0 if unknown (e.g., from malloc).
+  // see ./alloc.hh for allocating the memory on hugepages
+  u64 page_sz = 0;
+
   dealloc_fn_t dealloc_fn;
 
   explicit RMem(const u64 &s,
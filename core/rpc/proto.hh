@@ -0,0 +1,93 @@
+#pragma once
+
+#include "../bootstrap/proto.hh"
+
+#include "../qps/abs_recv_allocator.hh"
+
+namespace rdmaio {
+
+namespace rpc {
+
+using rpc_id_t = proto::rpc_id_t;
+
+// the index of a remote endpoint at the transport
+using peer_id_t = u32;
+
+enum MsgType : u8 {
+  Req = 0,
+  Reply,
+};
+
+enum class ReplyStatus : u8 {
+  Ok = 0,
+  NoHandler, // the server has not registered the rpc id
+  Timeout,   // no reply before the deadline of the call (at the client)
+};
+
+/*!
+  Each message starts with a header, followed by the payload.
+  The req_id is assigned by the caller, and echoed in the reply.
+ */
+struct __attribute__((packed)) Header {
+  u8 type;
+  u8 status;
+  rpc_id_t id;
+  u8 reserved = 0;
+  u32 len; // payload length
+  u64 req_id;
+};
+
+/*!
+  A request (at the server), or a reply (at the client).
+  The payload points to the recv buffer, which is only valid in the
+  handler (or reply callback), since it is reposted afterwards.
+ */
+struct MsgView {
+  peer_id_t peer;
+  ReplyStatus status;
+  const char *payload;
+  u32 len;
+};
+
+/*!
+  A ring of registered send buffers.
+  A buffer is reused after *num* following messages, so *num* should exceed
+  the #of in-flight sends of the QP (see SendBufs::create).
+ */
+class SendBufs {
+  char *base = nullptr;
+  usize cur = 0;
+
+public:
+  const usize entry_sz;
+  const usize num;
+  const rmem::mr_key_t lkey;
+
+  static Option<SendBufs> create(Arc<qp::AbsRecvAllocator> &alloc,
+                                 const usize &entry_sz, const usize &num) {
+    auto buf = alloc->alloc_one(entry_sz * num);
+    if (!buf)
+      return {};
+    return SendBufs(static_cast<char *>(std::get<0>(buf.value())), entry_sz,
+                    num, std::get<1>(buf.value()));
+  }
+
+  char *next() {
+    auto ret = base + (cur % num) * entry_sz;
+    cur += 1;
+    return ret;
+  }
+
+  u64 total_sz() const { return entry_sz * num; }
+
+  char *start() const { return base; }
+
+private:
+  SendBufs(char *base, const usize &entry_sz, const usize &num,
+           const rmem::mr_key_t &lkey)
+      : base(base), entry_sz(entry_sz), num(num), lkey(lkey) {}
+};
+
+} // namespace rpc
+
+} // namespace rdmaio
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "./proto.hh"
+
+#include "../qps/doorbell_batch.hh"
+#include "../qps/recv_iter.hh"
+
+namespace rdmaio {
+
+namespace rpc {
+
+using namespace qp;
+
+/*!
+  The RPC transport over RC SEND/RECV, one RC QP per peer.
+  All the QPs share one recv_cq, so a single poll serves all the peers;
+  a message is matched to its peer by the qp_num of the completion.
+
+  The server side QPs are typically created by RecvManager
+  (../qps/rc_recv_manager.hh), which also allocates and posts their
+  RecvEntries<R>; then add them with add_peer(qp, entries).
+  At the client, add_peer(qp) allocates and posts the recv entries.
+
+  The sends of each peer are doorbell batched (see DoorbellBatch),
+  and posted when the batch is full or upon flush().
+
+  Flow control: a message is only posted if the peer has a free recv entry
+  for it, so the sender never triggers RNR NAKs (and the retry backoff).
+  - Each data message consumes a credit. The peer is assumed to post R recv
+    entries, so R - kCreditReserve credits are available initially.
+  - The receiver returns the credits as it reposts the recv entries,
+    piggybacked in the imm of its messages to the sender.
+    If it has no message to send, a zero-length credit-only message is sent
+    once R / 4 credits are pending; these consume the kCreditReserve
+    reserved entries, which are not credited.
+  - Without credits, the messages are queued locally, and posted
+    once the credits come back.
+
+  Example:
+  `
+  // server
+  auto qp = ctrl.registered_qps.query("client-qp").value();
+  auto entries = manager.reg_recv_entries.query("client-qp").value();
+  auto t = RCTransport<>::create(recv_cq, alloc).value();
+  t->add_peer(qp, entries);
+  `
+ */
+template <usize R = 128> class RCTransport {
+  static_assert(R >= 16, "too few recv entries for the credits");
+
+public:
+  // the recv entries reserved for the credit-only messages
+  static constexpr const u32 kCreditReserve = 4;
+
+  // set in the imm of a credit-only message
+  static constexpr const u32 kCreditOnlyBit = 1u << 31;
+
+private:
+  struct Peer {
+    Arc<RC> qp;
+    Arc<RecvEntries<R>> entries;
+    SendBufs bufs;
+    DoorbellBatch<> batch;
+
+    // #of recv entries consumed but not reposted,
+    // and the ones consumed by data, which should be credited
+    usize consumed = 0;
+    usize consumed_data = 0;
+
+    // #of messages we may send to the peer
+    u32 credits = R - kCreditReserve;
+    // #of reposted recv entries not yet credited to the peer
+    u32 credits_to_return = 0;
+
+    // messages waiting for the credits
+    std::deque<std::pair<const char *, u32>> backlog;
+
+    bool dirty = false;
+
+    Peer(const Arc<RC> &qp, const Arc<RecvEntries<R>> &entries,
+         const SendBufs &bufs)
+        : qp(qp), entries(entries), bufs(bufs), batch(qp) {}
+  };
+
+  // the DoorbellBatch is not movable, so the peers are stored by pointers
+  std::vector<std::unique_ptr<Peer>> peers;
+  std::unordered_map<u32, peer_id_t> qpn_to_peer;
+
+  // peers with batched (or backlogged) sends, or credits to return
+  std::vector<peer_id_t> pending_sends;
+  std::vector<peer_id_t> pending_recvs;
+
+  ibv_cq *recv_cq = nullptr;
+  Arc<AbsRecvAllocator> alloc;
+
+  ibv_wc wcs[R];
+
+public:
+  const usize msg_sz;
+
+  /*!
+    \param recv_cq: the recv_cq shared by the QPs of the peers
+    \param alloc: allocates the send (and the client's recv) buffers
+    \param msg_sz: the max message size, should not exceed the size of the
+    recv buffers
+   */
+  static Option<Arc<RCTransport>> create(ibv_cq *recv_cq,
+                                         Arc<AbsRecvAllocator> alloc,
+                                         const usize &msg_sz = 4096) {
+    if (recv_cq == nullptr)
+      return {};
+    return Arc<RCTransport>(new RCTransport(recv_cq, alloc, msg_sz));
+  }
+
+  /*!
+    Add a connected QP whose recv entries have been posted.
+    Selective signaling is enabled at the QP, if not yet,
+    so the QP should not be multiplexed by a CQMux.
+   */
+  Option<peer_id_t> add_peer(const Arc<RC> &qp,
+                             const Arc<RecvEntries<R>> &entries) {
+    if (qp->recv_cq != recv_cq || qp->mux_idx != 0)
+      return {};
+
+    // the sends in flight are bounded by RC::prepare_signal,
+    // and the backlog is bounded by R (see get_send_buf)
+    auto bufs = SendBufs::create(alloc, msg_sz, 2 * qp->max_send_sz() + R);
+    if (!bufs)
+      return {};
+    if (!qp->selective_signaled())
+      qp->enable_selective_signal(qp->max_send_sz() / 2);
+
+    peers.emplace_back(new Peer(qp, entries, bufs.value()));
+    auto id = static_cast<peer_id_t>(peers.size() - 1);
+    qpn_to_peer[qp->qp->qp_num] = id;
+    return id;
+  }
+
+  /*!
+    Add a connected QP, and allocate and post its recv entries.
+   */
+  Option<peer_id_t> add_peer(const Arc<RC> &qp) {
+    auto entries = RecvEntriesFactoryv2<R>::create(alloc, msg_sz);
+    if (qp->post_recvs(*entries, R) != IOCode::Ok)
+      return {};
+    return add_peer(qp, entries);
+  }
+
+  usize num_peers() const { return peers.size(); }
+
+  u32 credits(const peer_id_t &peer) const { return peers[peer]->credits; }
+
+  usize backlogged(const peer_id_t &peer) const {
+    return peers[peer]->backlog.size();
+  }
+
+  /*!
+    \ret a registered buffer (msg_sz bytes) to fill in the next message,
+    or nullptr if too many messages are waiting for the credits
+   */
+  char *get_send_buf(const peer_id_t &peer) {
+    auto &p = *peers[peer];
+    if (unlikely(p.backlog.size() >= R))
+      return nullptr;
+    return p.bufs.next();
+  }
+
+  /*!
+    Add a message (in the buffer returned by get_send_buf) to the peer's
+    batch, or to its backlog if no credit is left.
+   */
+  Result<std::string> send(const peer_id_t &peer, const char *buf,
+                           const u32 &len) {
+    RDMA_ASSERT(peer < peers.size()) << "unknown peer: " << peer;
+    auto &p = *peers[peer];
+    mark_pending(peer);
+
+    if (p.credits == 0 || !p.backlog.empty()) {
+      p.backlog.push_back(std::make_pair(buf, len));
+      return ::rdmaio::Ok(std::string(""));
+    }
+    return post_data(p, buf, len);
+  }
+
+  /*!
+    Post the batched messages, the backlogged ones allowed by the credits,
+    and the pending credits, one doorbell per peer.
+   */
+  Result<std::string> flush() {
+    auto ret = ::rdmaio::Ok(std::string(""));
+    for (auto peer : pending_sends) {
+      auto &p = *peers[peer];
+      p.dirty = false;
+
+      while (p.credits > 0 && !p.backlog.empty()) {
+        auto msg = p.backlog.front();
+        p.backlog.pop_front();
+        auto res = post_data(p, msg.first, msg.second);
+        if (unlikely(res != IOCode::Ok))
+          ret = res;
+      }
+
+      // no data carries the credits
+      if (p.credits_to_return >= R / 4) {
+        Op<> op;
+        op.set_op(IBV_WR_SEND_WITH_IMM)
+            .set_imm(std::exchange(p.credits_to_return, 0) | kCreditOnlyBit);
+        op.set_payload(p.bufs.start(), 0, p.bufs.lkey);
+        auto res = p.batch.add(op);
+        if (unlikely(res != IOCode::Ok))
+          ret = res;
+      }
+
+      auto res = p.batch.flush();
+      if (unlikely(res != IOCode::Ok))
+        ret = res;
+    }
+    pending_sends.clear();
+    return ret;
+  }
+
+  /*!
+    Poll the received messages of all the peers,
+    and call f(peer, msg, len) for each.
+    \note: the msg buffer is reposted after this call.
+    \ret #of messages received
+   */
+  template <typename F> usize poll_msgs(F &&f) {
+    usize num = 0;
+    for (RecvIter<RC, R> iter(recv_cq, wcs); iter.has_msgs(); iter.next()) {
+      auto &wc = iter.cur_wc();
+      auto it = qpn_to_peer.find(wc.qp_num);
+      if (unlikely(it == qpn_to_peer.end())) {
+        // e.g., a QP sharing the recv_cq which is not added as a peer
+        RDMA_LOG(4) << "drop a msg from unknown qp: " << wc.qp_num;
+        continue;
+      }
+      const peer_id_t peer = it->second;
+      auto &p = *peers[peer];
+      // every polled entry (including the failed ones) is reposted,
+      // so the recv ring of the peer stays in sync with its entries
+      if (p.consumed++ == 0)
+        pending_recvs.push_back(peer);
+
+      if (unlikely(wc.status != IBV_WC_SUCCESS)) {
+        RDMA_LOG(4) << "RC recv error: " << RC::wc_status(wc);
+        continue;
+      }
+
+      if (wc.wc_flags & IBV_WC_WITH_IMM) {
+        p.credits += wc.imm_data & (~kCreditOnlyBit);
+        if (!p.backlog.empty())
+          mark_pending(peer);
+        if (wc.imm_data & kCreditOnlyBit)
+          continue;
+      }
+      p.consumed_data += 1;
+
+      auto msg = static_cast<char *>(std::get<1>(iter.cur_msg().value()));
+      f(peer, msg, static_cast<u32>(wc.byte_len));
+      num += 1;
+    }
+
+    // repost the recv entries, and credit the ones consumed by data.
+    // the peers failed to repost are kept, and retried at the next poll,
+    // so their entries are credited only after being reposted
+    usize failed = 0;
+    for (auto peer : pending_recvs) {
+      auto &p = *peers[peer];
+      auto res = p.qp->post_recvs(*p.entries, p.consumed);
+      if (unlikely(res != IOCode::Ok)) {
+        RDMA_LOG(4) << "post recv error: " << strerror(res.desc);
+        pending_recvs[failed++] = peer;
+        continue;
+      }
+      p.consumed = 0;
+      p.credits_to_return += std::exchange(p.consumed_data, 0);
+      if (p.credits_to_return >= R / 4)
+        mark_pending(peer);
+    }
+    pending_recvs.resize(failed);
+    return num;
+  }
+
+private:
+  void mark_pending(const peer_id_t &peer) {
+    auto &p = *peers[peer];
+    if (!p.dirty) {
+      p.dirty = true;
+      pending_sends.push_back(peer);
+    }
+  }
+
+  /*!
+    Add a data message to the batch, which consumes a credit,
+    and carries the pending credits to the peer.
+   */
+  Result<std::string> post_data(Peer &p, const char *buf, const u32 &len) {
+    p.credits -= 1;
+    Op<> op;
+    op.set_op(IBV_WR_SEND_WITH_IMM)
+        .set_imm(std::exchange(p.credits_to_return, 0));
+    op.set_payload(buf, len, p.bufs.lkey);
+    return p.batch.add(op);
+  }
+
+  RCTransport(ibv_cq *recv_cq, Arc<AbsRecvAllocator> alloc,
+              const usize &msg_sz)
+      : recv_cq(recv_cq), alloc(alloc), msg_sz(msg_sz) {}
+};
+
+} // namespace rpc
+
+} // namespace rdmaio
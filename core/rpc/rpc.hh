@@ -0,0 +1,271 @@
+#pragma once
+
+#include <functional>
+#include <string.h>
+
+#include "../utils/timer.hh"
+
+#include "./proto.hh"
+
+namespace rdmaio {
+
+namespace rpc {
+
+/*!
+  A two-sided RDMA RPC, over a transport (UDTransport or RCTransport).
+  Each RPC instance can be both a client and a server.
+
+  - Server: handlers are registered by rpc id, similar to RPCFactory.
+    A handler reads the request directly from the recv buffer, and writes
+    the reply directly to a registered send buffer,
+    so neither of them is copied.
+  - Client: at most W calls can be outstanding, each identified by a req_id.
+    The reply is delivered to the callback of the call.
+    A call without a reply after timeout_usec (e.g., the request or the
+    reply is lost) expires at poll(), and its callback gets a reply with
+    ReplyStatus::Timeout, so its slot is freed.
+
+  Both the requests and the replies are batched by the transport, and are
+  posted upon poll() (or flush()).
+
+  \note: not thread-safe, each thread should use its own RPC and transport.
+
+  Example:
+  `
+  auto t = UDTransport<>::create(ud, alloc).value();
+  RPC<UDTransport<>> rpc(t);
+  rpc.register_handler(73, [](const MsgView &req, char *reply, u32 cap) {
+    memcpy(reply, req.payload, req.len); // echo
+    return req.len;
+  });
+
+  auto peer = t->add_peer(remote_attr);
+  auto res = rpc.call(peer, 73, buf, len, reply_cb, ctx);
+  while (running)
+    rpc.poll(); // serve requests and replies
+  `
+ */
+template <class Transport, usize W = 64> class RPC {
+  static_assert(W > 0 && (W & (W - 1)) == 0, "W should be a power of two");
+
+public:
+  /*!
+    handle(req, reply_buf, reply_cap) -> reply size
+   */
+  using req_handler_f =
+      std::function<u32(const MsgView &req, char *reply, const u32 &cap)>;
+
+  using reply_cb_t = void (*)(void *ctx, const MsgView &reply);
+
+  static constexpr const usize kMaxRPCs = 1 << (sizeof(rpc_id_t) * 8);
+
+private:
+  Arc<Transport> transport;
+
+  req_handler_f handlers[kMaxRPCs];
+
+  struct Pending {
+    u64 req_id = 0;
+    peer_id_t peer = 0;
+    double deadline = 0;
+    reply_cb_t cb = nullptr;
+    void *ctx = nullptr;
+    bool busy = false;
+  };
+  Pending pendings[W];
+  usize outstanding = 0;
+
+  u64 next_req_id = 1;
+
+  Timer timer;
+  double timeout_usec;
+
+public:
+  explicit RPC(const Arc<Transport> &t,
+               const double &timeout_usec = 1000000)
+      : transport(t), timeout_usec(timeout_usec) {}
+
+  bool register_handler(const rpc_id_t &id, req_handler_f fn) {
+    if (handlers[id])
+      return false;
+    handlers[id] = fn;
+    return true;
+  }
+
+  usize max_payload() const { return transport->msg_sz - sizeof(Header); }
+
+  usize outstanding_calls() const { return outstanding; }
+
+  /*!
+    Get a registered buffer to fill in the parameter of the next call,
+    which is passed to call_prepared() to avoid the copy.
+    \ret nullptr if the transport runs out of send buffers
+   */
+  char *get_req_buf(const peer_id_t &peer) {
+    auto buf = transport->get_send_buf(peer);
+    if (unlikely(buf == nullptr))
+      return nullptr;
+    return buf + sizeof(Header);
+  }
+
+  /*!
+    Call *id* at the peer with a parameter in buf (from get_req_buf).
+    \ret
+    - Ok: the req_id of the call
+    - NotReady: W calls are outstanding (or no send buffer), retry after
+      poll()
+    - Err: the parameter is too large, or the post failed
+   */
+  Result<u64> call_prepared(const peer_id_t &peer, const rpc_id_t &id,
+                            char *buf, const u32 &len, reply_cb_t cb,
+                            void *ctx = nullptr) {
+    if (unlikely(len > max_payload()))
+      return ::rdmaio::Err(static_cast<u64>(0));
+
+    const auto req_id = next_req_id;
+    auto &p = pendings[req_id & (W - 1)];
+    if (p.busy)
+      return ::rdmaio::NotReady(static_cast<u64>(0));
+
+    auto msg = buf - sizeof(Header);
+    *(reinterpret_cast<Header *>(msg)) = {.type = MsgType::Req,
+                                          .status = 0,
+                                          .id = id,
+                                          .len = len,
+                                          .req_id = req_id};
+    auto res = transport->send(peer, msg, sizeof(Header) + len);
+    if (unlikely(res != IOCode::Ok))
+      return ::rdmaio::Err(static_cast<u64>(0));
+
+    p = {.req_id = req_id,
+         .peer = peer,
+         .deadline = timer.passed_msec() + timeout_usec,
+         .cb = cb,
+         .ctx = ctx,
+         .busy = true};
+    next_req_id += 1;
+    outstanding += 1;
+    return ::rdmaio::Ok(req_id);
+  }
+
+  /*!
+    Call *id* at the peer, the parameter is copied to a registered buffer.
+   */
+  Result<u64> call(const peer_id_t &peer, const rpc_id_t &id, const void *arg,
+                   const u32 &len, reply_cb_t cb, void *ctx = nullptr) {
+    if (unlikely(len > max_payload()))
+      return ::rdmaio::Err(static_cast<u64>(0));
+    if (pendings[next_req_id & (W - 1)].busy)
+      return ::rdmaio::NotReady(static_cast<u64>(0));
+
+    auto buf = get_req_buf(peer);
+    if (unlikely(buf == nullptr))
+      return ::rdmaio::NotReady(static_cast<u64>(0));
+    memcpy(buf, arg, len);
+    return call_prepared(peer, id, buf, len, cb, ctx);
+  }
+
+  /*!
+    Serve the received requests and replies, expire the calls passing their
+    deadlines, then post the batched replies (and requests).
+    \ret #of messages received
+   */
+  usize poll() {
+    auto num = transport->poll_msgs(
+        [this](const peer_id_t &peer, char *msg, const u32 &len) {
+          this->handle_msg(peer, msg, len);
+        });
+    if (outstanding > 0)
+      expire();
+    flush();
+    return num;
+  }
+
+  Result<std::string> flush() { return transport->flush(); }
+
+private:
+  void handle_msg(const peer_id_t &peer, char *msg, const u32 &len) {
+    if (unlikely(len < sizeof(Header))) {
+      RDMA_LOG(4) << "drop a malformed msg with sz: " << len;
+      return;
+    }
+    const Header &header = *(reinterpret_cast<Header *>(msg));
+    if (unlikely(sizeof(Header) + header.len > len)) {
+      RDMA_LOG(4) << "drop a truncated msg with payload sz: " << header.len
+                  << ", msg sz: " << len;
+      return;
+    }
+    const MsgView view = {.peer = peer,
+                          .status = static_cast<ReplyStatus>(header.status),
+                          .payload = msg + sizeof(Header),
+                          .len = header.len};
+
+    if (header.type == MsgType::Req)
+      return handle_req(header, view);
+
+    // a reply
+    auto &p = pendings[header.req_id & (W - 1)];
+    if (unlikely(!p.busy || p.req_id != header.req_id)) {
+      RDMA_LOG(4) << "drop a stale reply of req: " << header.req_id;
+      return;
+    }
+    p.busy = false;
+    outstanding -= 1;
+    if (p.cb != nullptr)
+      p.cb(p.ctx, view);
+  }
+
+  /*!
+    Fire the callbacks of the calls passing their deadlines with Timeout.
+    A reply arriving later is dropped as stale, since the slot is freed.
+   */
+  void expire() {
+    const double now = timer.passed_msec();
+    for (usize i = 0; i < W; ++i) {
+      auto &p = pendings[i];
+      if (!p.busy || p.deadline > now)
+        continue;
+      p.busy = false;
+      outstanding -= 1;
+      const MsgView view = {.peer = p.peer,
+                            .status = ReplyStatus::Timeout,
+                            .payload = nullptr,
+                            .len = 0};
+      if (p.cb != nullptr)
+        p.cb(p.ctx, view);
+    }
+  }
+
+  void handle_req(const Header &header, const MsgView &req) {
+    auto reply = transport->get_send_buf(req.peer);
+    if (unlikely(reply == nullptr)) {
+      RDMA_LOG(4) << "no send buffer for the reply of req: " << header.req_id;
+      return;
+    }
+    auto &reply_header = *(reinterpret_cast<Header *>(reply));
+
+    reply_header = {.type = MsgType::Reply,
+                    .status = static_cast<u8>(ReplyStatus::Ok),
+                    .id = header.id,
+                    .len = 0,
+                    .req_id = header.req_id};
+
+    auto &fn = handlers[header.id];
+    if (likely(fn)) {
+      auto cap = static_cast<u32>(max_payload());
+      reply_header.len = fn(req, reply + sizeof(Header), cap);
+      RDMA_ASSERT(reply_header.len <= cap)
+          << "reply too large: " << reply_header.len;
+    } else
+      reply_header.status = static_cast<u8>(ReplyStatus::NoHandler);
+
+    auto res = transport->send(req.peer, reply,
+                               sizeof(Header) + reply_header.len);
+    if (unlikely(res != IOCode::Ok))
+      RDMA_LOG(4) << "failed to send the reply: " << res.desc;
+  }
+};
+
+} // namespace rpc
+
+} // namespace rdmaio
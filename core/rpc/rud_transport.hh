@@ -0,0 +1,406 @@
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include "./proto.hh"
+
+#include "../qps/recv_iter.hh"
+#include "../utils/timer_wheel.hh"
+
+namespace rdmaio {
+
+namespace rpc {
+
+using namespace qp;
+
+enum RUDMsgType : u8 {
+  Data = 0,
+  Ack,
+};
+
+/*!
+  The header of each datagram of the RUDTransport.
+  ack and credit are piggybacked on all the messages, including the data.
+ */
+struct __attribute__((packed)) RUDHeader {
+  u8 type;
+  u8 reserved = 0;
+  u16 reserved1 = 0;
+  u32 seq;    // of a data message
+  u32 ack;    // the sender has received all the data before ack
+  u32 credit; // the receiver of this msg may send the data before credit
+};
+
+/*!
+  A reliable and flow-controlled transport over a UD QP.
+  It shares the interface of UDTransport, so RPC<RUDTransport<>> works.
+
+  - Sequencing: data to each peer are numbered, and delivered in order.
+    Out-of-order data are dropped (go-back-N).
+  - Acks: the cumulative ack is piggybacked on every message to the peer.
+    If no data goes to a peer in a flush(), an ack-only message is sent
+    instead (if there are new data to ack).
+  - Retransmission: if the sent data are not acked in rto_usec,
+    all of them are retransmitted. The timers are managed by a TimerWheel.
+  - Credits: each peer may only send the data granted by the receiver,
+    i.e., seq < credit, so that the RQ does not run dry.
+    A receiver evenly divides half of its R recv entries among at most
+    max_peers peers (fixed at create()), so the grants never exceed R/2
+    however many peers are added; the other half is reserved for acks
+    and retransmissions.
+    Data without credits wait at the sender, and are posted once
+    credits arrive.
+
+  Each peer has S send slots, holding the data until acked.
+  If all are in use, get_send_buf() returns nullptr.
+  So for RPC<RUDTransport<R, S>, W>, S should be no less than W,
+  otherwise replies may be dropped.
+
+  \note: the peers at both sides should add each other (add_peer)
+  before talking.
+ */
+template <usize R = 2048, usize S = 64> class RUDTransport {
+  static_assert(S > 0 && (S & (S - 1)) == 0, "S should be a power of two");
+
+  struct Peer {
+    QPAttr attr;
+
+    // send side
+    char *slots = nullptr;
+    u32 lens[S];
+    u32 next_seq = 0; // the next seq to assign
+    u32 posted = 0;   // the data before posted have been posted
+    u32 acked = 0;    // the data before acked are acked by the peer
+    // the data before credit are allowed to post,
+    // only one before the peer grants its credits
+    u32 credit = 1;
+    u64 timer_gen = 0;
+    bool timer_armed = false;
+
+    // recv side
+    u32 expected = 0; // the next seq to receive
+    u32 ack_sent = 0;
+    bool ack_now = false;
+    RUDHeader *ack_buf = nullptr;
+
+    bool dirty = false;
+  };
+
+  Arc<UD> ud;
+  Arc<RecvEntries<R>> entries;
+  rmem::mr_key_t lkey;
+
+  std::vector<Peer> peers;
+  std::map<u64, peer_id_t> peer_idx;
+
+  // peers with data to post, or acks to send
+  std::vector<peer_id_t> dirty_peers;
+
+  TimerWheel<std::pair<peer_id_t, u64>> wheel;
+
+  Arc<AbsRecvAllocator> alloc;
+
+  UDReq reqs[kNMaxDoorbell];
+  usize num_reqs = 0;
+
+public:
+  const usize msg_sz;
+  const double rto_usec;
+  const usize max_peers;
+
+  // statistics
+  usize retransmits = 0;
+  usize dropped = 0;
+
+  /*!
+    \param alloc: allocates the recv and the send buffers (in one MR)
+    \param rto_usec: the retransmission timeout
+    \param max_peers: the max #of peers to add, which divide the credits
+   */
+  static Option<Arc<RUDTransport>> create(Arc<UD> ud,
+                                          Arc<AbsRecvAllocator> alloc,
+                                          const double &rto_usec = 1000,
+                                          const usize &max_peers = 16) {
+    RDMA_ASSERT(R <= static_cast<usize>(ud->my_config.max_recv_sz()))
+        << "too many recv entries for the UD: " << R;
+    RDMA_ASSERT(R >= 4) << "too few recv entries";
+    if (max_peers == 0 || max_peers > R / 2) {
+      RDMA_LOG(4) << "invalid max_peers: " << max_peers << " for " << R
+                  << " recv entries";
+      return {};
+    }
+
+    auto entries = RecvEntriesFactoryv2<R>::create(alloc, ud->kMaxMsgSz + kGRHSz);
+    if (ud->post_recvs(*entries, R) != IOCode::Ok)
+      return {};
+
+    // the send slots should be in the same MR as the recv buffers
+    return Arc<RUDTransport>(new RUDTransport(ud, entries, alloc,
+                                              entries->sges[0].lkey,
+                                              ud->kMaxMsgSz - sizeof(RUDHeader),
+                                              rto_usec, max_peers));
+  }
+
+  /*!
+    \param attr: the UD QP of the peer, e.g., fetched by ConnectManager
+    \ret the peer id, or {} if failed to allocate the send slots,
+    or max_peers peers have been added
+   */
+  Option<peer_id_t> add_peer(const QPAttr &attr) {
+    auto key = peer_key(attr.lid, attr.qpn);
+    auto it = peer_idx.find(key);
+    if (it != peer_idx.end())
+      return it->second;
+    if (peers.size() >= max_peers)
+      return {};
+
+    auto buf = alloc->alloc_one(S * slot_sz() + sizeof(RUDHeader));
+    if (!buf || std::get<1>(buf.value()) != lkey)
+      return {};
+
+    Peer p;
+    p.attr = attr;
+    p.slots = static_cast<char *>(std::get<0>(buf.value()));
+    p.ack_buf = reinterpret_cast<RUDHeader *>(p.slots + S * slot_sz());
+    peers.push_back(p);
+
+    auto id = static_cast<peer_id_t>(peers.size() - 1);
+    peer_idx.insert(std::make_pair(key, id));
+
+    // grant the credits to the peer upon the next flush
+    peers[id].ack_now = true;
+    mark_dirty(id);
+    return id;
+  }
+
+  usize num_peers() const { return peers.size(); }
+
+  /*!
+    \ret the #of data a peer may send to us without acks,
+    which is fixed so that all the grants sum to no more than R/2
+   */
+  u32 credits_per_peer() const { return static_cast<u32>(R / 2 / max_peers); }
+
+  /*!
+    \ret #of data sent to the peer, but not yet acked
+   */
+  u32 unacked(const peer_id_t &peer) const {
+    return peers[peer].next_seq - peers[peer].acked;
+  }
+
+  /*!
+    \ret a registered buffer (msg_sz bytes) to fill in the next message,
+    or nullptr if all the send slots of the peer are in use
+   */
+  char *get_send_buf(const peer_id_t &peer) {
+    auto &p = peers[peer];
+    if (p.next_seq - p.acked >= S)
+      return nullptr;
+    return slot(p, p.next_seq) + sizeof(RUDHeader);
+  }
+
+  /*!
+    Queue a message (in the buffer returned by the last get_send_buf),
+    which is posted upon flush().
+   */
+  Result<std::string> send(const peer_id_t &peer, const char *buf,
+                           const u32 &len) {
+    RDMA_ASSERT(peer < peers.size()) << "unknown peer: " << peer;
+    auto &p = peers[peer];
+    if (unlikely(buf != slot(p, p.next_seq) + sizeof(RUDHeader) ||
+                 len > msg_sz))
+      return ::rdmaio::Err(std::string("the msg is not from get_send_buf"));
+
+    p.lens[p.next_seq % S] = len;
+    p.next_seq += 1;
+    mark_dirty(peer);
+    return ::rdmaio::Ok(std::string(""));
+  }
+
+  /*!
+    Retransmit the timeout data, then post the data (within credits) and acks
+    of all the dirty peers.
+   */
+  Result<std::string> flush() {
+    wheel.advance([this](const std::pair<peer_id_t, u64> &e) {
+      this->on_timeout(e.first, e.second);
+    });
+
+    auto ret = ::rdmaio::Ok(std::string(""));
+    for (auto peer : dirty_peers) {
+      auto &p = peers[peer];
+      p.dirty = false;
+
+      const u32 end = before(p.credit, p.next_seq) ? p.credit : p.next_seq;
+      const bool has_data = before(p.posted, end);
+      for (; before(p.posted, end); p.posted += 1) {
+        auto buf = slot(p, p.posted);
+        fill_header(p, reinterpret_cast<RUDHeader *>(buf), RUDMsgType::Data,
+                    p.posted);
+        add_req(p, buf, sizeof(RUDHeader) + p.lens[p.posted % S], ret);
+      }
+
+      if (has_data && !p.timer_armed)
+        arm_timer(peer);
+
+      // an ack-only message
+      if (!has_data && (p.ack_now || p.ack_sent != p.expected)) {
+        fill_header(p, p.ack_buf, RUDMsgType::Ack, 0);
+        add_req(p, reinterpret_cast<char *>(p.ack_buf), sizeof(RUDHeader),
+                ret);
+      }
+    }
+    dirty_peers.clear();
+    post_reqs(ret);
+    return ret;
+  }
+
+  /*!
+    Poll the received messages, handle the acks and credits,
+    and call f(peer, msg, len) for each in-order data.
+    \ret #of data delivered
+   */
+  template <typename F> usize poll_msgs(F &&f) {
+    usize num = 0;
+    for (RecvIter<UD, R> iter(ud, entries); iter.has_msgs(); iter.next()) {
+      auto &wc = iter.cur_wc();
+      if (unlikely(wc.status != IBV_WC_SUCCESS)) {
+        RDMA_LOG(4) << "UD recv error: " << UD::wc_status(wc);
+        continue;
+      }
+      auto it = peer_idx.find(peer_key(wc.slid, wc.src_qp));
+      if (unlikely(it == peer_idx.end() ||
+                   wc.byte_len < kGRHSz + sizeof(RUDHeader))) {
+        dropped += 1;
+        continue;
+      }
+
+      const peer_id_t peer = it->second;
+      auto &p = peers[peer];
+      auto msg = static_cast<char *>(std::get<1>(iter.cur_msg().value())) +
+                 kGRHSz;
+      const auto &header = *(reinterpret_cast<RUDHeader *>(msg));
+      on_ack(peer, header.ack, header.credit);
+
+      if (header.type != RUDMsgType::Data)
+        continue;
+
+      if (header.seq == p.expected) {
+        p.expected += 1;
+        f(peer, msg + sizeof(RUDHeader),
+          static_cast<u32>(wc.byte_len - kGRHSz - sizeof(RUDHeader)));
+        num += 1;
+      } else {
+        // a duplicated or out-of-order data, the sender may lose our acks
+        p.ack_now = true;
+        dropped += 1;
+      }
+      mark_dirty(peer);
+    }
+    return num;
+  }
+
+private:
+  RUDTransport(Arc<UD> ud, Arc<RecvEntries<R>> entries,
+               Arc<AbsRecvAllocator> alloc, const rmem::mr_key_t &lkey,
+               const usize &msg_sz, const double &rto_usec,
+               const usize &max_peers)
+      : ud(ud), entries(entries), lkey(lkey),
+        wheel(256, std::max(rto_usec / 16, 1.0)), alloc(alloc),
+        msg_sz(msg_sz), rto_usec(rto_usec), max_peers(max_peers) {
+    ud->bind_local_mr({.buf = 0, .sz = 0, .key = 0, .lkey = lkey});
+  }
+
+  // serial number comparison, which tolerates the wrap-around of u32
+  static bool before(const u32 &a, const u32 &b) {
+    return static_cast<int32_t>(a - b) < 0;
+  }
+
+  static u64 peer_key(const u64 &lid, const u64 &qpn) {
+    return (lid << 32) | (qpn & bitmask<u64>(32));
+  }
+
+  usize slot_sz() const { return sizeof(RUDHeader) + msg_sz; }
+
+  char *slot(Peer &p, const u32 &seq) const {
+    return p.slots + (seq % S) * slot_sz();
+  }
+
+  void mark_dirty(const peer_id_t &peer) {
+    if (!peers[peer].dirty) {
+      peers[peer].dirty = true;
+      dirty_peers.push_back(peer);
+    }
+  }
+
+  void fill_header(Peer &p, RUDHeader *header, const RUDMsgType &type,
+                   const u32 &seq) {
+    *header = {.type = type,
+               .seq = seq,
+               .ack = p.expected,
+               .credit = p.expected + credits_per_peer()};
+    p.ack_sent = p.expected;
+    p.ack_now = false;
+  }
+
+  void on_ack(const peer_id_t &peer, const u32 &ack, const u32 &credit) {
+    auto &p = peers[peer];
+    if (before(p.credit, credit)) {
+      p.credit = credit;
+      if (before(p.posted, p.next_seq))
+        mark_dirty(peer);
+    }
+    // ignore the acks of the data not sent, e.g., from a stale peer
+    if (before(p.acked, ack) && !before(p.next_seq, ack)) {
+      p.acked = ack;
+      // the acks of the data posted before a go-back-N
+      if (before(p.posted, ack))
+        p.posted = ack;
+      // restart the timer for the remaining data
+      p.timer_armed = false;
+      if (before(p.acked, p.posted))
+        arm_timer(peer);
+    }
+  }
+
+  void arm_timer(const peer_id_t &peer) {
+    auto &p = peers[peer];
+    p.timer_gen += 1;
+    p.timer_armed = true;
+    wheel.schedule_usec(rto_usec, std::make_pair(peer, p.timer_gen));
+  }
+
+  void on_timeout(const peer_id_t &peer, const u64 &gen) {
+    auto &p = peers[peer];
+    if (gen != p.timer_gen || !p.timer_armed)
+      return;
+    p.timer_armed = false;
+    if (!before(p.acked, p.posted))
+      return;
+
+    // go-back-N
+    retransmits += p.posted - p.acked;
+    p.posted = p.acked;
+    mark_dirty(peer);
+  }
+
+  void add_req(Peer &p, const char *buf, const u32 &len,
+               Result<std::string> &ret) {
+    reqs[num_reqs++] = {.dest = &p.attr, .buf = buf, .len = len, .imm = 0};
+    if (num_reqs == kNMaxDoorbell)
+      post_reqs(ret);
+  }
+
+  void post_reqs(Result<std::string> &ret) {
+    if (num_reqs == 0)
+      return;
+    auto res = ud->send_batch(reqs, std::exchange(num_reqs, 0));
+    if (unlikely(res != IOCode::Ok))
+      ret = res;
+  }
+};
+
+} // namespace rpc
+
+} // namespace rdmaio
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include "./proto.hh"
+
+#include "../qps/recv_iter.hh"
+
+namespace rdmaio {
+
+namespace rpc {
+
+using namespace qp;
+
+/*!
+  The RPC transport over a UD QP, which talks to all the peers.
+  Messages larger than the UD's MTU (UD::kMaxMsgSz) are not supported,
+  and lost messages are not retransmitted.
+
+  A received message is matched to its peer by the (slid, src_qp) of the
+  completion, so the peers must be added (add_peer) before talking to them.
+  \note: on RoCE the slid is 0, so the peers should have distinct qpns.
+
+  The sends are batched (at most kNMaxDoorbell) and posted with one doorbell,
+  either when the batch is full or upon flush().
+ */
+template <usize R = 2048> class UDTransport {
+  Arc<UD> ud;
+  Arc<RecvEntries<R>> entries;
+  SendBufs bufs;
+
+  std::vector<QPAttr> peers;
+  std::map<u64, peer_id_t> peer_idx;
+
+  struct Pending {
+    peer_id_t peer;
+    const char *buf;
+    u32 len;
+  };
+  Pending pendings[kNMaxDoorbell];
+  usize num_pending = 0;
+
+public:
+  const usize msg_sz;
+
+  /*!
+    \param alloc: allocates both the recv and the send buffers
+    (in one registered MR)
+   */
+  static Option<Arc<UDTransport>> create(Arc<UD> ud,
+                                         Arc<AbsRecvAllocator> alloc) {
+    const usize msg_sz = ud->kMaxMsgSz;
+    RDMA_ASSERT(R <= static_cast<usize>(ud->my_config.max_recv_sz()))
+        << "too many recv entries for the UD: " << R;
+
+    // the sends in flight are bounded by UD::prepare_signal
+    auto bufs =
+        SendBufs::create(alloc, msg_sz, 2 * ud->my_config.max_send_sz());
+    if (!bufs)
+      return {};
+
+    auto entries = RecvEntriesFactoryv2<R>::create(alloc, msg_sz + kGRHSz);
+    if (ud->post_recvs(*entries, R) != IOCode::Ok)
+      return {};
+
+    ud->bind_local_mr({.buf = reinterpret_cast<uintptr_t>(bufs.value().start()),
+                       .sz = bufs.value().total_sz(),
+                       .key = 0,
+                       .lkey = bufs.value().lkey});
+    return Arc<UDTransport>(new UDTransport(ud, entries, bufs.value(), msg_sz));
+  }
+
+  /*!
+    \param attr: the UD QP of the peer, e.g., fetched by ConnectManager
+   */
+  peer_id_t add_peer(const QPAttr &attr) {
+    auto key = peer_key(attr.lid, attr.qpn);
+    auto it = peer_idx.find(key);
+    if (it != peer_idx.end())
+      return it->second;
+
+    peers.push_back(attr);
+    auto id = static_cast<peer_id_t>(peers.size() - 1);
+    peer_idx.insert(std::make_pair(key, id));
+    return id;
+  }
+
+  usize num_peers() const { return peers.size(); }
+
+  /*!
+    \ret a registered buffer (msg_sz bytes) to fill in the next message
+   */
+  char *get_send_buf(const peer_id_t &peer) { return bufs.next(); }
+
+  /*!
+    Add a message (in the buffer returned by get_send_buf) to the batch.
+   */
+  Result<std::string> send(const peer_id_t &peer, const char *buf,
+                           const u32 &len) {
+    RDMA_ASSERT(peer < peers.size()) << "unknown peer: " << peer;
+    pendings[num_pending++] = {.peer = peer, .buf = buf, .len = len};
+    if (num_pending == kNMaxDoorbell)
+      return flush();
+    return ::rdmaio::Ok(std::string(""));
+  }
+
+  /*!
+    Post all the batched messages.
+   */
+  Result<std::string> flush() {
+    if (num_pending == 0)
+      return ::rdmaio::Ok(std::string(""));
+
+    UDReq reqs[kNMaxDoorbell];
+    for (uint i = 0; i < num_pending; ++i) {
+      reqs[i] = {.dest = &peers[pendings[i].peer],
+                 .buf = pendings[i].buf,
+                 .len = pendings[i].len,
+                 .imm = 0};
+    }
+    auto num = std::exchange(num_pending, 0);
+    return ud->send_batch(reqs, num);
+  }
+
+  /*!
+    Poll the received messages, and call f(peer, msg, len) for each.
+    The messages from unknown peers are dropped.
+    \note: the msg buffer is reposted after this call.
+    \ret #of messages received
+   */
+  template <typename F> usize poll_msgs(F &&f) {
+    usize num = 0;
+    for (RecvIter<UD, R> iter(ud, entries); iter.has_msgs(); iter.next()) {
+      auto &wc = iter.cur_wc();
+      if (unlikely(wc.status != IBV_WC_SUCCESS)) {
+        RDMA_LOG(4) << "UD recv error: " << UD::wc_status(wc);
+        continue;
+      }
+
+      auto it = peer_idx.find(peer_key(wc.slid, wc.src_qp));
+      if (unlikely(it == peer_idx.end())) {
+        RDMA_LOG(4) << "drop a msg from unknown qp: " << wc.src_qp;
+        continue;
+      }
+
+      auto msg = static_cast<char *>(std::get<1>(iter.cur_msg().value()));
+      f(it->second, msg + kGRHSz, static_cast<u32>(wc.byte_len - kGRHSz));
+      num += 1;
+    }
+    return num;
+  }
+
+private:
+  UDTransport(Arc<UD> ud, Arc<RecvEntries<R>> entries, const SendBufs &bufs,
+              const usize &msg_sz)
+      : ud(ud), entries(entries), bufs(bufs), msg_sz(msg_sz) {}
+
+  static u64 peer_key(const u64 &lid, const u64 &qpn) {
+    return (lid << 32) | (qpn & bitmask<u64>(32));
+  }
+};
+
+} // namespace rpc
+
+} // namespace rdmaio
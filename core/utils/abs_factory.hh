@@ -1,11 +1,14 @@
 #pragma once
 
-#include <map>
+#include <atomic>
 #include <memory>
 #include <mutex>
+#include <unordered_map>
 
 #include "../common.hh"
 
+#include "./ebr.hh"
+
 namespace rdmaio {
 
 /*!
@@ -28,57 +31,100 @@ namespace rdmaio {
   opened_nics.dereg(73,key); // delete the nic from the registration
   `
 
+  The queries are lock-free (see ./ebr.hh), so many threads can query
+  concurrently; reg/dereg copy the entries, which suits the rare updates.
  */
 template <typename K, typename V> class Factory {
-  std::map<K,std::pair<Arc<V>,u64>> store;
+  using store_t = std::unordered_map<K, std::pair<Arc<V>, u64>>;
+
+  // the current entries, which is immutable once published:
+  // the writers copy it, modify the copy and publish the copy,
+  // so the readers (query) never take the lock (see ./ebr.hh).
+  std::atomic<store_t *> store;
+
+  // serialize the writers
   std::mutex lock;
+  RetireList<store_t> retired;
 
 public:
+  Factory() : store(new store_t()) {}
+
+  ~Factory() { delete store.load(); }
+
   static Arc<V> wrapper_raw_ptr(V *v) {
     return Arc<V>(v, [](auto p) {});
   }
 
-  usize reg_entries() const { return store.size(); }
+  usize reg_entries() const {
+    EBR::Guard guard;
+    return store.load()->size();
+  }
+
   /*!
     Register a v to the factory,
     if successful, return an authentication key so that user can delete it.
    */
   Option<u64> reg(const K &k, Arc<V> v) {
     std::lock_guard<std::mutex> guard(lock);
-    if (store.find(k) != store.end())
+    auto cur = store.load();
+    if (cur->find(k) != cur->end())
       return {};
     auto key = generate_key();
-    store.insert(std::make_pair(k,std::make_pair(v,key)));
 
+    auto next = new store_t(*cur);
+    next->insert(std::make_pair(k, std::make_pair(v, key)));
+    publish(next);
     return key;
   }
 
   /*!
     Qeury a registered entry, without authentication.
+    It is lock-free, so it can be called by many threads on the data path.
    */
   Option<Arc<V>> query(const K &k) {
-    std::lock_guard<std::mutex> guard(lock);
-    if (store.find(k) != store.end())
-      return std::get<0>(store[k]);
+    EBR::Guard guard;
+    auto cur = store.load();
+    auto it = cur->find(k);
+    if (it != cur->end())
+      return std::get<0>(it->second);
     return {};
   }
 
+  /*!
+    Call f on a registered entry without copying its Arc,
+    so the concurrent queries donot contend on the reference count.
+    \note: f should not keep the reference, and should not call reg/dereg
+    \ret: false if the entry is not found
+   */
+  template <typename F> bool visit(const K &k, F &&f) {
+    EBR::Guard guard;
+    auto cur = store.load();
+    auto it = cur->find(k);
+    if (it == cur->end())
+      return false;
+    f(std::get<0>(it->second));
+    return true;
+  }
+
   Arc<V> query_or_default(const K &k, V *def) {
     auto res = query(k);
-    if (res);
+    if (res)
       return res.value();
     return wrapper_raw_ptr(def);
   }
 
   Option<Arc<V>> dereg(const K &id, const u64 &k) {
     std::lock_guard<std::mutex> guard(lock);
-    auto it = store.find(id);
-    if (it != store.end()) {
+    auto cur = store.load();
+    auto it = cur->find(id);
+    if (it != cur->end()) {
       // further check the authentication key
       if (std::get<1>(it->second) == k) {
         auto res = std::get<0>(it->second);
-        store.erase(it);
 
+        auto next = new store_t(*cur);
+        next->erase(id);
+        publish(next);
         return res;
       }
     }
@@ -100,6 +146,10 @@ public:
     return {};
   }
 
+private:
+  // replace the entries, the old one is deleted after the readers exit
+  void publish(store_t *next) { retired.retire(store.exchange(next)); }
+
 protected:
   // user can override the generate key function to generate their own authentical keys
   virtual u64 generate_key() {
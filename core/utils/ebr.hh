@@ -0,0 +1,203 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "../common.hh"
+
+namespace rdmaio {
+
+/*!
+  Epoch-based reclamation (EBR), so the readers of a shared object never take
+  locks, while a writer can still free the object it replaced.
+
+  - A reader accesses the shared objects in a read section (EBR::Guard),
+    which publishes the global epoch at its start in a per-thread slot.
+  - A writer replaces an object and retires the old one (RetireList).
+    Retiring advances the global epoch, and the old object is deleted once no
+    read section started at (or before) its retire epoch is active.
+
+  The slots are shared by all the users of EBR. A thread takes its slot at
+  its first read section, and returns it when the thread exits.
+  If more than kMaxThreads threads read concurrently, the rest fall back to a
+  shared counter, which only delays the reclamation.
+
+  Example:
+  `
+  std::atomic<T *> ptr;
+  RetireList<T> retired;
+
+  // reader
+  {
+    EBR::Guard g;
+    T *p = ptr.load();
+    ... // use p
+  }
+
+  // writer, serialized with the other writers
+  retired.retire(ptr.exchange(new T()));
+  `
+ */
+class EBR {
+public:
+  static constexpr const usize kMaxThreads = 256;
+
+  class Guard {
+  public:
+    Guard() { EBR::enter(); }
+    ~Guard() { EBR::exit(); }
+
+    Guard(const Guard &) = delete;
+    Guard &operator=(const Guard &) = delete;
+  };
+
+  /*!
+    Advance the global epoch
+    \ret: the epoch before advancing, the objects retired at it can be
+    deleted once safe() holds.
+   */
+  static u64 advance() { return global_epoch().fetch_add(1); }
+
+  /*!
+    \ret: whether all the read sections started at (or before) epoch e exit
+   */
+  static bool safe(const u64 &e) {
+    if (overflow_readers().load() > 0)
+      return false;
+    auto s = slots();
+    for (usize i = 0; i < kMaxThreads; ++i) {
+      auto v = s[i].epoch.load();
+      if (v != kQuiescent && v <= e)
+        return false;
+    }
+    return true;
+  }
+
+private:
+  static constexpr const u64 kQuiescent = 0;
+
+  struct alignas(64) Slot {
+    // the epoch when the thread enters its read section,
+    // or kQuiescent if the thread is not reading
+    std::atomic<u64> epoch{kQuiescent};
+    std::atomic<bool> used{false};
+  };
+
+  // the per-thread state, which returns its slot when the thread exits
+  struct Local {
+    Slot *slot = nullptr;
+    usize depth = 0;
+    bool tried = false;
+
+    ~Local() {
+      if (slot != nullptr) {
+        slot->epoch.store(kQuiescent);
+        slot->used.store(false);
+      }
+    }
+  };
+
+  static std::atomic<u64> &global_epoch() {
+    static std::atomic<u64> epoch(kQuiescent + 1);
+    return epoch;
+  }
+
+  static std::atomic<u64> &overflow_readers() {
+    static std::atomic<u64> num(0);
+    return num;
+  }
+
+  static Slot *slots() {
+    static Slot s[kMaxThreads];
+    return s;
+  }
+
+  static Local &local() {
+    thread_local Local l;
+    if (unlikely(!l.tried)) {
+      l.tried = true;
+      auto s = slots();
+      for (usize i = 0; i < kMaxThreads; ++i) {
+        bool expected = false;
+        if (!s[i].used.load() &&
+            s[i].used.compare_exchange_strong(expected, true)) {
+          l.slot = &s[i];
+          break;
+        }
+      }
+    }
+    return l;
+  }
+
+  static void enter() {
+    auto &l = local();
+    // nested read sections are protected by the outermost one
+    if (l.depth++ > 0)
+      return;
+    if (likely(l.slot != nullptr))
+      l.slot->epoch.store(global_epoch().load());
+    else
+      overflow_readers().fetch_add(1);
+  }
+
+  static void exit() {
+    auto &l = local();
+    if (--l.depth > 0)
+      return;
+    if (likely(l.slot != nullptr))
+      l.slot->epoch.store(kQuiescent);
+    else
+      overflow_readers().fetch_sub(1);
+  }
+};
+
+/*!
+  The objects retired by a writer, which are deleted once no reader may
+  access them.
+  \note: not thread-safe, the writers should be serialized
+ */
+template <typename T> class RetireList {
+  std::vector<std::pair<u64, T *>> objs;
+
+public:
+  RetireList() = default;
+  RetireList(const RetireList &) = delete;
+  RetireList &operator=(const RetireList &) = delete;
+
+  /*!
+    Delete all the objects, the readers should have all exited
+   */
+  ~RetireList() {
+    for (auto &o : objs)
+      delete o.second;
+  }
+
+  /*!
+    Retire an object which has been unlinked from the shared structure
+   */
+  void retire(T *obj) {
+    objs.push_back(std::make_pair(EBR::advance(), obj));
+    collect();
+  }
+
+  /*!
+    Delete the retired objects no reader may access
+    \ret: #of objects still retired
+   */
+  usize collect() {
+    auto it = std::remove_if(objs.begin(), objs.end(),
+                             [](const std::pair<u64, T *> &o) {
+                               if (!EBR::safe(o.first))
+                                 return false;
+                               delete o.second;
+                               return true;
+                             });
+    objs.erase(it, objs.end());
+    return objs.size();
+  }
+
+  usize size() const { return objs.size(); }
+};
+
+} // namespace rdmaio
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
 #include <string>
 
 #include "../common.hh"
@@ -8,6 +11,66 @@ namespace rdmaio {
 
 using ByteBuffer = std::string;
 
+/*!
+  A non-owning view of bytes, e.g., a msg inside a received ByteBuffer.
+  So a msg can be decoded without copying it out of the buffer.
+  The viewed buffer must outlive the view.
+
+  Example:
+  `
+  ByteBuffer buf = ...;
+  ByteView v(buf);
+  auto header = Marshal::dedump<Header>(v).value();
+  auto payload = v.sub(sizeof(Header));
+  // copy it if it should outlive buf
+  ByteBuffer p = payload.to_buffer();
+  `
+ */
+class ByteView {
+  const char *ptr = nullptr;
+  usize sz = 0;
+
+public:
+  ByteView() = default;
+
+  ByteView(const char *p, const usize &sz) : ptr(p), sz(sz) {}
+
+  // implicitly view a whole buffer
+  ByteView(const ByteBuffer &b) : ptr(b.data()), sz(b.size()) {}
+
+  const char *data() const { return ptr; }
+
+  usize size() const { return sz; }
+
+  bool empty() const { return sz == 0; }
+
+  /*!
+    View [off, off + len) of this view, clamped to its end
+   */
+  ByteView sub(const usize &off, usize len = kViewEnd) const {
+    if (off >= sz)
+      return ByteView(ptr + sz, 0);
+    return ByteView(ptr + off, std::min(len, sz - off));
+  }
+
+  int compare(const ByteView &o) const {
+    auto res = memcmp(ptr, o.ptr, std::min(sz, o.sz));
+    if (res != 0)
+      return res;
+    return sz == o.sz ? 0 : (sz < o.sz ? -1 : 1);
+  }
+
+  bool operator==(const ByteView &o) const { return compare(o) == 0; }
+
+  ByteBuffer to_buffer() const { return ByteBuffer(ptr, sz); }
+
+  // so the handlers taking a ByteBuffer still accept a view (with a copy)
+  operator ByteBuffer() const { return to_buffer(); }
+
+private:
+  static constexpr const usize kViewEnd = std::numeric_limits<usize>::max();
+};
+
 /*!
   A simple, basic use of helper methods for marshaling/unmarshaling data from
   byte buffer.
@@ -26,6 +89,11 @@ using ByteBuffer = std::string;
     ByteBuffer buf = Marshal::dump(temp);
     assert(Marshal::dedump(buf).value() == temp); // note this is an option.
     `
+  3. Dump several structs into one buf, reusing its memory.
+  ` buf.clear();
+    Marshal::dump_to(temp, buf);
+    Marshal::dump_to(temp, buf);
+    `
  */
 class Marshal {
 public:
@@ -63,7 +131,15 @@ public:
     return buf;
   }
 
-  template <typename T> static Option<T> dedump(const ByteBuffer &b) {
+  /*!
+    Append t to the end of buf, which does not allocate
+    if buf has reserved enough capacity.
+   */
+  template <typename T> static void dump_to(const T &t, ByteBuffer &buf) {
+    buf.append(reinterpret_cast<const char *>(&t), sizeof(T));
+  }
+
+  template <typename T> static Option<T> dedump(const ByteView &b) {
     if (b.size() >= sizeof(T)) {
       T res;
       memcpy((char *)(&res), b.data(), sizeof(T));
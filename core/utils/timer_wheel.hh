@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "../common.hh"
+
+#include "./timer.hh"
+
+namespace rdmaio {
+
+/*!
+  A hashed timer wheel, which fires the scheduled events after a delay.
+  The time is split into ticks (of tick_usec), and an event expiring at tick t
+  is stored at slot t % num_slots. So scheduling is O(1), and advancing
+  only visits the slots passed since the last advance.
+
+  Events cannot be cancelled; instead, the user should ignore a fired event
+  that is stale, e.g., by tagging the events with a generation number.
+
+  Example:
+  `
+  TimerWheel<u32> wheel(256, 10); // 256 slots, 10us per tick
+  wheel.schedule(5, 73); // fire 73 after 5 ticks
+  ...
+  wheel.advance([](const u32 &val) {
+    // handle the expired event
+  });
+  `
+ */
+template <typename T> class TimerWheel {
+  struct Event {
+    u64 expire;
+    T val;
+  };
+  std::vector<std::vector<Event>> slots;
+
+  Timer timer;
+  u64 cur_tick = 0;
+  usize num_events = 0;
+
+public:
+  const double tick_usec;
+
+  TimerWheel(const usize &num_slots, const double &tick_usec)
+      : slots(std::max(num_slots, static_cast<usize>(1))),
+        tick_usec(tick_usec) {}
+
+  u64 now() const { return cur_tick; }
+
+  usize size() const { return num_events; }
+
+  bool empty() const { return num_events == 0; }
+
+  /*!
+    Schedule the event *val* after *delay* (at least one) ticks.
+   */
+  void schedule(const u64 &delay, const T &val) {
+    const u64 expire = cur_tick + std::max(delay, static_cast<u64>(1));
+    slots[expire % slots.size()].push_back({.expire = expire, .val = val});
+    num_events += 1;
+  }
+
+  /*!
+    Schedule the event *val* after *usec* microseconds.
+   */
+  void schedule_usec(const double &usec, const T &val) {
+    schedule(static_cast<u64>(usec / tick_usec) + 1, val);
+  }
+
+  /*!
+    Advance the wheel according to the wall clock,
+    and call f(val) for each expired event.
+    \ret #of events fired
+   */
+  template <typename F> usize advance(F &&f) {
+    const u64 target =
+        static_cast<u64>(timer.passed<std::chrono::microseconds>() / tick_usec);
+    return advance_to(target, f);
+  }
+
+  /*!
+    Advance the wheel to the tick *target*,
+    and call f(val) for each expired event.
+   */
+  template <typename F> usize advance_to(const u64 &target, F &&f) {
+    if (target <= cur_tick)
+      return 0;
+    if (num_events == 0) {
+      cur_tick = target;
+      return 0;
+    }
+
+    // each slot is visited at most once
+    const u64 steps = std::min(target - cur_tick, static_cast<u64>(slots.size()));
+    const u64 start = cur_tick;
+    cur_tick = target;
+
+    usize fired = 0;
+    for (u64 i = 1; i <= steps; ++i) {
+      auto &slot = slots[(start + i) % slots.size()];
+      for (usize j = 0; j < slot.size();) {
+        if (slot[j].expire <= target) {
+          auto val = slot[j].val;
+          // remove the event before calling f, which may schedule new ones
+          slot[j] = slot.back();
+          slot.pop_back();
+          num_events -= 1;
+          fired += 1;
+          f(val);
+        } else
+          j += 1;
+      }
+    }
+    return fired;
+  }
+};
+
+} // namespace rdmaio
@@ -37,22 +37,10 @@ int main(int argc, char **argv) {
                 .value(); // UD can send at most 4000 bytes
   char *buf = (char *)(mr->get_reg_attr().value().buf);
 
-  // 4. prepare the sender structure
-  ibv_send_wr wr;
-  ibv_sge sge;
-
-  wr.opcode = IBV_WR_SEND_WITH_IMM;
-  wr.num_sge = 1;
-  wr.imm_data = 73;
-  wr.next = nullptr;
-  wr.sg_list = &sge;
-
-  wr.wr.ud.ah = ud->create_ah(std::get<1>(fetch_qp_attr_res.desc));
-  wr.wr.ud.remote_qpn = std::get<1>(fetch_qp_attr_res.desc).qpn;
-  wr.wr.ud.remote_qkey = std::get<1>(fetch_qp_attr_res.desc).qkey;
-  wr.send_flags = IBV_SEND_SIGNALED;
-
-  sge.addr = (uintptr_t)(buf);
+  // 4. bind the local buffer to the UD, the address handler of the server
+  // will be created (and cached) at the first send_to
+  ud->bind_local_mr(mr->get_reg_attr().value());
+  auto server_attr = std::get<1>(fetch_qp_attr_res.desc);
 
   RDMA_LOG(2) << "client ready to send pingpong message to the server!";
   RDMA_LOG(2) << "try type anything~";
@@ -66,11 +54,11 @@ int main(int argc, char **argv) {
 
     memset(buf,0,msg.size() + 1);
     memcpy(buf,msg.data(),msg.size());
-    sge.length = msg.size() + 1;
-    sge.lkey = mr->get_reg_attr().value().key;
 
-    struct ibv_send_wr *bad_sr = nullptr;
-    RDMA_ASSERT(ibv_post_send(ud->qp, &wr, &bad_sr) == 0);
+    // signal the request since we will reuse the buffer at the next round
+    auto res_s = ud->send_to(server_attr, buf, msg.size() + 1, 73,
+                             IBV_SEND_SIGNALED);
+    RDMA_ASSERT(res_s == IOCode::Ok) << res_s.desc;
 
     // wait one completion
     auto ret_r = ud->wait_one_comp();
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "../core/nicinfo.hh"
+#include "../core/qps/abs_recv_allocator.hh"
+#include "../core/rmem/handler.hh"
+
+namespace test {
+
+using namespace rdmaio;
+using namespace rdmaio::qp;
+using namespace rdmaio::rmem;
+
+/*!
+  Carve the buffers from a registered RMem in order, which are never freed.
+  It is enough for the tests, which allocate the recv (and send) buffers
+  once at the start.
+ */
+class BumpAllocator : public AbsRecvAllocator {
+  RMem::raw_ptr_t buf = nullptr;
+  usize total_mem = 0;
+  mr_key_t key;
+
+public:
+  BumpAllocator(Arc<RMem> mem, mr_key_t key)
+      : buf(mem->raw_ptr), total_mem(mem->sz), key(key) {}
+
+  Option<std::pair<rmem::RMem::raw_ptr_t, rmem::mr_key_t>>
+  alloc_one(const usize &sz) override {
+    if (total_mem < sz)
+      return {};
+    auto ret = buf;
+    buf = static_cast<char *>(buf) + sz;
+    total_mem -= sz;
+    return std::make_pair(ret, key);
+  }
+
+  Option<std::pair<rmem::RMem::raw_ptr_t, rmem::RegAttr>>
+  alloc_one_for_remote(const usize &sz) override {
+    return {};
+  }
+};
+
+/*!
+  The first NIC, with an RMem registered at it,
+  and a BumpAllocator over the RMem.
+
+  Example:
+  `
+  auto env = RDMAEnv::create(4 * 1024 * 1024).value();
+  auto qp = RC::create(env.nic, QPConfig()).value();
+  auto entries = RecvEntriesFactory<BumpAllocator, 128, 1024>::create(
+      *env.alloc);
+  `
+ */
+struct RDMAEnv {
+  Arc<RNic> nic;
+  Arc<RMem> mem;
+  Arc<RegHandler> handler;
+  RegAttr mr;
+  Arc<BumpAllocator> alloc;
+
+  static Option<RDMAEnv> create(const u64 &mem_sz) {
+    auto devs = RNicInfo::query_dev_names();
+    if (devs.empty())
+      return {};
+    auto nic = RNic::create(devs.at(0));
+    if (!nic)
+      return {};
+
+    auto mem = Arc<RMem>(new RMem(mem_sz));
+    if (!mem->valid())
+      return {};
+    auto handler = RegHandler::create(mem, nic.value());
+    if (!handler)
+      return {};
+    auto mr = handler.value()->get_reg_attr().value();
+    const mr_key_t lkey = mr.lkey;
+
+    return RDMAEnv({.nic = nic.value(),
+                    .mem = mem,
+                    .handler = handler.value(),
+                    .mr = mr,
+                    .alloc = std::make_shared<BumpAllocator>(mem, lkey)});
+  }
+};
+
+} // namespace test
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+
+#include "../core/async_cm.hh"
+
+namespace test {
+
+using namespace rdmaio;
+
+TEST(AsyncCM, Servers) {
+  RCtrl ctrl0(7771);
+  RCtrl ctrl1(7772);
+
+  // a reply which does not fit in one message
+  const rpc_id_t large_id = 73;
+  ASSERT_TRUE(ctrl0.rpc.register_handler(large_id, [](const ByteView &b) {
+    return ByteBuffer(3 * kMaxMsgSz, 'a');
+  }));
+  ctrl0.start_daemon();
+  ctrl1.start_daemon();
+
+  auto cm = AsyncCM::create().value();
+  auto s0 = cm->add_server("localhost:7771").value();
+  auto s1 = cm->add_server("localhost:7772").value();
+  // no server listens on it
+  auto dead = cm->add_server("localhost:7779").value();
+  ASSERT_EQ(cm->num_servers(), 3);
+  ASSERT_FALSE(cm->add_server("localhost"));
+
+  // 1. ping all the servers concurrently
+  usize ready = 0;
+  usize timeouts = 0;
+  for (auto s : {s0, s1, dead}) {
+    auto res = cm->wait_ready(
+        s,
+        [&](Result<std::string> &res) {
+          if (res == IOCode::Ok)
+            ready += 1;
+          if (res == IOCode::Timeout)
+            timeouts += 1;
+        },
+        200000);
+    RDMA_ASSERT(res == IOCode::Ok);
+  }
+  ASSERT_EQ(cm->outstanding(), 3);
+
+  Timer t;
+  ASSERT_TRUE(cm->wait_all(1000000));
+  ASSERT_EQ(ready, 2);
+  ASSERT_EQ(timeouts, 1);
+  // the dead server only delays itself, and is retried in the meantime
+  ASSERT_LT(t.passed_msec(), 1000000);
+  ASSERT_GT(cm->stats.retries, 0);
+  ASSERT_EQ(cm->stats.timeouts, 1);
+
+  // 2. an unregistered MR is not ready
+  usize not_ready = 0;
+  cm->fetch_remote_mr(s1, 73, [&](Result<ConnectManager::mr_res_t> &res) {
+    if (res == IOCode::NotReady)
+      not_ready += 1;
+  });
+  ASSERT_TRUE(cm->wait_all(1000000));
+  ASSERT_EQ(not_ready, 1);
+
+  // 3. poll the reply of a call without callback
+  auto id = cm->call(s0, proto::FetchQPAttr,
+                     ::rdmaio::Marshal::dump<proto::QPReq>(proto::QPReq()));
+  RDMA_ASSERT(id == IOCode::Ok);
+  ASSERT_FALSE(cm->take_reply(id.desc));
+  while (cm->outstanding() > 0)
+    cm->poll();
+  auto reply = cm->take_reply(id.desc).value();
+  RDMA_ASSERT(reply == IOCode::Ok);
+  ASSERT_EQ(::rdmaio::Marshal::dedump<proto::RCReply>(reply.desc)
+                .value()
+                .status,
+            proto::CallbackStatus::NotFound);
+  ASSERT_FALSE(cm->take_reply(id.desc));
+
+  // 4. a fragmented reply fails clearly, instead of being decoded
+  usize too_large = 0;
+  cm->call(s0, large_id, ByteBuffer(1, '0'), [&](Result<ByteBuffer> &res) {
+    if (res == IOCode::Err && res.desc == "reply too large")
+      too_large += 1;
+  });
+  ASSERT_TRUE(cm->wait_all(1000000));
+  ASSERT_EQ(too_large, 1);
+
+  ctrl0.stop_daemon();
+  ctrl1.stop_daemon();
+}
+
+} // namespace test
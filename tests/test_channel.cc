@@ -67,4 +67,33 @@ TEST(Channel, Basic) {
   RDMA_LOG(2) << "check replies done, ok";
 }
 
+TEST(Channel, Batch) {
+  // more msgs than one recvmmsg/sendmmsg handles
+  const usize total_sent = kMaxBatch * 3 + 5;
+
+  auto send_c = SendChannel::create("localhost:7778").value();
+  auto recv_c = RecvChannel::create(7778).value();
+
+  for (uint i = 0; i < total_sent; ++i)
+    RDMA_ASSERT(send_c->send(Marshal::dump<u64>(i)) == IOCode::Ok);
+
+  usize count = 0;
+  for (recv_c->start(); recv_c->has_msg(); recv_c->next(), count += 1) {
+    auto &msg = recv_c->cur();
+    // the buffer is sized to the msg
+    ASSERT_EQ(msg.size(), sizeof(u64));
+    ASSERT_EQ(Marshal::dedump<u64>(msg).value(), count);
+    recv_c->reply_cur(Marshal::dump<u64>(count + 1));
+  }
+  ASSERT_EQ(count, total_sent);
+
+  // the replies are all sent once the channel finds no more msgs
+  for (uint i = 0; i < total_sent; ++i) {
+    auto reply_res = send_c->recv();
+    RDMA_ASSERT(reply_res == IOCode::Ok);
+    ASSERT_EQ(Marshal::dedump<u64>(reply_res.desc).value(), i + 1);
+  }
+  RDMA_ASSERT(send_c->recv(1000) == IOCode::Timeout);
+}
+
 } // namespace test
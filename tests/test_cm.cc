@@ -79,4 +79,63 @@ TEST(CM, QP) {
   ctrl.stop_daemon();
 }
 
+TEST(CM, RCBatch) {
+  RCtrl ctrl(6667);
+  ctrl.start_daemon();
+
+  auto res = RNicInfo::query_dev_names();
+  ASSERT_FALSE(res.empty()); // there has to be NIC on the host machine
+
+  auto nic = RNic::create(res[0]).value();
+  RDMA_ASSERT(ctrl.opened_nics.reg(0, nic));
+
+  // more QPs than one batch
+  const usize num = ConnectManager::kMaxRCBatch + 3;
+  std::vector<std::string> names;
+  std::vector<Arc<RC>> qps;
+  for (uint i = 0; i < num; ++i) {
+    names.push_back("batch_qp" + std::to_string(i));
+    qps.push_back(RC::create(nic, QPConfig()).value());
+  }
+
+  ConnectManager cm("localhost:6667");
+  if (cm.wait_ready(1000000, 2) ==
+      IOCode::Timeout) // wait 1 second for server to ready, retry 2 times
+    assert(false);
+
+  auto batch_res = cm.cc_rc_batch(names, qps, 0, QPConfig());
+  RDMA_ASSERT(batch_res == IOCode::Ok) << std::get<0>(batch_res.desc);
+  auto keys = std::get<1>(batch_res.desc);
+  ASSERT_EQ(keys.size(), num);
+
+  // each QP is connected, and its remote peer is registered
+  ASSERT_EQ(ctrl.registered_qps.reg_entries(), num);
+  for (uint i = 0; i < num; ++i) {
+    ASSERT_TRUE(ctrl.registered_qps.query(names[i]));
+    auto status = qps[i]->qp_status();
+    RDMA_ASSERT(status == IOCode::Ok);
+    ASSERT_EQ(status.desc, IBV_QPS_RTS);
+  }
+
+  // the names have been used
+  auto dup_res = cm.cc_rc_batch(
+      {names[0]}, {RC::create(nic, QPConfig()).value()}, 0, QPConfig());
+  ASSERT_TRUE(dup_res == IOCode::Err);
+  ASSERT_TRUE(std::get<1>(dup_res.desc).empty());
+
+  // the QPs created after the failed one are not left at the server
+  auto orphan_res = cm.cc_rc_batch(
+      {"fresh0", names[0], "fresh1"},
+      {RC::create(nic, QPConfig()).value(), RC::create(nic, QPConfig()).value(),
+       RC::create(nic, QPConfig()).value()},
+      0, QPConfig());
+  ASSERT_TRUE(orphan_res == IOCode::Err);
+  ASSERT_EQ(std::get<1>(orphan_res.desc).size(), 1);
+  ASSERT_TRUE(ctrl.registered_qps.query("fresh0"));
+  ASSERT_FALSE(ctrl.registered_qps.query("fresh1"));
+  ASSERT_EQ(ctrl.registered_qps.reg_entries(), num + 1);
+
+  ctrl.stop_daemon();
+}
+
 }// namespace test
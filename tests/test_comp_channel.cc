@@ -0,0 +1,65 @@
+#include <gtest/gtest.h>
+
+#include "../core/qps/mod.hh"
+
+#include "../core/qps/recv_iter.hh"
+
+#include "./rdma_env.hh"
+
+namespace test {
+
+using namespace rdmaio;
+using namespace rdmaio::qp;
+using namespace rdmaio::rmem;
+
+TEST(CompChannel, Wait) {
+  auto env = RDMAEnv::create(4 * 1024 * 1024).value();
+  auto nic = env.nic;
+
+  // block immediately if the cq is empty
+  auto ch = CompChannel::create(nic, 0).value();
+  ASSERT_GE(ch->fd(), 0);
+
+  auto ud = UD::create(nic, QPConfig(), ch).value();
+  ASSERT_TRUE(ud->valid());
+
+  auto recv_rs =
+      RecvEntriesFactory<BumpAllocator, 128, 1024>::create(*env.alloc);
+  RDMA_ASSERT(ud->post_recvs(*recv_rs, 128) == IOCode::Ok);
+
+  // 1. nothing to wait, so the waiter blocks and then timeouts
+  {
+    RecvIter<UD, 128> iter(ud, recv_rs);
+    ASSERT_FALSE(iter.has_msgs());
+    ASSERT_FALSE(iter.wait(*ch, 10000));
+    ASSERT_EQ(ch->stats.spin_hits, 0);
+    ASSERT_GE(ch->stats.blocks, 1);
+    ASSERT_EQ(ch->stats.timeouts, 1);
+  }
+
+  // 2. send a message to myself, and wait for its send and recv completions
+  ud->bind_local_mr(env.mr);
+  u64 *msg = reinterpret_cast<u64 *>(static_cast<char *>(env.mem->raw_ptr) +
+                                     2 * 1024 * 1024);
+  *msg = 73;
+  auto dest = ud->my_attr();
+  RDMA_ASSERT(ud->send_to(dest, msg, sizeof(u64), 12, IBV_SEND_SIGNALED) ==
+              IOCode::Ok);
+  auto res_s = ud->wait_one_comp(1000000);
+  RDMA_ASSERT(res_s == IOCode::Ok) << UD::wc_status(res_s.desc);
+
+  {
+    RecvIter<UD, 128> iter(ud, recv_rs);
+    if (!iter.has_msgs()) {
+      ASSERT_TRUE(iter.wait(*ch, 1000000));
+    }
+    ASSERT_TRUE(iter.has_msgs());
+    ASSERT_EQ(std::get<0>(iter.cur_msg().value()), 12);
+  }
+
+  // every wait takes one of the paths
+  const auto &s = ch->stats;
+  ASSERT_GE(s.spin_hits + s.armed_hits + s.blocks, 2);
+}
+
+} // namespace test
@@ -0,0 +1,187 @@
+#include <gtest/gtest.h>
+
+#include "../core/coro/scheduler.hh"
+#include "../core/qps/op.hh"
+
+#include "./rdma_env.hh"
+
+namespace test {
+
+using namespace rdmaio;
+using namespace rdmaio::coro;
+using namespace rdmaio::qp;
+using namespace rdmaio::rmem;
+
+class CountCoro : public Coroutine {
+  int i = 0;
+
+public:
+  std::vector<int> *trace;
+  const int rounds;
+
+  CountCoro(std::vector<int> *trace, int rounds)
+      : trace(trace), rounds(rounds) {}
+
+  CoroStatus run() override {
+    RLIB_CORO_BEGIN(this);
+    for (i = 0; i < rounds; ++i) {
+      trace->push_back(id);
+      RLIB_CORO_YIELD(this);
+    }
+    RLIB_CORO_END(this);
+  }
+};
+
+class WaitCoro : public Coroutine {
+public:
+  int step = 0;
+
+  CoroStatus run() override {
+    RLIB_CORO_BEGIN(this);
+    step = 1;
+    RLIB_CORO_WAIT(this, 2);
+    step = 2;
+    RLIB_CORO_WAIT(this, 1);
+    step = 3;
+    RLIB_CORO_END(this);
+  }
+};
+
+// each coroutine reads the u64 at the remote slot to its own local slot
+class ReadCoro : public Coroutine {
+  Arc<RC> qp;
+  u64 *remote;
+  u64 *local;
+  const mr_key_t key;
+
+  Op<> op;
+
+public:
+  const usize rounds;
+  usize done = 0;
+
+  ReadCoro(const Arc<RC> &qp, u64 *remote, u64 *local, const mr_key_t &key,
+           const usize &rounds)
+      : qp(qp), remote(remote), local(local), key(key), rounds(rounds) {}
+
+  CoroStatus run() override {
+    RLIB_CORO_BEGIN(this);
+    for (done = 0; done < rounds; ++done) {
+      *local = 0;
+      op.set_rdma_rbuf(remote, key).set_read();
+      op.set_payload(local, sizeof(u64), key);
+      RDMA_ASSERT(op.execute(qp, IBV_SEND_SIGNALED, id) == IOCode::Ok);
+      RLIB_CORO_WAIT(this, 1);
+      if (failed || *local != *remote)
+        break;
+    }
+    RLIB_CORO_END(this);
+  }
+};
+
+TEST(Coro, Yield) {
+  Scheduler s;
+  std::vector<int> trace;
+  s.spawn(std::make_shared<CountCoro>(&trace, 3));
+  s.spawn(std::make_shared<CountCoro>(&trace, 2));
+  ASSERT_EQ(s.alive_coros(), 2);
+
+  s.run();
+  ASSERT_EQ(s.alive_coros(), 0);
+
+  // the coroutines are interleaved
+  std::vector<int> expected = {0, 1, 0, 1, 0};
+  ASSERT_EQ(trace, expected);
+}
+
+TEST(Coro, Wait) {
+  Scheduler s;
+  auto c = std::make_shared<WaitCoro>();
+  auto id = s.spawn(c);
+
+  s.run_ready();
+  ASSERT_EQ(c->step, 1);
+  ASSERT_EQ(c->pending_comps, 2);
+  ASSERT_EQ(s.ready_coros(), 0);
+
+  // not resumed until all the completions arrive
+  s.complete(id);
+  ASSERT_EQ(s.ready_coros(), 0);
+  s.complete(id, IBV_WC_REM_ACCESS_ERR);
+  ASSERT_EQ(s.ready_coros(), 1);
+  ASSERT_TRUE(c->failed);
+  ASSERT_EQ(c->err_status, IBV_WC_REM_ACCESS_ERR);
+
+  s.run_ready();
+  ASSERT_EQ(c->step, 2);
+  s.complete(id);
+  s.run_ready();
+  ASSERT_EQ(c->step, 3);
+  ASSERT_EQ(s.alive_coros(), 0);
+}
+
+TEST(Coro, EarlyComp) {
+  Scheduler s;
+  auto c = std::make_shared<WaitCoro>();
+  auto id = s.spawn(c);
+
+  // the completions arrive before the coroutine waits for them
+  s.complete(id);
+  s.complete(id);
+  s.complete(id);
+  ASSERT_EQ(c->arrived, 3);
+
+  // so both waits return immediately
+  s.run_ready();
+  ASSERT_EQ(c->step, 3);
+  ASSERT_EQ(c->pending_comps, 0);
+  ASSERT_EQ(c->arrived, 0);
+  ASSERT_EQ(s.alive_coros(), 0);
+
+  // completions of unknown coroutines are ignored
+  s.complete(id + 1);
+}
+
+TEST(Coro, PollRC) {
+  auto env = RDMAEnv::create(4096).value();
+  auto nic = env.nic;
+  auto mr = env.mr;
+
+  auto qp = RC::create(nic, QPConfig()).value();
+  auto res_c = qp->connect(qp->my_attr());
+  RDMA_ASSERT(res_c == IOCode::Ok);
+
+  Scheduler s;
+  auto signaled = RC::create(nic, QPConfig()).value();
+  signaled->enable_selective_signal(16);
+  ASSERT_FALSE(s.add_qp(signaled));
+  ASSERT_TRUE(s.add_qp(qp));
+
+  u64 *slots = reinterpret_cast<u64 *>(mr.buf);
+  const mr_key_t key = mr.key;
+  slots[0] = 73;
+  const usize num_coros = 8;
+  std::vector<Arc<ReadCoro>> coros;
+  for (uint i = 0; i < num_coros; ++i) {
+    coros.push_back(
+        std::make_shared<ReadCoro>(qp, slots, slots + 1 + i, key, 100));
+    s.spawn(coros.back());
+  }
+
+  // the completions are only delivered by poll_once()
+  s.run_ready();
+  ASSERT_EQ(s.ready_coros(), 0);
+  usize polled = 0;
+  while (polled < num_coros)
+    polled += s.poll_once();
+  ASSERT_EQ(s.ready_coros(), num_coros);
+
+  s.run();
+  for (auto &c : coros) {
+    ASSERT_FALSE(c->failed);
+    ASSERT_EQ(c->done, c->rounds);
+  }
+  ASSERT_EQ(qp->progress.pending_reqs(), 0);
+}
+
+} // namespace test
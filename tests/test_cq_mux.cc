@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+
+#include "../core/nicinfo.hh"
+#include "../core/qps/mod.hh"
+
+#include "../core/qps/cq_mux.hh"
+#include "../core/qps/op.hh"
+
+namespace test {
+
+using namespace rdmaio::qp;
+using namespace rdmaio::rmem;
+using namespace rdmaio;
+
+TEST(CQMux, Basic) {
+  auto res = RNicInfo::query_dev_names();
+  ASSERT_FALSE(res.empty());
+  auto nic = std::make_shared<RNic>(res[0]);
+  ASSERT_TRUE(nic->valid());
+
+  auto mem = Arc<RMem>(new RMem(1024));
+  ASSERT_TRUE(mem->valid());
+  RegHandler handler(mem, nic);
+  ASSERT_TRUE(handler.valid());
+  auto mr = handler.get_reg_attr().value();
+
+  auto mux = CQMux::create(nic).value();
+
+  const usize num_qps = 4;
+  std::vector<Arc<RC>> qps;
+  for (uint i = 0; i < num_qps; ++i) {
+    auto qp = mux->create_rc(QPConfig()).value();
+    ASSERT_EQ(qp->cq, mux->get_cq());
+    ASSERT_EQ(qp->mux_idx, i + 1);
+
+    auto res_c = qp->connect(qp->my_attr());
+    RDMA_ASSERT(res_c == IOCode::Ok);
+    qps.push_back(qp);
+  }
+  ASSERT_EQ(mux->num_qps(), num_qps);
+
+  // a QP using its own CQ cannot be multiplexed
+  auto other = RC::create(nic, QPConfig()).value();
+  auto res_a = mux->add(other);
+  RDMA_ASSERT(res_a == IOCode::Err);
+
+  // the selective signaling polls the shared CQ by itself, so it is
+  // exclusive with the multiplexing
+  auto signaled = RC::create(nic, QPConfig(), nullptr, mux->get_cq()).value();
+  ASSERT_TRUE(signaled->enable_selective_signal(16));
+  res_a = mux->add(signaled);
+  RDMA_ASSERT(res_a == IOCode::Err);
+  ASSERT_FALSE(qps[0]->enable_selective_signal(16));
+  ASSERT_FALSE(qps[0]->selective_signaled());
+
+  // each QP reads a u64 to the slot of itself
+  u64 *test_loc = reinterpret_cast<u64 *>(mr.buf);
+  test_loc[0] = 73;
+  for (uint i = 0; i < num_qps; ++i) {
+    Op<> op;
+    op.set_rdma_rbuf(test_loc, mr.key).set_read();
+    op.set_payload(test_loc + 1 + i, sizeof(u64), mr.key);
+    auto res_s = op.execute(qps[i], IBV_SEND_SIGNALED, 12 + i);
+    RDMA_ASSERT(res_s == IOCode::Ok);
+  }
+
+  ibv_wc wcs[16];
+  RC *owners[16];
+  usize polled = 0;
+  while (polled < num_qps) {
+    auto comps = mux->poll_comps(wcs, owners);
+    for (uint i = 0; i < comps.size(); ++i) {
+      ASSERT_EQ(comps[i].status, IBV_WC_SUCCESS);
+      auto qp_idx = owners[i]->mux_idx - 1;
+      ASSERT_EQ(owners[i], qps[qp_idx].get());
+      ASSERT_EQ(comps[i].wr_id, 12 + qp_idx);
+      ASSERT_EQ(test_loc[1 + qp_idx], 73);
+    }
+    polled += comps.size();
+  }
+
+  for (auto &qp : qps) {
+    ASSERT_EQ(qp->ongoing_signaled(), 0);
+    ASSERT_EQ(qp->progress.pending_reqs(), 0);
+  }
+}
+
+} // namespace test
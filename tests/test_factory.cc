@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+
+#include "../core/utils/abs_factory.hh"
+
+namespace test {
+
+using namespace rdmaio;
+
+struct Obj {
+  u64 val;
+  explicit Obj(const u64 &v) : val(v) {}
+
+  static Option<Arc<Obj>> create(const u64 &v) {
+    return Arc<Obj>(new Obj(v));
+  }
+};
+
+TEST(Factory, Basic) {
+  Factory<std::string, Obj> f;
+  auto key = f.reg("a", Arc<Obj>(new Obj(73))).value();
+  ASSERT_FALSE(f.reg("a", Arc<Obj>(new Obj(12))));
+  ASSERT_EQ(f.reg_entries(), 1);
+
+  ASSERT_EQ(f.query("a").value()->val, 73);
+  ASSERT_FALSE(f.query("b"));
+
+  u64 visited = 0;
+  ASSERT_TRUE(f.visit("a", [&](const Arc<Obj> &o) { visited = o->val; }));
+  ASSERT_EQ(visited, 73);
+  ASSERT_FALSE(f.visit("b", [&](const Arc<Obj> &o) {}));
+
+  Obj def(12);
+  ASSERT_EQ(f.query_or_default("b", &def)->val, 12);
+  ASSERT_EQ(f.query_or_default("a", &def)->val, 73);
+
+  auto created = f.create_then_reg("c", 42).value();
+  ASSERT_EQ(f.query("c").value(), created.first);
+
+  // a wrong key cannot dereg the entry
+  ASSERT_FALSE(f.dereg("a", key + 1));
+  ASSERT_EQ(f.dereg("a", key).value()->val, 73);
+  ASSERT_FALSE(f.query("a"));
+  ASSERT_EQ(f.reg_entries(), 1);
+}
+
+TEST(EBR, Retire) {
+  struct Counted {
+    std::atomic<usize> *freed;
+    ~Counted() { *freed += 1; }
+  };
+  std::atomic<usize> freed(0);
+  RetireList<Counted> retired;
+
+  // no reader, so it is freed immediately
+  retired.retire(new Counted({.freed = &freed}));
+  ASSERT_EQ(freed, 1);
+
+  // a reader in its read section delays the reclamation
+  std::atomic<int> state(0);
+  std::thread reader([&]() {
+    EBR::Guard g;
+    state = 1;
+    while (state != 2)
+      ;
+  });
+  while (state != 1)
+    ;
+  retired.retire(new Counted({.freed = &freed}));
+  ASSERT_EQ(freed, 1);
+  ASSERT_EQ(retired.size(), 1);
+
+  state = 2;
+  reader.join();
+  ASSERT_EQ(retired.collect(), 0);
+  ASSERT_EQ(freed, 2);
+}
+
+TEST(Factory, Concurrent) {
+  Factory<u64, Obj> f;
+  const u64 num_keys = 64;
+  for (u64 i = 0; i < num_keys; ++i)
+    ASSERT_TRUE(f.reg(i, Arc<Obj>(new Obj(i))));
+
+  // readers query the stable keys, while a writer keeps updating the others
+  std::atomic<bool> running(true);
+  std::atomic<u64> queries(0);
+  std::vector<std::thread> readers;
+  for (uint t = 0; t < 4; ++t) {
+    readers.push_back(std::thread([&, t]() {
+      u64 n = 0;
+      while (running) {
+        const u64 k = (n + t) % num_keys;
+        auto o = f.query(k);
+        ASSERT_TRUE(o);
+        ASSERT_EQ(o.value()->val, k);
+        // the updated keys may or may not be found
+        auto u = f.query(num_keys + n % 8);
+        if (u) {
+          ASSERT_EQ(u.value()->val, num_keys + n % 8);
+        }
+        n += 1;
+      }
+      queries += n;
+    }));
+  }
+
+  for (uint round = 0; round < 2000; ++round) {
+    const u64 k = num_keys + round % 8;
+    auto key = f.reg(k, Arc<Obj>(new Obj(k))).value();
+    ASSERT_TRUE(f.dereg(k, key));
+  }
+  running = false;
+  for (auto &r : readers)
+    r.join();
+
+  ASSERT_GT(queries, 0);
+  ASSERT_EQ(f.reg_entries(), num_keys);
+}
+
+} // namespace test
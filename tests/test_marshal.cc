@@ -34,3 +34,26 @@ TEST(Marshal,dedump) {
   auto dedumped_val = Marshal::dedump<u64>(buf).value();
   ASSERT_EQ(dedumped_val,test_val);
 }
+
+TEST(Marshal,view) {
+  ByteBuffer buf;
+  buf.reserve(64);
+  const char *data = buf.data();
+  Marshal::dump_to<u64>(73, buf);
+  Marshal::dump_to<u32>(12, buf);
+  // no reallocation
+  ASSERT_EQ(buf.data(), data);
+  ASSERT_EQ(buf.size(), sizeof(u64) + sizeof(u32));
+
+  ByteView v(buf);
+  ASSERT_EQ(v.data(), buf.data());
+  ASSERT_EQ(Marshal::dedump<u64>(v).value(), 73);
+  ASSERT_EQ(Marshal::dedump<u32>(v.sub(sizeof(u64))).value(), 12);
+  ASSERT_FALSE(Marshal::dedump<u64>(v.sub(sizeof(u64))));
+  ASSERT_TRUE(v.sub(buf.size() + 1).empty());
+
+  ASSERT_TRUE(v == ByteView(buf));
+  ASSERT_FALSE(v.sub(1) == ByteView(buf));
+  ByteBuffer copied = v.sub(0, sizeof(u64));
+  ASSERT_EQ(copied, Marshal::dump<u64>(73));
+}
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 
 #include "../core/nicinfo.hh"
+#include "../core/rmem/alloc.hh"
 #include "../core/rmem/handler.hh"
 
 namespace test {
@@ -79,4 +80,52 @@ TEST(RMEM, Err) {
 #endif
 }
 
+TEST(RMEM, alloc_policy) {
+  // 4KB pages
+  {
+    AllocPolicy p;
+    p.page_sz = kPage4K;
+    auto mem = RMemAlloc::create(10000, p).value();
+    ASSERT_EQ(mem->page_sz, kPage4K);
+    ASSERT_EQ(mem->sz, 10000);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(mem->raw_ptr) % kPage4K, 0);
+    memset(mem->raw_ptr, 1, mem->sz);
+  }
+
+  // hugepages, which falls back to smaller pages if none is reserved
+  for (auto page : {kPage2M, kPage1G}) {
+    AllocPolicy p;
+    p.page_sz = page;
+    p.numa_node = 0; // preferred, so it never fails
+    auto mem = RMemAlloc::create(3 * 1024 * 1024, p).value();
+    ASSERT_LE(mem->page_sz, page);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(mem->raw_ptr) % mem->page_sz, 0);
+    memset(mem->raw_ptr, 1, mem->sz);
+
+    // without fallback, either the hugepages are used or it fails
+    p.fallback = false;
+    auto strict = RMemAlloc::create(3 * 1024 * 1024, p);
+    if (strict) {
+      ASSERT_EQ(strict.value()->page_sz, page);
+    }
+
+    // strictly bound, the hugepages are only used if node 0 has free ones,
+    // so touching the memory never faults with SIGBUS
+    p.fallback = true;
+    p.strict_numa = true;
+    auto bound = RMemAlloc::create(3 * 1024 * 1024, p);
+    if (bound)
+      memset(bound.value()->raw_ptr, 1, bound.value()->sz);
+  }
+
+  // a node which cannot exist
+  AllocPolicy p;
+  p.page_sz = kPage4K;
+  p.numa_node = 1000;
+  p.strict_numa = true;
+  ASSERT_FALSE(RMemAlloc::create(4096, p));
+  p.strict_numa = false;
+  ASSERT_TRUE(RMemAlloc::create(4096, p));
+}
+
 } // namespace test
@@ -54,10 +54,45 @@ TEST(BootMsg, Basic) {
     ASSERT_TRUE(iter_count < ground_truth.size());
     ASSERT_EQ(iter.cur_msg().compare(ground_truth[iter_count]),0);
     ASSERT_EQ(iter.cur_msg().compare(mss_2.query_one(iter_count).value()), 0);
+    // the view points into the msg without copying
+    ASSERT_TRUE(iter.cur_view() == ByteView(ground_truth[iter_count]));
+    ASSERT_EQ(mss_2.view_one(iter_count).value().data(),
+              std::get<0>(iter.cur()));
     iter_count += 1;
   }
 
   ASSERT_EQ(iter_count,ground_truth.size());
 }
 
+TEST(BootMsg, Batch) {
+  MsgBatch batch;
+  const char *data = batch.buffer().data();
+
+  for (uint round = 0; round < 2; ++round) {
+    ASSERT_TRUE(batch.empty());
+    ASSERT_TRUE(batch.append_struct<u64>(73 + round));
+    ASSERT_TRUE(batch.append(ByteBuffer(100, 'a' + round)));
+    ASSERT_EQ(batch.num_msg(), 2);
+
+    auto encoded = batch.buffer();
+    auto mm = MultiMsg<kMaxMsgSz>::create_from(encoded).value();
+    ASSERT_EQ(mm.num_msg(), 2);
+    ASSERT_EQ(Marshal::dedump<u64>(mm.view_one(0).value()).value(),
+              73 + round);
+    ASSERT_EQ(mm.query_one(1).value(), ByteBuffer(100, 'a' + round));
+    batch.clear();
+  }
+  // the buffer is reused
+  ASSERT_EQ(batch.buffer().data(), data);
+
+  // the batch is full
+  for (uint i = 0; i < kMaxMultiMsg; ++i)
+    ASSERT_TRUE(batch.append(ByteBuffer("x")));
+  ASSERT_FALSE(batch.fits(1, 1));
+  ASSERT_FALSE(batch.append(ByteBuffer("x")));
+  ASSERT_EQ(batch.pack().size(), sizeof(MsgsHeader) + kMaxMultiMsg);
+  ASSERT_TRUE(batch.empty());
+  ASSERT_FALSE(batch.append(ByteBuffer(kMaxMsgSz, 'x')));
+}
+
 } // namespace test
@@ -5,6 +5,7 @@
 #include "../core/utils/marshal.hh"
 
 #include "../core/qps/op.hh"
+#include "../core/qps/doorbell_batch.hh"
 
 namespace test {
 
@@ -144,4 +145,277 @@ TEST_F(OpTest, CAS) {
   ASSERT_EQ(test_loc[1], compare_data);
 }
 
+TEST_F(OpTest, BatchPoll) {
+  auto mem = Arc<RMem>(new RMem(1024));  // allocate a memory with 1K bytes
+  ASSERT_TRUE(mem->valid());
+
+  RegHandler handler(mem, nic);
+  ASSERT_TRUE(handler.valid());
+
+  auto mr = handler.get_reg_attr().value();
+  u64 *test_loc = reinterpret_cast<u64 *>(mr.buf);
+  test_loc[0] = 73;
+
+  // post a batch of signaled reads, each with a distinct user wr_id
+  const usize batch = 16;
+  Op<> op;
+  op.set_rdma_rbuf(test_loc, mr.key).set_read().set_imm(0);
+  for (uint i = 0; i < batch; ++i) {
+    ASSERT_TRUE(op.set_payload(test_loc + 1 + i, sizeof(u64), mr.key));
+    auto res_s = op.execute(qp, IBV_SEND_SIGNALED, 73 + i);
+    RDMA_ASSERT(res_s == IOCode::Ok);
+  }
+  ASSERT_EQ(qp->ongoing_signaled(), batch);
+
+  ibv_wc wcs[batch];
+  usize polled = 0;
+  while (polled < batch) {
+    auto comps = qp->poll_rc_comps(wcs);
+    ASSERT_FALSE(comps.error());
+    for (auto &wc : comps) {
+      ASSERT_EQ(wc.status, IBV_WC_SUCCESS);
+      // the user's wr_id is decoded in place
+      ASSERT_EQ(wc.wr_id, 73 + polled);
+      polled += 1;
+    }
+  }
+
+  ASSERT_EQ(qp->ongoing_signaled(), 0);
+  ASSERT_EQ(qp->progress.pending_reqs(), 0);
+  for (uint i = 0; i < batch; ++i)
+    ASSERT_EQ(test_loc[1 + i], 73);
+}
+
+TEST_F(OpTest, SelectiveSignal) {
+  auto mem = Arc<RMem>(new RMem(1024));  // allocate a memory with 1K bytes
+  ASSERT_TRUE(mem->valid());
+
+  RegHandler handler(mem, nic);
+  ASSERT_TRUE(handler.valid());
+
+  auto mr = handler.get_reg_attr().value();
+  u64 *test_loc = reinterpret_cast<u64 *>(mr.buf);
+  test_loc[0] = 73;
+
+  const usize every = 16;
+  qp->enable_selective_signal(every);
+
+  Op<> op;
+  op.set_rdma_rbuf(test_loc, mr.key).set_read().set_imm(0);
+  ASSERT_TRUE(op.set_payload(test_loc + 1, sizeof(u64), mr.key));
+
+  // post much more unsignaled requests than the send queue can hold
+  const usize total = qp->max_send_sz() * 16;
+  for (uint i = 0; i < total; ++i) {
+    auto res_s = op.execute(qp);
+    RDMA_ASSERT(res_s == IOCode::Ok) << res_s.desc;
+    ASSERT_LE(qp->progress.pending_reqs(), qp->max_send_sz());
+    ASSERT_LE(qp->ongoing_signaled(), qp->max_send_sz() / every + 1);
+  }
+
+  // every *every* requests, one is signaled
+  while (qp->ongoing_signaled() > 0) {
+    auto res_p = qp->wait_rc_comp();
+    RDMA_ASSERT(res_p == IOCode::Ok);
+  }
+  ASSERT_EQ(qp->progress.pending_reqs(), 0);
+  ASSERT_EQ(test_loc[1], 73);
+
+  qp->disable_selective_signal();
+}
+
+TEST_F(OpTest, DoorbellBatch) {
+  auto mem = Arc<RMem>(new RMem(1024));  // allocate a memory with 1K bytes
+  ASSERT_TRUE(mem->valid());
+
+  RegHandler handler(mem, nic);
+  ASSERT_TRUE(handler.valid());
+
+  auto mr = handler.get_reg_attr().value();
+  qp->bind_remote_mr(mr);
+  qp->bind_local_mr(mr);
+
+  u64 *test_loc = reinterpret_cast<u64 *>(mr.buf);
+  test_loc[0] = 73;
+
+  const usize total = 12;
+  DoorbellBatch<4> batch(qp);
+  for (uint i = 0; i < total; ++i) {
+    auto res = batch.read(0, test_loc + 1 + i, sizeof(u64), i);
+    RDMA_ASSERT(res == IOCode::Ok) << res.desc;
+    // the batch is flushed once full
+    ASSERT_EQ(batch.size(), (i + 1) % 4);
+  }
+  ASSERT_TRUE(batch.empty());
+
+  // only the last request of each batch is signaled
+  ASSERT_EQ(qp->ongoing_signaled(), total / 4);
+  while (qp->ongoing_signaled() > 0) {
+    auto res_p = qp->wait_rc_comp();
+    RDMA_ASSERT(res_p == IOCode::Ok);
+    ASSERT_EQ(std::get<0>(res_p.desc) % 4, 3);
+  }
+  ASSERT_EQ(qp->progress.pending_reqs(), 0);
+
+  for (uint i = 0; i < total; ++i)
+    ASSERT_EQ(test_loc[1 + i], 73);
+
+  // a partial batch is posted by an explicit flush
+  auto res_a = batch.faa(0, test_loc + 1, 1);
+  RDMA_ASSERT(res_a == IOCode::Ok);
+  ASSERT_EQ(batch.size(), 1);
+  auto res_f = batch.flush();
+  RDMA_ASSERT(res_f == IOCode::Ok);
+  auto res_p = qp->wait_rc_comp();
+  RDMA_ASSERT(res_p == IOCode::Ok);
+  ASSERT_EQ(test_loc[0], 74);
+}
+
+TEST_F(OpTest, GatherWrite) {
+  auto mem = Arc<RMem>(new RMem(1024));
+  ASSERT_TRUE(mem->valid());
+
+  RegHandler handler(mem, nic);
+  ASSERT_TRUE(handler.valid());
+  auto mr = handler.get_reg_attr().value();
+
+  // buf: [header, 0, 0, 0, payload, payload, remote, remote, remote]
+  u64 *test_loc = reinterpret_cast<u64 *>(mr.buf);
+  memset(test_loc, 0, 9 * sizeof(u64));
+  test_loc[0] = 73;
+  test_loc[4] = 12;
+  test_loc[5] = 13;
+
+  Op<2> op;
+  op.set_write().set_rdma_rbuf(test_loc + 6, mr.key);
+  op.set_gather(test_loc, sizeof(u64), mr.key, test_loc + 4, 2 * sizeof(u64),
+                mr.key);
+
+  // the default QP only supports one send sge
+  auto res_e = op.execute(qp, IBV_SEND_SIGNALED);
+  RDMA_ASSERT(res_e == IOCode::Err);
+
+  auto gather_qp = RC::create(nic, QPConfig().set_max_send_sge(2)).value();
+  ASSERT_TRUE(gather_qp->valid());
+  auto res_c = gather_qp->connect(gather_qp->my_attr());
+  RDMA_ASSERT(res_c == IOCode::Ok);
+
+  auto res_s = op.execute(gather_qp, IBV_SEND_SIGNALED);
+  RDMA_ASSERT(res_s == IOCode::Ok);
+  auto res_p = gather_qp->wait_one_comp();
+  RDMA_ASSERT(res_p == IOCode::Ok);
+
+  ASSERT_EQ(test_loc[6], 73);
+  ASSERT_EQ(test_loc[7], 12);
+  ASSERT_EQ(test_loc[8], 13);
+}
+
+TEST_F(OpTest, TooManySges) {
+  auto res = RC::create(nic, QPConfig().set_max_send_sge(4096));
+  ASSERT_FALSE(res);
+}
+
+TEST_F(OpTest, AutoInline) {
+  auto mem = Arc<RMem>(new RMem(1024));
+  ASSERT_TRUE(mem->valid());
+
+  RegHandler handler(mem, nic);
+  ASSERT_TRUE(handler.valid());
+  auto mr = handler.get_reg_attr().value();
+
+  ASSERT_GE(qp->max_inline_data, sizeof(u64));
+  ASSERT_EQ(qp->inline_threshold, qp->max_inline_data);
+
+  u64 *test_loc = reinterpret_cast<u64 *>(mr.buf);
+  test_loc[0] = 0;
+  u64 val = 73; // not registered, so it can only be sent inlined
+
+  Op<> op;
+  op.set_write().set_rdma_rbuf(test_loc, mr.key);
+  op.set_payload(&val, sizeof(u64), 0);
+
+  auto res_s = op.execute(qp, IBV_SEND_SIGNALED);
+  RDMA_ASSERT(res_s == IOCode::Ok);
+  auto res_p = qp->wait_one_comp();
+  RDMA_ASSERT(res_p == IOCode::Ok);
+  ASSERT_EQ(test_loc[0], 73);
+  ASSERT_EQ(qp->inlined_reqs, 1);
+
+  // reads are never inlined
+  op.set_read().set_payload(test_loc + 1, sizeof(u64), mr.key);
+  res_s = op.execute(qp, IBV_SEND_SIGNALED);
+  RDMA_ASSERT(res_s == IOCode::Ok);
+  res_p = qp->wait_one_comp();
+  RDMA_ASSERT(res_p == IOCode::Ok);
+  ASSERT_EQ(test_loc[1], 73);
+  ASSERT_EQ(qp->inlined_reqs, 1);
+  ASSERT_EQ(qp->dma_reqs, 0);
+
+  // disable the auto inline
+  qp->set_inline_threshold(0);
+  test_loc[2] = 12;
+  op.set_write().set_rdma_rbuf(test_loc, mr.key);
+  op.set_payload(test_loc + 2, sizeof(u64), mr.key);
+  res_s = op.execute(qp, IBV_SEND_SIGNALED);
+  RDMA_ASSERT(res_s == IOCode::Ok);
+  res_p = qp->wait_one_comp();
+  RDMA_ASSERT(res_p == IOCode::Ok);
+  ASSERT_EQ(test_loc[0], 12);
+  ASSERT_EQ(qp->dma_reqs, 1);
+}
+
+static void count_comp(void *ctx, const ibv_wc &wc) {
+  RDMA_ASSERT(wc.status == IBV_WC_SUCCESS) << RC::wc_status(wc);
+  *(reinterpret_cast<int *>(ctx)) += 1;
+}
+
+TEST_F(OpTest, Async) {
+  auto mem = Arc<RMem>(new RMem(1024));
+  ASSERT_TRUE(mem->valid());
+
+  RegHandler handler(mem, nic);
+  ASSERT_TRUE(handler.valid());
+  auto mr = handler.get_reg_attr().value();
+
+  u64 *test_loc = reinterpret_cast<u64 *>(mr.buf);
+  test_loc[0] = 73;
+
+  const int num = 16;
+  int done[num] = {0};
+
+  // 1. each op is signaled
+  Op<> op;
+  op.set_rdma_rbuf(test_loc, mr.key).set_read();
+  for (int i = 0; i < num; ++i) {
+    op.set_payload(test_loc + 1 + i, sizeof(u64), mr.key);
+    auto res_s = op.execute_async(qp, count_comp, &done[i]);
+    RDMA_ASSERT(res_s == IOCode::Ok);
+  }
+
+  ibv_wc wcs[num];
+  int polled = 0;
+  while (polled < num)
+    polled += qp->poll_rc_comps(wcs).size();
+  for (int i = 0; i < num; ++i) {
+    ASSERT_EQ(done[i], 1);
+    ASSERT_EQ(test_loc[1 + i], 73);
+  }
+
+  // 2. with selective signaling, a covering completion fires all the ops
+  qp->enable_selective_signal(num * 2);
+  for (int i = 0; i < num; ++i) {
+    op.set_payload(test_loc + 1 + i, sizeof(u64), mr.key);
+    auto res_s = op.execute_async(qp, count_comp, &done[i],
+                                  i == num - 1 ? IBV_SEND_SIGNALED : 0);
+    RDMA_ASSERT(res_s == IOCode::Ok);
+  }
+  ASSERT_EQ(qp->ongoing_signaled(), 1);
+
+  auto res_p = qp->wait_rc_comp();
+  RDMA_ASSERT(res_p == IOCode::Ok);
+  for (int i = 0; i < num; ++i)
+    ASSERT_EQ(done[i], 2);
+  ASSERT_EQ(qp->progress.pending_reqs(), 0);
+}
+
 }  // namespace test
@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+
+#include <set>
+#include <thread>
+
+#include "../core/qps/mod.hh"
+#include "../core/qps/pool_allocator.hh"
+
+namespace test {
+
+using namespace rdmaio;
+using namespace rdmaio::qp;
+using namespace rdmaio::rmem;
+
+// a fake registration, so the pool can be tested without a NIC
+static RegAttr fake_attr(Arc<RMem> mem) {
+  return RegAttr({.buf = reinterpret_cast<uintptr_t>(mem->raw_ptr),
+                  .sz = mem->sz,
+                  .key = 73,
+                  .lkey = 12});
+}
+
+TEST(PoolAllocator, Classes) {
+  auto mem = Arc<RMem>(new RMem(1024 * 1024));
+  auto pool = PoolAllocator::create(mem, fake_attr(mem), {4096, 64, 1024})
+                  .value();
+  ASSERT_EQ(pool->num_classes(), 3);
+  ASSERT_EQ(pool->class_sz(1), 64);
+  ASSERT_EQ(pool->class_sz(64), 64);
+  ASSERT_EQ(pool->class_sz(65), 1024);
+  ASSERT_EQ(pool->class_sz(4096), 4096);
+  ASSERT_EQ(pool->class_sz(4097), 0);
+  ASSERT_FALSE(pool->alloc_one(4097));
+
+  auto res = pool->alloc_one(100).value();
+  ASSERT_EQ(std::get<1>(res), 12);
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(std::get<0>(res)) %
+                static_cast<uintptr_t>(PoolAllocator::kAlign),
+            0);
+
+  auto res_r = pool->alloc_one_for_remote(100).value();
+  ASSERT_EQ(std::get<1>(res_r).key, 73);
+  ASSERT_EQ(reinterpret_cast<char *>(std::get<0>(res_r)) -
+                reinterpret_cast<char *>(std::get<0>(res)),
+            1024);
+}
+
+TEST(PoolAllocator, Reuse) {
+  auto mem = Arc<RMem>(new RMem(1024 * 1024));
+  auto pool = PoolAllocator::create(mem, fake_attr(mem)).value();
+
+  auto ptr = std::get<0>(pool->alloc_one(200).value());
+  pool->dealloc_one(ptr, 200);
+  ASSERT_EQ(std::get<0>(pool->alloc_one(256).value()), ptr);
+  // the class of 1024 does not use the freed buffer
+  ASSERT_NE(std::get<0>(pool->alloc_one(1024).value()), ptr);
+
+  // allocate until the region runs out, then free them all
+  std::vector<RMem::raw_ptr_t> bufs;
+  for (auto res = pool->alloc_one(4096); res; res = pool->alloc_one(4096))
+    bufs.push_back(std::get<0>(res.value()));
+  ASSERT_GT(bufs.size(), 200);
+  ASSERT_LE(pool->carved_bytes(), mem->sz);
+  ASSERT_EQ(std::set<RMem::raw_ptr_t>(bufs.begin(), bufs.end()).size(),
+            bufs.size());
+
+  for (auto b : bufs)
+    pool->dealloc_one(b, 4096);
+  const auto carved = pool->carved_bytes();
+  for (uint i = 0; i < bufs.size(); ++i)
+    ASSERT_TRUE(pool->alloc_one(4096));
+  ASSERT_EQ(pool->carved_bytes(), carved);
+}
+
+TEST(PoolAllocator, Threads) {
+  auto mem = Arc<RMem>(new RMem(4 * 1024 * 1024));
+  auto pool = PoolAllocator::create(mem, fake_attr(mem)).value();
+
+  const usize num_threads = 4;
+  const usize per_thread = 256;
+
+  // each thread allocates some buffers, writes them, and frees them
+  std::vector<std::thread> threads;
+  for (uint t = 0; t < num_threads; ++t) {
+    threads.push_back(std::thread([&pool, t]() {
+      for (uint round = 0; round < 16; ++round) {
+        std::vector<u64 *> bufs;
+        for (uint i = 0; i < per_thread; ++i) {
+          auto buf = static_cast<u64 *>(
+              std::get<0>(pool->alloc_one(1024).value()));
+          *buf = t;
+          bufs.push_back(buf);
+        }
+        for (auto b : bufs) {
+          ASSERT_EQ(*b, t);
+          pool->dealloc_one(b, 1024);
+        }
+      }
+    }));
+  }
+  for (auto &t : threads)
+    t.join();
+
+  // the buffers cached by the threads are returned once they exit,
+  // so the region is carved for one round of all threads at most
+  const auto carved = pool->carved_bytes();
+  ASSERT_LE(carved, (num_threads * per_thread + PoolAllocator::kCacheBatch *
+                                                    num_threads * 2) *
+                        1024);
+  // all the carved buffers are free again
+  for (uint i = 0; i < carved / 1024; ++i)
+    ASSERT_TRUE(pool->alloc_one(1024));
+  ASSERT_EQ(pool->carved_bytes(), carved);
+}
+
+TEST(PoolAllocator, ReleaseEntries) {
+  auto mem = Arc<RMem>(new RMem(1024 * 1024));
+  auto pool = PoolAllocator::create(mem, fake_attr(mem)).value();
+
+  auto entries = RecvEntriesFactory<PoolAllocator, 128, 1000>::create(*pool);
+  const auto carved = pool->carved_bytes();
+  ASSERT_GE(carved, 128 * 1024);
+
+  release_recv_entries(*entries, *pool);
+  ASSERT_EQ(entries->sges[0].addr, 0);
+
+  auto again = RecvEntriesFactory<PoolAllocator, 128, 1000>::create(*pool);
+  ASSERT_EQ(pool->carved_bytes(), carved);
+}
+
+} // namespace test
@@ -0,0 +1,223 @@
+#include <gtest/gtest.h>
+
+#include "../core/rpc/rc_transport.hh"
+#include "../core/rpc/rpc.hh"
+#include "../core/rpc/rud_transport.hh"
+#include "../core/rpc/ud_transport.hh"
+
+#include "./rdma_env.hh"
+
+namespace test {
+
+using namespace rdmaio;
+using namespace rdmaio::rmem;
+using namespace rdmaio::rpc;
+
+struct CallCtx {
+  usize replies = 0;
+  u64 sum = 0;
+};
+
+static void count_reply(void *ctx, const MsgView &reply) {
+  auto c = static_cast<CallCtx *>(ctx);
+  RDMA_ASSERT(reply.status == ReplyStatus::Ok);
+  RDMA_ASSERT(reply.len == sizeof(u64));
+  c->replies += 1;
+  c->sum += *(reinterpret_cast<const u64 *>(reply.payload));
+}
+
+// add one to the u64 parameter
+static u32 add_one(const MsgView &req, char *reply, const u32 &cap) {
+  RDMA_ASSERT(req.len == sizeof(u64));
+  *(reinterpret_cast<u64 *>(reply)) =
+      *(reinterpret_cast<const u64 *>(req.payload)) + 1;
+  return sizeof(u64);
+}
+
+/*!
+  Issue *total* calls to the peer, with at most W outstanding ones
+ */
+template <class T, usize W>
+static void run_calls(RPC<T, W> &rpc, const peer_id_t &peer,
+                      const usize &total) {
+  CallCtx ctx;
+  u64 expected = 0;
+  usize issued = 0;
+  while (ctx.replies < total) {
+    while (issued < total) {
+      u64 arg = issued;
+      auto res = rpc.call(peer, 73, &arg, sizeof(u64), count_reply, &ctx);
+      if (res == IOCode::NotReady)
+        break;
+      RDMA_ASSERT(res == IOCode::Ok);
+      expected += issued + 1;
+      issued += 1;
+    }
+    ASSERT_LE(rpc.outstanding_calls(), W);
+    rpc.poll();
+  }
+  ASSERT_EQ(ctx.sum, expected);
+  ASSERT_EQ(rpc.outstanding_calls(), 0);
+}
+
+TEST(RDMARPC, UD) {
+  auto env = RDMAEnv::create(32 * 1024 * 1024).value();
+  auto nic = env.nic;
+  Arc<AbsRecvAllocator> alloc = env.alloc;
+
+  auto ud = UD::create(nic, QPConfig()).value();
+  auto t = UDTransport<>::create(ud, alloc).value();
+
+  // the RPC calls itself
+  RPC<UDTransport<>> rpc(t);
+  ASSERT_TRUE(rpc.register_handler(73, add_one));
+  ASSERT_FALSE(rpc.register_handler(73, add_one));
+  auto peer = t->add_peer(ud->my_attr());
+  ASSERT_EQ(peer, t->add_peer(ud->my_attr()));
+
+  run_calls(rpc, peer, 4096);
+
+  // call an unregistered rpc
+  CallCtx ctx;
+  auto res_c = rpc.call(peer, 12, nullptr, 0,
+                        [](void *ctx, const MsgView &reply) {
+                          RDMA_ASSERT(reply.status == ReplyStatus::NoHandler);
+                          static_cast<CallCtx *>(ctx)->replies += 1;
+                        },
+                        &ctx);
+  RDMA_ASSERT(res_c == IOCode::Ok);
+  while (ctx.replies == 0)
+    rpc.poll();
+}
+
+TEST(RDMARPC, Timeout) {
+  auto env = RDMAEnv::create(32 * 1024 * 1024).value();
+  auto nic = env.nic;
+  Arc<AbsRecvAllocator> alloc = env.alloc;
+
+  auto ud = UD::create(nic, QPConfig()).value();
+  auto t = UDTransport<>::create(ud, alloc).value();
+
+  // the peer posts no recv entries, so all the requests are lost
+  auto lost = UD::create(nic, QPConfig()).value();
+  RPC<UDTransport<>, 4> rpc(t, 1000);
+  auto peer = t->add_peer(lost->my_attr());
+
+  CallCtx ctx;
+  auto expire_cb = [](void *ctx, const MsgView &reply) {
+    RDMA_ASSERT(reply.status == ReplyStatus::Timeout);
+    static_cast<CallCtx *>(ctx)->replies += 1;
+  };
+  // more calls than W, so the slots must be freed by the expiration
+  usize issued = 0;
+  for (Timer timer; ctx.replies < 8 && timer.passed_sec() < 1;) {
+    u64 arg = issued;
+    auto res_c = rpc.call(peer, 73, &arg, sizeof(u64), expire_cb, &ctx);
+    if (res_c == IOCode::Ok)
+      issued += 1;
+    rpc.poll();
+  }
+  ASSERT_GE(ctx.replies, 8);
+  ASSERT_EQ(issued - ctx.replies, rpc.outstanding_calls());
+}
+
+TEST(RDMARPC, ReliableUD) {
+  auto env = RDMAEnv::create(32 * 1024 * 1024).value();
+  auto nic = env.nic;
+  Arc<AbsRecvAllocator> alloc = env.alloc;
+
+  auto ud = UD::create(nic, QPConfig()).value();
+  auto t = RUDTransport<>::create(ud, alloc, 1000, 1).value();
+
+  RPC<RUDTransport<>> rpc(t);
+  ASSERT_TRUE(rpc.register_handler(73, add_one));
+  auto peer = t->add_peer(ud->my_attr()).value();
+  ASSERT_EQ(t->credits_per_peer(), 2048 / 2);
+
+  // the credits are fixed by max_peers, so no more peers fit in
+  auto ud1 = UD::create(nic, QPConfig()).value();
+  ASSERT_FALSE(t->add_peer(ud1->my_attr()));
+  ASSERT_FALSE(RUDTransport<>::create(ud1, alloc, 1000, 2048));
+
+  run_calls(rpc, peer, 4096);
+
+  // all the data are acked eventually
+  for (Timer timer; t->unacked(peer) > 0 && timer.passed_sec() < 1;)
+    rpc.poll();
+  ASSERT_EQ(t->unacked(peer), 0);
+}
+
+TEST(RDMARPC, RC) {
+  auto env = RDMAEnv::create(32 * 1024 * 1024).value();
+  auto nic = env.nic;
+  Arc<AbsRecvAllocator> alloc = env.alloc;
+
+  auto recv_cq_res = Impl::create_cq(nic, 1024);
+  RDMA_ASSERT(recv_cq_res == IOCode::Ok);
+  auto recv_cq = std::get<0>(recv_cq_res.desc);
+
+  {
+    // the QP is connected to itself, so it is both the client and the server
+    auto qp = RC::create(nic, QPConfig(), recv_cq).value();
+    auto res_c = qp->connect(qp->my_attr());
+    RDMA_ASSERT(res_c == IOCode::Ok);
+
+    auto t = RCTransport<>::create(recv_cq, alloc).value();
+    auto peer = t->add_peer(qp).value();
+    ASSERT_TRUE(qp->selective_signaled());
+
+    RPC<RCTransport<>, 32> rpc(t);
+    ASSERT_TRUE(rpc.register_handler(73, add_one));
+
+    run_calls(rpc, peer, 4096);
+  }
+  ibv_destroy_cq(recv_cq);
+}
+
+TEST(RDMARPC, RCCredits) {
+  auto env = RDMAEnv::create(32 * 1024 * 1024).value();
+  auto nic = env.nic;
+  Arc<AbsRecvAllocator> alloc = env.alloc;
+
+  auto recv_cq_res = Impl::create_cq(nic, 1024);
+  RDMA_ASSERT(recv_cq_res == IOCode::Ok);
+  auto recv_cq = std::get<0>(recv_cq_res.desc);
+
+  {
+    // no RNR retry, so the QP fails if the sender outruns the receiver
+    auto qp = RC::create(nic, QPConfig().set_rnr(0, 1), recv_cq).value();
+    auto res_c = qp->connect(qp->my_attr());
+    RDMA_ASSERT(res_c == IOCode::Ok);
+
+    const usize R = 64;
+    auto t = RCTransport<R>::create(recv_cq, alloc).value();
+    auto peer = t->add_peer(qp).value();
+    ASSERT_EQ(t->credits(peer), R - RCTransport<R>::kCreditReserve);
+
+    // a burst larger than the recv entries, without polling
+    for (u64 i = 0; i < R; ++i) {
+      auto buf = t->get_send_buf(peer);
+      *(reinterpret_cast<u64 *>(buf)) = i;
+      RDMA_ASSERT(t->send(peer, buf, sizeof(u64)) == IOCode::Ok);
+    }
+    RDMA_ASSERT(t->flush() == IOCode::Ok);
+    ASSERT_EQ(t->credits(peer), 0);
+    ASSERT_EQ(t->backlogged(peer), RCTransport<R>::kCreditReserve);
+
+    // the backlog is posted once the credits return
+    u64 recved = 0;
+    for (Timer timer; recved < R && timer.passed_sec() < 1;) {
+      t->poll_msgs([&recved](const peer_id_t &p, char *msg, const u32 &len) {
+        ASSERT_EQ(len, sizeof(u64));
+        ASSERT_EQ(*(reinterpret_cast<u64 *>(msg)), recved);
+        recved += 1;
+      });
+      RDMA_ASSERT(t->flush() == IOCode::Ok);
+    }
+    ASSERT_EQ(recved, R);
+    ASSERT_EQ(t->backlogged(peer), 0);
+  }
+  ibv_destroy_cq(recv_cq);
+}
+
+} // namespace test
@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 
+#include <thread>
+
 #include "../core/bootstrap/srpc.hh"
 
 namespace test {
@@ -43,4 +45,203 @@ TEST(RPC, Basic) {
   }
 }
 
+TEST(RPC, Workers) {
+  SRpcHandler handler(1112);
+
+  // a slow RPC, e.g., creating a QP
+  const rpc_id_t slow_id = 73;
+  ASSERT_TRUE(handler.register_handler(slow_id, [](const ByteBuffer &b) {
+    usleep(200000);
+    return b;
+  }));
+
+  // a handler which is not thread-safe
+  const rpc_id_t serial_id = 74;
+  std::atomic<usize> inside(0);
+  std::atomic<usize> max_inside(0);
+  ASSERT_TRUE(handler.register_handler(
+      serial_id,
+      [&](const ByteBuffer &b) {
+        auto n = ++inside;
+        if (n > max_inside)
+          max_inside = n;
+        usleep(20000);
+        inside -= 1;
+        return b;
+      },
+      true));
+
+  const usize num = 4;
+  handler.start_workers(num);
+  ASSERT_EQ(handler.num_workers(), num);
+
+  std::atomic<bool> running(true);
+  std::thread loop([&]() {
+    while (running)
+      handler.run_one_event_loop();
+  });
+
+  std::vector<Arc<SRpc>> clients;
+  for (uint i = 0; i < num; ++i) {
+    clients.push_back(std::make_shared<SRpc>("localhost:1112"));
+    auto res = clients[i]->call(slow_id, ByteBuffer(i + 1, '0' + i));
+    RDMA_ASSERT(res == IOCode::Ok);
+  }
+
+  // the heartbeat is not queued after the slow calls
+  Timer t;
+  SRpc ping("localhost:1112");
+  RDMA_ASSERT(ping.call(RCtrlBinderIdType::HeartBeat, ByteBuffer(1, '0')) ==
+              IOCode::Ok);
+  auto res_p = ping.receive_reply(1000000, true);
+  RDMA_ASSERT(res_p == IOCode::Ok);
+  ASSERT_LT(t.passed_msec(), 150000);
+
+  // the slow calls are served in parallel
+  for (uint i = 0; i < num; ++i) {
+    auto res_reply = clients[i]->receive_reply(1000000);
+    RDMA_ASSERT(res_reply == IOCode::Ok);
+    ASSERT_EQ(res_reply.desc, ByteBuffer(i + 1, '0' + i));
+  }
+  ASSERT_LT(t.passed_msec(), num * 200000);
+
+  // the calls of a serialized handler do not overlap, even with workers
+  for (uint i = 0; i < num; ++i)
+    RDMA_ASSERT(clients[i]->call(serial_id, ByteBuffer(1, '0' + i)) ==
+                IOCode::Ok);
+  for (uint i = 0; i < num; ++i) {
+    auto res_reply = clients[i]->receive_reply(1000000);
+    RDMA_ASSERT(res_reply == IOCode::Ok);
+    ASSERT_EQ(res_reply.desc, ByteBuffer(1, '0' + i));
+  }
+  ASSERT_EQ(max_inside, 1);
+
+  running = false;
+  loop.join();
+  handler.stop_workers();
+  ASSERT_EQ(handler.num_workers(), 0);
+}
+
+TEST(RPC, Pipelined) {
+  SRpcHandler handler(1113);
+  const rpc_id_t echo_id = 73;
+  const rpc_id_t slow_id = 74;
+  ASSERT_TRUE(handler.register_handler(
+      echo_id, [](const ByteBuffer &b) -> ByteBuffer { return b + b; }));
+  ASSERT_TRUE(handler.register_handler(slow_id, [](const ByteBuffer &b) {
+    usleep(300000);
+    return b;
+  }));
+
+  std::atomic<bool> running(true);
+  std::thread loop([&]() {
+    while (running)
+      handler.run_one_event_loop();
+  });
+
+  SRpc rpc("localhost:1113");
+  rpc.window = 16;
+
+  // 1. many outstanding calls, several batched per datagram
+  std::vector<std::pair<u64, ByteBuffer>> calls;
+  for (uint i = 0; i < 64; ++i) {
+    ByteBuffer param(i % 7 + 1, 'a' + i % 26);
+    auto res = rpc.call_async(echo_id, param);
+    if (res == IOCode::NotReady) {
+      // the window is full, wait for the oldest call
+      ASSERT_EQ(rpc.outstanding_calls(), rpc.window);
+      auto reply = rpc.wait_reply(calls.front().first);
+      RDMA_ASSERT(reply == IOCode::Ok);
+      ASSERT_EQ(reply.desc, calls.front().second + calls.front().second);
+      calls.erase(calls.begin());
+      res = rpc.call_async(echo_id, param);
+    }
+    RDMA_ASSERT(res == IOCode::Ok);
+    calls.push_back(std::make_pair(res.desc, param));
+  }
+  // the replies are taken out of order
+  std::reverse(calls.begin(), calls.end());
+  for (auto &c : calls) {
+    auto reply = rpc.wait_reply(c.first);
+    RDMA_ASSERT(reply == IOCode::Ok);
+    ASSERT_EQ(reply.desc, c.second + c.second);
+  }
+  ASSERT_EQ(rpc.outstanding_calls(), 0);
+  ASSERT_FALSE(rpc.take_reply(calls.front().first));
+
+  // 2. a call timeouts, and its late reply does not break the next call
+  auto slow = rpc.call_async(slow_id, ByteBuffer("slow"), 100000);
+  RDMA_ASSERT(slow == IOCode::Ok);
+  auto slow_reply = rpc.wait_reply(slow.desc);
+  RDMA_ASSERT(slow_reply == IOCode::Timeout);
+
+  RDMA_ASSERT(rpc.call(echo_id, ByteBuffer("x")) == IOCode::Ok);
+  auto reply = rpc.receive_reply(1000000);
+  RDMA_ASSERT(reply == IOCode::Ok);
+  ASSERT_EQ(reply.desc, ByteBuffer("xx"));
+  ASSERT_EQ(rpc.stale_replies, 1);
+
+  running = false;
+  loop.join();
+}
+
+static ByteBuffer pattern(const usize &sz) {
+  ByteBuffer res(sz, '\0');
+  for (usize i = 0; i < sz; ++i)
+    res[i] = 'a' + (i * 7) % 26;
+  return res;
+}
+
+TEST(RPC, Large) {
+  SRpcHandler handler(1114);
+  const rpc_id_t echo_id = 73;
+  const rpc_id_t gen_id = 74;
+  ASSERT_TRUE(handler.register_handler(
+      echo_id, [](const ByteView &b) -> ByteBuffer { return b; }));
+  ASSERT_TRUE(handler.register_handler(gen_id, [](const ByteView &b) {
+    return pattern(Marshal::dedump<u64>(b).value());
+  }));
+
+  std::atomic<bool> running(true);
+  std::thread loop([&]() {
+    while (running)
+      handler.run_one_event_loop();
+  });
+
+  SRpc rpc("localhost:1114");
+
+  // 1. both the request and the reply are fragmented
+  for (usize sz : std::vector<usize>(
+           {kMaxFragSz - 100, kMaxFragSz * 3, 300 * 1024 + 73})) {
+    auto param = pattern(sz);
+    RDMA_ASSERT(rpc.call(echo_id, param) == IOCode::Ok);
+    auto reply = rpc.receive_reply(1000000);
+    RDMA_ASSERT(reply == IOCode::Ok) << reply.desc;
+    ASSERT_EQ(reply.desc.size(), sz);
+    ASSERT_EQ(reply.desc, param);
+  }
+
+  // 2. a large reply of an async call
+  std::vector<u64> ids;
+  for (u64 sz : {1024, 100 * 1024, 1024 * 1024}) {
+    auto res = rpc.call_async(gen_id, Marshal::dump<u64>(sz));
+    RDMA_ASSERT(res == IOCode::Ok);
+    ids.push_back(res.desc);
+  }
+  for (auto sz : {1024, 100 * 1024, 1024 * 1024}) {
+    auto reply = rpc.wait_reply(ids.front());
+    ids.erase(ids.begin());
+    RDMA_ASSERT(reply == IOCode::Ok) << reply.desc;
+    ASSERT_EQ(reply.desc, pattern(sz));
+  }
+  ASSERT_EQ(rpc.outstanding_calls(), 0);
+
+  // 3. the request exceeds the limit
+  auto res = rpc.call(echo_id, ByteBuffer(kMaxLargeMsgSz + 1, 'x'));
+  RDMA_ASSERT(res != IOCode::Ok);
+
+  running = false;
+  loop.join();
+}
+
 } // namespace test
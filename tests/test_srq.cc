@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+
+#include "../core/qps/mod.hh"
+
+#include "../core/qps/recv_iter.hh"
+#include "../core/qps/srq.hh"
+
+#include "./rdma_env.hh"
+
+namespace test {
+
+using namespace rdmaio;
+using namespace rdmaio::qp;
+using namespace rdmaio::rmem;
+
+TEST(SRQ, Basic) {
+  auto env = RDMAEnv::create(4 * 1024 * 1024).value();
+  auto nic = env.nic;
+  Arc<AbsRecvAllocator> alloc = env.alloc;
+
+  const usize srq_depth = 256;
+  auto srq = SRQ<srq_depth>::create(nic, alloc, 1024, 16).value();
+  ASSERT_EQ(srq->posted, srq_depth);
+
+  // two receivers share the SRQ, each connected to a sender
+  const usize num_qps = 2;
+  std::vector<Arc<RC>> senders;
+  std::vector<Arc<RC>> receivers;
+  for (uint i = 0; i < num_qps; ++i) {
+    auto sender = RC::create(nic, QPConfig()).value();
+    auto receiver =
+        RC::create(nic, QPConfig(), srq->recv_cq, nullptr, srq->srq).value();
+
+    auto res_c = sender->connect(receiver->my_attr());
+    RDMA_ASSERT(res_c == IOCode::Ok);
+    res_c = receiver->connect(sender->my_attr());
+    RDMA_ASSERT(res_c == IOCode::Ok);
+
+    senders.push_back(sender);
+    receivers.push_back(receiver);
+  }
+
+  // more messages than the SRQ depth, so the buffers must be reposted
+  const usize rounds = 4;
+  usize recved_msgs[num_qps] = {0};
+  for (uint r = 0; r < rounds; ++r) {
+    for (uint i = 0; i < num_qps; ++i) {
+      for (uint j = 0; j < srq_depth / num_qps / 2; ++j) {
+        u64 msg = j;
+        auto res_s = senders[i]->send_normal(
+            {.op = IBV_WR_SEND_WITH_IMM,
+             .flags = IBV_SEND_SIGNALED,
+             .len = sizeof(u64),
+             .wr_id = 0},
+            {.local_addr = reinterpret_cast<RMem::raw_ptr_t>(&msg),
+             .remote_addr = 0,
+             .imm_data = i},
+            env.mr, env.mr);
+        RDMA_ASSERT(res_s == IOCode::Ok);
+        auto res_p = senders[i]->wait_one_comp();
+        RDMA_ASSERT(res_p == IOCode::Ok) << RC::wc_status(res_p.desc);
+      }
+    }
+
+    usize recved = 0;
+    while (recved < srq_depth / 2) {
+      for (RecvIter<SRQ<srq_depth>, 64> iter(srq, srq->wcs); iter.has_msgs();
+           iter.next()) {
+        auto imm_msg = iter.cur_msg().value();
+        auto qp_idx = std::get<0>(imm_msg);
+        ASSERT_LT(qp_idx, num_qps);
+        ASSERT_EQ(iter.cur_qp_num(), receivers[qp_idx]->qp->qp_num);
+        ASSERT_EQ(*(reinterpret_cast<u64 *>(std::get<1>(imm_msg))),
+                  recved_msgs[qp_idx] % (srq_depth / num_qps / 2));
+        recved_msgs[qp_idx] += 1;
+        recved += 1;
+      }
+    }
+  }
+  ASSERT_EQ(recved_msgs[0], rounds * srq_depth / num_qps / 2);
+  ASSERT_EQ(recved_msgs[1], rounds * srq_depth / num_qps / 2);
+  ASSERT_EQ(srq->posted + srq->pending_refill(), srq_depth);
+}
+
+} // namespace test
@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+
+#include "../core/utils/timer_wheel.hh"
+
+namespace test {
+
+using namespace rdmaio;
+
+TEST(TimerWheel, Basic) {
+  TimerWheel<u64> wheel(8, 10);
+  std::vector<u64> fired;
+  auto record = [&fired](const u64 &v) { fired.push_back(v); };
+
+  wheel.schedule(3, 3);
+  wheel.schedule(1, 1);
+  // longer than one round of the wheel
+  wheel.schedule(20, 20);
+  ASSERT_EQ(wheel.size(), 3);
+
+  ASSERT_EQ(wheel.advance_to(1, record), 1);
+  ASSERT_EQ(fired.back(), 1);
+
+  // the event at the same slot of a later round is not fired
+  ASSERT_EQ(wheel.advance_to(4, record), 1);
+  ASSERT_EQ(fired.back(), 3);
+  ASSERT_EQ(wheel.advance_to(12, record), 0);
+
+  // skip more than one round at once
+  ASSERT_EQ(wheel.advance_to(100, record), 1);
+  ASSERT_EQ(fired.back(), 20);
+  ASSERT_TRUE(wheel.empty());
+}
+
+TEST(TimerWheel, Reschedule) {
+  TimerWheel<u64> wheel(4, 10);
+  usize count = 0;
+
+  // an event re-schedules itself until fired 10 times
+  wheel.schedule(2, 0);
+  for (u64 t = 1; t < 100; ++t) {
+    wheel.advance_to(t, [&](const u64 &v) {
+      count += 1;
+      if (v + 1 < 10)
+        wheel.schedule(2, v + 1);
+    });
+  }
+  ASSERT_EQ(count, 10);
+  ASSERT_TRUE(wheel.empty());
+}
+
+TEST(TimerWheel, Clock) {
+  TimerWheel<u64> wheel(64, 100);
+  wheel.schedule_usec(1000, 73);
+
+  usize fired = 0;
+  Timer t;
+  while (fired == 0)
+    fired += wheel.advance([](const u64 &v) { ASSERT_EQ(v, 73); });
+  ASSERT_GE(t.passed_msec(), 1000);
+}
+
+} // namespace test
@@ -124,4 +124,87 @@ TEST(UD, Create) {
   ASSERT_EQ(recved_msgs, 1024);
 }
 
+TEST(UD, SendBatch) {
+  auto res = RNicInfo::query_dev_names();
+  ASSERT_FALSE(res.empty());
+  auto nic = std::make_shared<RNic>(res[0]);
+  ASSERT_TRUE(nic->valid());
+
+  auto ud = UD::create(nic, QPConfig()).value();
+  ASSERT_TRUE(ud->valid());
+
+  auto mem = Arc<RMem>(new RMem(16 * 1024 * 1024));
+  ASSERT_TRUE(mem->valid());
+
+  auto handler = RegHandler::create(mem, nic).value();
+  SimpleAllocator alloc(mem, handler->get_reg_attr().value().key);
+
+  auto recv_rs = RecvEntriesFactory<SimpleAllocator, 1024, 1000>::create(alloc);
+  {
+    auto res = ud->post_recvs(*recv_rs, 1024);
+    RDMA_ASSERT(res == IOCode::Ok);
+  }
+
+  // the send buffers are after the recv buffers
+  ud->bind_local_mr(handler->get_reg_attr().value());
+  u64 *send_buf = reinterpret_cast<u64 *>(
+      static_cast<char *>(mem->raw_ptr) + 8 * 1024 * 1024);
+
+  // the address handler is cached
+  auto dest = ud->my_attr();
+  auto ah = ud->create_ah(dest);
+  ASSERT_NE(nullptr, ah);
+  ASSERT_EQ(ah, ud->create_ah(dest));
+  ASSERT_EQ(ud->cached_ahs(), 1);
+
+  // send 1024 messages, in batches of kNMaxDoorbell
+  for (uint i = 0; i < 1024; i += kNMaxDoorbell) {
+    UDReq reqs[kNMaxDoorbell];
+    for (uint j = 0; j < kNMaxDoorbell; ++j) {
+      send_buf[i + j] = i + j;
+      reqs[j] = {.dest = &dest,
+                 .buf = send_buf + i + j,
+                 .len = sizeof(u64),
+                 .imm = 73};
+    }
+    auto res_s = ud->send_batch(reqs, kNMaxDoorbell);
+    RDMA_ASSERT(res_s == IOCode::Ok) << res_s.desc;
+
+    // UD only signals a fraction of the requests
+    ASSERT_LE(ud->ongoing_signaled(), 1);
+  }
+  ASSERT_EQ(ud->cached_ahs(), 1);
+
+  sleep(1);
+
+  uint recved_msgs = 0;
+  for (RecvIter<UD, 1024> iter(ud, recv_rs); iter.has_msgs(); iter.next()) {
+    auto imm_msg = iter.cur_msg().value();
+    auto buf = static_cast<char *>(std::get<1>(imm_msg)) + kGRHSz;
+
+    ASSERT_EQ(std::get<0>(imm_msg), 73);
+    ASSERT_EQ(*(reinterpret_cast<u64 *>(buf)), recved_msgs);
+    recved_msgs += 1;
+  }
+  ASSERT_EQ(recved_msgs, 1024);
+}
+
+TEST(UD, SplitRecvEntries) {
+  auto mem = Arc<RMem>(new RMem(4 * 1024 * 1024));
+  ASSERT_TRUE(mem->valid());
+  SimpleAllocator alloc(mem, 0);
+
+  auto recv_rs =
+      SplitRecvEntriesFactory<SimpleAllocator, 128, 64, 4096>::create(alloc);
+  recv_rs->sanity_check();
+
+  for (uint i = 0; i < 128; ++i) {
+    auto sges = recv_rs->sges_ptr(i);
+    ASSERT_EQ(recv_rs->rs[i].wr_id, sges[0].addr);
+    ASSERT_EQ(sges[0].length, 64);
+    ASSERT_EQ(sges[1].length, 4096);
+    ASSERT_EQ(sges[0].addr + 64, sges[1].addr);
+  }
+}
+
 } // namespace test
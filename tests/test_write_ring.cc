@@ -0,0 +1,179 @@
+#include <gtest/gtest.h>
+
+#include "../core/nicinfo.hh"
+#include "../core/qps/mod.hh"
+
+#include "../core/qps/write_ring.hh"
+
+#include "./fast_random.hh"
+#include "./rdma_env.hh"
+
+namespace test {
+
+using namespace rdmaio;
+using namespace rdmaio::qp;
+using namespace rdmaio::rmem;
+
+TEST(WriteRing, Basic) {
+  auto res = RNicInfo::query_dev_names();
+  ASSERT_FALSE(res.empty());
+  auto nic = std::make_shared<RNic>(res[0]);
+  ASSERT_TRUE(nic->valid());
+
+  // layout: [ring (64KB) ... credit (at 1MB) ... send buffer (at 2MB)]
+  auto mem = Arc<RMem>(new RMem(4 * 1024 * 1024));
+  ASSERT_TRUE(mem->valid());
+  auto handler = RegHandler::create(mem, nic).value();
+  auto mr = handler->get_reg_attr().value();
+
+  const u64 ring_sz = 64 * 1024;
+  const u64 credit_off = 1024 * 1024;
+  char *base = reinterpret_cast<char *>(mr.buf);
+  char *send_buf = base + 2 * 1024 * 1024;
+
+  auto recv_cq_res = Impl::create_cq(nic, 128);
+  RDMA_ASSERT(recv_cq_res == IOCode::Ok);
+  auto recv_cq = std::get<0>(recv_cq_res.desc);
+
+  auto send_qp = RC::create(nic, QPConfig()).value();
+  auto recv_qp = RC::create(nic, QPConfig(), recv_cq).value();
+  auto res_c = send_qp->connect(recv_qp->my_attr());
+  RDMA_ASSERT(res_c == IOCode::Ok);
+  res_c = recv_qp->connect(send_qp->my_attr());
+  RDMA_ASSERT(res_c == IOCode::Ok);
+  send_qp->bind_local_mr(mr);
+
+  {
+    auto sender =
+        WriteRingSender::create(
+            send_qp, mr, ring_sz,
+            reinterpret_cast<WriteRingCredit *>(base + credit_off))
+            .value();
+    auto receiver =
+        WriteRingReceiver<>::create(recv_qp, base, ring_sz, mr, credit_off)
+            .value();
+
+    FastRandom rand(0xdeadbeaf);
+    const usize total_msgs = 2000;
+    usize recved = 0;
+
+    auto check_msg = [&](const std::pair<char *, u32> &msg) {
+      ASSERT_GE(msg.second, sizeof(u32));
+      ASSERT_EQ(*(reinterpret_cast<u32 *>(msg.first)), recved);
+      for (uint j = sizeof(u32); j < msg.second; ++j)
+        ASSERT_EQ(msg.first[j], static_cast<char>(recved));
+      recved += 1;
+    };
+
+    for (uint i = 0; i < total_msgs; ++i) {
+      // messages are large enough to wrap the ring many times
+      u32 len = rand.rand_number<u32>(sizeof(u32), 3000);
+      // the send queue has at most 128 in-flight writes,
+      // so the slots of the send buffer are not overwritten before sent
+      char *msg = send_buf + (i % 256) * 4096;
+      *(reinterpret_cast<u32 *>(msg)) = i;
+      memset(msg + sizeof(u32), static_cast<char>(i), len - sizeof(u32));
+
+      while (true) {
+        auto res_s = sender->send(msg, len);
+        if (res_s == IOCode::Ok)
+          break;
+        RDMA_ASSERT(res_s == IOCode::NotReady) << res_s.desc;
+        // the ring is full, drain the receiver to return credits
+        for (auto m = receiver->next_msg(); m; m = receiver->next_msg())
+          check_msg(m.value());
+      }
+    }
+
+    while (recved < total_msgs) {
+      auto m = receiver->next_msg();
+      if (m)
+        check_msg(m.value());
+    }
+
+    // once idle, the receiver returns all the consumed space
+    ASSERT_FALSE(receiver->next_msg());
+    for (Timer t; sender->free_space() < ring_sz && t.passed_sec() < 1;)
+      ;
+    ASSERT_EQ(sender->free_space(), ring_sz);
+    ASSERT_FALSE(receiver->failed());
+  }
+
+  // the recv_cq is not owned by the QP
+  send_qp.reset();
+  recv_qp.reset();
+  ASSERT_EQ(ibv_destroy_cq(recv_cq), 0);
+}
+
+TEST(WriteRing, SmallMsgs) {
+  auto env = RDMAEnv::create(4 * 1024 * 1024).value();
+  auto mr = env.mr;
+
+  const u64 ring_sz = 64 * 1024;
+  const u64 credit_off = 1024 * 1024;
+  char *base = reinterpret_cast<char *>(mr.buf);
+  char *send_buf = base + 2 * 1024 * 1024;
+
+  auto recv_cq_res = Impl::create_cq(env.nic, 128);
+  RDMA_ASSERT(recv_cq_res == IOCode::Ok);
+  auto recv_cq = std::get<0>(recv_cq_res.desc);
+
+  // no RNR retry, so the QP fails if the sender outruns the recv entries
+  auto send_qp = RC::create(env.nic, QPConfig().set_rnr(0, 1)).value();
+  auto recv_qp = RC::create(env.nic, QPConfig(), recv_cq).value();
+  auto res_c = send_qp->connect(recv_qp->my_attr());
+  RDMA_ASSERT(res_c == IOCode::Ok);
+  res_c = recv_qp->connect(send_qp->my_attr());
+  RDMA_ASSERT(res_c == IOCode::Ok);
+  send_qp->bind_local_mr(mr);
+
+  {
+    // the ring holds far more 8-byte messages than the recv entries
+    const usize R = 16;
+    auto sender =
+        WriteRingSender::create(
+            send_qp, mr, ring_sz,
+            reinterpret_cast<WriteRingCredit *>(base + credit_off), R)
+            .value();
+    auto receiver =
+        WriteRingReceiver<R>::create(recv_qp, base, ring_sz, mr, credit_off)
+            .value();
+    ASSERT_EQ(sender->free_msgs(), R);
+
+    const u64 total_msgs = 10000;
+    u64 recved = 0;
+    auto drain = [&]() {
+      for (auto m = receiver->next_msg(); m; m = receiver->next_msg()) {
+        ASSERT_EQ(m.value().second, sizeof(u64));
+        ASSERT_EQ(*(reinterpret_cast<u64 *>(m.value().first)), recved);
+        recved += 1;
+      }
+    };
+
+    for (u64 i = 0; i < total_msgs; ++i) {
+      u64 *msg = reinterpret_cast<u64 *>(send_buf) + i % 256;
+      *msg = i;
+      while (true) {
+        auto res_s = sender->send(msg, sizeof(u64));
+        if (res_s == IOCode::Ok)
+          break;
+        RDMA_ASSERT(res_s == IOCode::NotReady) << res_s.desc;
+        // bounded by the recv entries, rather than the ring
+        ASSERT_GE(sender->free_space(), sizeof(u64));
+        drain();
+      }
+      ASSERT_LE(sender->free_msgs(), R);
+    }
+
+    for (Timer t; recved < total_msgs && t.passed_sec() < 1;)
+      drain();
+    ASSERT_EQ(recved, total_msgs);
+    ASSERT_FALSE(receiver->failed());
+  }
+
+  send_qp.reset();
+  recv_qp.reset();
+  ASSERT_EQ(ibv_destroy_cq(recv_cq), 0);
+}
+
+} // namespace test